@@ -1,14 +1,25 @@
 #define ARMA_USE_HDF5
 #include <iostream>
+#include <algorithm>
 #include <armadillo>
+#include <cctype>
 #include <complex>
+#include <cstdlib>
+#include <cstdint>
+#include <random>
+#include <memory>
 #include <chrono>
 #include <sstream>
-#include <tyche>
+#include <sys/resource.h>
 #include "KMatrix.hpp"
 #include "Amplitude.hpp"
 #include "Likelihood.hpp"
 #include "DataReader.hpp"
+#include "EnsembleSampler.hpp"
+#include "ChainCheckpoint.hpp"
+#include "ConvergenceMonitor.hpp"
+#include "RunConfig.hpp"
+#include "ThreadPool.hpp"
 #include "TH1F.h"
 #include "TCanvas.h"
 
@@ -16,75 +27,167 @@ using namespace std;
 using namespace arma;
 
 
+//!
+//! @brief Peak resident set size of the process so far, in MB
+//!
+static double peakResidentMB() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+//!
+//! @brief CPU time used by all threads of the process so far, in seconds
+//!
+static double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 1.0e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
 int main(int argc, char* argv[]) {
-  if (argc < 4) {
+  // "--config <file>" may appear anywhere, the remaining arguments are positional
+  vector<string> arguments;
+  string configPath;
+  for (int i = 1; i < argc; i++) {
+    const string argument = argv[i];
+    if ((argument == "--config" || argument == "-c") && i + 1 < argc) {
+      configPath = argv[++i];
+    } else {
+      arguments.push_back(argument);
+    }
+  }
+  if (arguments.size() < 3) {
     cout << "Insufficient command-line arguments provided." << endl;
     return 1;
   }
 
+  // Built-in settings, which a configuration file (see configs/default.cfg) overrides
+  RunConfig config;
+  for (const string& name : Likelihood::parameterNames()) {
+    const bool phase = name.find("Phase") != string::npos;
+    config.parameters.push_back({name, 0.0f, phase ? arma::Datum<float>::tau : 1000.0f});
+  }
+  config.addStage(50);
+  config.addMove("stretch", 0.5f);
+  config.addMove("differential_evolution", 0.30f);
+  config.addMove("differential_evolution", 0.05f, {1.0e-5f, 1.0f});
+  config.addMove("snooker", 0.15f);
+  // Read and checked before setup, so a typo does not cost a full setup
+  if (!configPath.empty()) {
+    config.read(configPath);
+  }
+  config.validate();
+  // 23 parameters also sample the f0(980) magnitude
+  config.checkParameters(Likelihood::parameterNames(config.parameters.size() == 23));
+  config.print();
+
   cout << "Starting Calculation" << endl;
-  Likelihood lh(argv[1], argv[2], argv[3]);
+  // The third argument is either the generated Monte Carlo or, if it is a plain number, the number of generated events
+  const string& genArgument = arguments[2];
+  const bool genIsCount = !genArgument.empty() && all_of(genArgument.begin(), genArgument.end(), ::isdigit);
+  unique_ptr<Likelihood> likelihood = genIsCount
+    ? make_unique<Likelihood>(arguments[0], arguments[1], stoll(genArgument))
+    : make_unique<Likelihood>(arguments[0], arguments[1], genArgument);
+  Likelihood& lh = *likelihood;
+  const int nThreads = arguments.size() > 3 ? stoi(arguments[3]) : 0;
+  lh.setNumThreads(nThreads);
+  if (arguments.size() > 4) {
+    lh.setInterpolationTolerance(stof(arguments[4]));
+  }
+  if (arguments.size() > 5) {
+    lh.setCacheDirectory(arguments[5]);
+  }
+  if (arguments.size() > 6) {
+    const char* scratch = getenv("TMPDIR");
+    lh.setMemoryBudget(stoull(arguments[6]) * 1024 * 1024, scratch ? scratch : "/tmp");
+  }
+  lh.setSelection(config.selection);
   lh.setup();
-  std::function<float(const Col<float>&)> lambda_func = [&](const Col<float>& x) {
-    return lh.getExtendedLogLikelihood(x);
+  cout << "Peak resident memory after setup: " << peakResidentMB() << " MB" << endl;
+  // One persistent pool runs the event sums of every likelihood call, so walker proposals evaluated concurrently
+  // by the ensemble share its threads instead of each starting their own
+  ThreadPool pool(std::max(nThreads, 0));
+  lh.setThreadPool(&pool);
+  cout << "Evaluating the likelihood on " << pool.size() << " threads" << endl;
+  // Only the const (thread-safe) evaluation path is reachable from the sampler, which evaluates the proposals of
+  // each half of the ensemble as one batch of concurrent walkers
+  const Likelihood& evaluator = lh;
+  const uint64_t seed = config.fixedSeed ? config.seed : random_device()();
+  EnsembleSampler sampler(config.walkers, config.parameters, [&evaluator](const fmat& positions) {
+    return evaluator.getExtendedLogLikelihoodWalkers(positions);
+  }, seed);
+
+  // The chain is appended to the checkpoint file in blocks while sampling, and a run stopped by a crash or a wall
+  // time limit continues from the last block when started again with KMATRIX_RESUME=1
+  const char* resumeVariable = getenv("KMATRIX_RESUME");
+  SamplerState state;
+  const bool resume = resumeVariable && string(resumeVariable) != "0" && ChainCheckpoint::load(config.output, state);
+  if (resume) {
+    sampler.setState(state);
+    cout << "Resuming from step " << state.steps << " of " << config.output << endl;
+  } else {
+    cout << "Setup done, initializing walkers (seed " << seed << ")" << endl;
+    sampler.init();
+  }
+  ChainCheckpoint checkpoint(config.output, config.parameters, sampler.numWalkers(), config.checkpointEvery, resume);
+
+  // Convergence is judged from the steps of this invocation, so a resumed run first refills the window
+  ConvergenceMonitor monitor(config.parameters.size(), sampler.numWalkers(), config.autocorrWindow);
+  const double cpuStart = cpuSeconds();
+  // Effective samples in the window per CPU-second spent on the steps in it
+  auto effectiveRate = [&monitor, &cpuStart]() {
+    const double windowSeconds = (cpuSeconds() - cpuStart) * monitor.numSamples() / monitor.numRecorded();
+    return monitor.effectiveSamples() / windowSeconds;
   };
-  tyche::Ensemble<float> ensemble(
-    70,
-      {
-        // {"f0(980) Magnitude", 0.0f, 10000.0f},
-        {"f0(1370) Magnitude", 0.0f, 1000.0f},
-        {"f0(1370) Phase", 0.0f, arma::Datum<float>::tau},
-        {"f0(1500) Magnitude", 0.0f, 1000.0f},
-        {"f0(1500) Phase", 0.0f, arma::Datum<float>::tau},
-        {"f0(1710) Magnitude", 0.0f, 1000.0f},
-        {"f0(1710) Phase", 0.0f, arma::Datum<float>::tau},
-        {"f2(1270) Magnitude", 0.0f, 1000.0f},
-        {"f2(1270) Phase", 0.0f, arma::Datum<float>::tau},
-        {"f2(1525) Magnitude", 0.0f, 1000.0f},
-        {"f2(1525) Phase", 0.0f, arma::Datum<float>::tau},
-        {"f2(1810) Magnitude", 0.0f, 1000.0f},
-        {"f2(1810) Phase", 0.0f, arma::Datum<float>::tau},
-        {"f2(1950) Magnitude", 0.0f, 1000.0f},
-        {"f2(1950) Phase", 0.0f, arma::Datum<float>::tau},
-        {"a0(980) Magnitude", 0.0f, 1000.0f},
-        {"a0(980) Phase", 0.0f, arma::Datum<float>::tau},
-        {"a0(1450) Magnitude", 0.0f, 1000.0f},
-        {"a0(1450) Phase", 0.0f, arma::Datum<float>::tau},
-        {"a2(1320) Magnitude", 0.0f, 1000.0f},
-        {"a2(1320) Phase", 0.0f, arma::Datum<float>::tau},
-        {"a2(1700) Magnitude", 0.0f, 1000.0f},
-        {"a2(1700) Phase", 0.0f, arma::Datum<float>::tau}
-      },
-      lambda_func 
-    );
-  cout << "Setup done, initializing walkers" << endl;
-  ensemble.init();
+  bool converged = false;
+  // The moves of every stage are owned by the configuration, so nothing is allocated per step and the memory in
+  // use stays flat however long the run is
   cout << "Beginning MCMC" << endl;
-  for (uint j = 0; j < 50; j++) {
-    ensemble.sample({{new tyche::StretchMove<float>(), 0.5f},
-                     {new tyche::DifferentialEvolutionMove<float>(23), 0.30f},
-                     {new tyche::DifferentialEvolutionMove<float>(23, 1.0e-5, 1.0), 0.05f},
-                     {new tyche::DifferentialEvolutionSnookerMove<float>(), 0.15f}});
-    cout << j << endl;
+  const vector<RunConfig::Stage>& stages = config.getStages();
+  uint64_t stageEnd = 0;
+  for (size_t s = 0; s < stages.size() && !converged; s++) {
+    stageEnd += stages[s].steps;
+    while (sampler.numSteps() < stageEnd && !converged) {
+      sampler.step(stages[s].moves);
+      checkpoint.record(sampler.getState());
+      monitor.record(sampler.getPositions());
+      if (sampler.numSteps() % config.checkpointEvery == 0 || sampler.numSteps() == stageEnd) {
+        cout << "Step " << sampler.numSteps() << " of " << config.totalSteps() << " (stage " << s + 1
+             << "), mean acceptance fraction " << arma::mean(sampler.acceptanceFraction()) << ", peak resident memory "
+             << peakResidentMB() << " MB" << endl;
+      }
+      if (monitor.numRecorded() % config.autocorrEvery == 0) {
+        monitor.update();
+        const arma::uword slowest = monitor.getTau().index_max();
+        cout << "Autocorrelation time up to " << monitor.getTau()(slowest) << " steps ("
+             << config.parameters[slowest].name << "), split-R-hat up to " << monitor.getRHat().max() << ", "
+             << monitor.effectiveSamples() << " effective samples in the last " << monitor.numSamples() << " steps ("
+             << effectiveRate() << " per CPU-second)" << endl;
+        converged = config.stopTauFactor > 0.0f
+            && monitor.converged(config.stopTauFactor, config.stopTauChange, config.stopRHat);
+      }
+    }
   }
-  cout << "Saving!" << endl;
-  ensemble.save("MCMC.h5");
-
-  // for (uint j = 0; j < 100; j++) {
-  //   ensemble.sample({{new tyche::StretchMove<float>(), 0.5f},
-  //                    {new tyche::DifferentialEvolutionMove<float>(23), 0.3f},
-  //                    {new tyche::DifferentialEvolutionMove<float>(23, 1.0e-5, 1.0), 0.1f},
-  //                    {new tyche::DifferentialEvolutionSnookerMove<float>(), 0.1f}});
-  // }
-  // cout << "Saving!" << endl;
-  // ensemble.save("MCMC.h5");
-
-  // for (uint j = 0; j < 200; j++) {
-  //   ensemble.sample({{new tyche::StretchMove<float>(), 0.5f},
-  //                    {new tyche::DifferentialEvolutionMove<float>(23), 0.3f},
-  //                    {new tyche::DifferentialEvolutionSnookerMove<float>(), 0.2f}});
-  // }
-  // cout << "Saving!" << endl;
-  // ensemble.save("MCMC.h5");
+  if (monitor.numRecorded() > 0) {
+    if (monitor.numRecorded() % config.autocorrEvery != 0) {
+      monitor.update();
+    }
+    cout << "Effective sample size " << monitor.effectiveSamples() << " in the last " << monitor.numSamples()
+         << " steps (" << effectiveRate() << " per CPU-second), " << cpuSeconds() - cpuStart
+         << " CPU-seconds of sampling" << endl;
+  }
+  if (converged) {
+    cout << "Converged after " << sampler.numSteps() << " steps, skipping the remaining "
+         << config.totalSteps() - sampler.numSteps() << " steps of the schedule" << endl;
+  }
+  checkpoint.close();
+  cout << "Saved " << checkpoint.numSteps() << " steps to " << config.output << " (mean acceptance fraction "
+       << arma::mean(sampler.acceptanceFraction()) << ", peak resident memory " << peakResidentMB() << " MB)"
+       << endl;
   return 0;
 }
@@ -4,9 +4,12 @@
 // #define ARMA_NO_DEBUG
 #include <armadillo>
 #include "KMatrix.hpp"
+#include "FixedKMatrix.hpp"
 
 using namespace arma;
 
+// All evaluation methods are const and only read the K-matrix constants, so a single Amplitude can be
+// shared between threads.
 class Amplitude {
   public:
     Amplitude();
@@ -14,7 +17,7 @@ class Amplitude {
         const cx_fvec& ikc_inv_f0,
         const cx_fvec& ikc_inv_f2,
         const cx_fvec& ikc_inv_a0,
-        const cx_fvec& ikc_inv_a2);
+        const cx_fvec& ikc_inv_a2) const;
     float intensity(const cx_fvec& betas, const float& s, const float& theta, const float& phi,
         const fmat& bw_f0,
         const fmat& bw_f2,
@@ -23,15 +26,27 @@ class Amplitude {
         const cx_fvec& ikc_inv_f0,
         const cx_fvec& ikc_inv_f2,
         const cx_fvec& ikc_inv_a0,
-        const cx_fvec& ikc_inv_a2);
-    complex<float> S0_wave();
-    complex<float> D2_wave(const float& theta, const float& phi);
-    cx_fvec ikc_inv_vec_f0(const float& s);
-    cx_fvec ikc_inv_vec_f2(const float& s);
-    cx_fvec ikc_inv_vec_a0(const float& s);
-    cx_fvec ikc_inv_vec_a2(const float& s);
-    fmat bw_f2(const float& s);
-    fmat bw_a2(const float& s);
+        const cx_fvec& ikc_inv_a2) const;
+    cx_fvec coefficients(const float& s, const float& theta, const float& phi,
+        const fmat& bw_f2,
+        const fmat& bw_a2,
+        const cx_fvec& ikc_inv_f0,
+        const cx_fvec& ikc_inv_f2,
+        const cx_fvec& ikc_inv_a0,
+        const cx_fvec& ikc_inv_a2) const;
+    bool coefficients(cx_fvec& result, const float& s, const float& theta, const float& phi) const;
+    bool massCoefficients(cx_fvec& result, const float& s) const;
+    void applyWaves(cx_fvec& result, const float& theta, const float& phi) const;
+    vector<float> singularPoints() const;
+    vector<float> constants() const;
+    complex<float> S0_wave() const;
+    complex<float> D2_wave(const float& theta, const float& phi) const;
+    cx_fvec ikc_inv_vec_f0(const float& s) const;
+    cx_fvec ikc_inv_vec_f2(const float& s) const;
+    cx_fvec ikc_inv_vec_a0(const float& s) const;
+    cx_fvec ikc_inv_vec_a2(const float& s) const;
+    fmat bw_f2(const float& s) const;
+    fmat bw_a2(const float& s) const;
 
   private:
     KMatrix kmat_f0 = KMatrix(5, 5, 0);
@@ -57,6 +72,12 @@ class Amplitude {
     fmat a2_malphas;
     fmat a2_galphas;
     fmat a2_cbkg;
+
+    // Fixed-size copies of the K-matrices above, used by the per-event setup path
+    FixedKMatrix<5, 5, 0> fixed_f0;
+    FixedKMatrix<4, 4, 2> fixed_f2;
+    FixedKMatrix<2, 2, 0> fixed_a0;
+    FixedKMatrix<3, 2, 2> fixed_a2;
 };
 
 #endif  // AMPLITUDE_H
@@ -0,0 +1,84 @@
+#ifndef AMPLITUDEBASIS_H
+#define AMPLITUDEBASIS_H
+#pragma once
+// #define ARMA_NO_DEBUG
+
+#include <armadillo>
+#include <complex>
+#include <vector>
+#include <ostream>
+#include <string>
+#include "EventStore.hpp"
+#include "IntensityKernels.hpp"
+#include "ThreadPool.hpp"
+
+using namespace std;
+
+/**
+ * @brief Per-event coefficients of each resonance coupling, stored column-wise
+ *
+ * The amplitude is linear in the couplings, so each event can be reduced to one complex coefficient per
+ * resonance with the (I - KC)^-1 column, barrier factors, propagator and spherical harmonic folded in.
+ * Weights, real parts and imaginary parts are stored as columns of a single EventStore, so every
+ * coefficient is contiguous over events and the real (or imaginary) parts of all coefficients form one
+ * column-major (stride x nCoefficients) matrix. Coefficients are ordered like the couplings, so the
+ * columns of each K-matrix (f0, f2, a0, a2) sit at a fixed offset (see kmatrixOffsets).
+ */
+class AmplitudeBasis {
+  public:
+    static constexpr arma::uword nCoefficients = 13;
+    static constexpr arma::uword nKMatrices = 4;
+    static constexpr const char* kmatrixNames[nKMatrices] = {"f0", "f2", "a0", "a2"};
+    static constexpr arma::uword kmatrixOffsets[nKMatrices] = {0, 5, 9, 11};
+    static constexpr arma::uword kmatrixSizes[nKMatrices] = {5, 4, 2, 2};
+
+    AmplitudeBasis();
+
+    void resize(const arma::uword& nEvents);
+    void set(const arma::uword& i, const arma::cx_fvec& coefficients, const float& weight);
+    void compact(const vector<unsigned char>& valid);
+    void reserve(const arma::uword& nEvents);
+    void append(const AmplitudeBasis& other);
+    void setUseHugePages(const bool& enable);
+    void mapFile(const int& fd, const size_t& offset, const arma::uword& nEvents, const size_t& stride);
+    const EventStore& getStore() const { return store; }
+    void setKernel(const IntensityKernel& newKernel);
+    IntensityKernel getKernel() const { return kernel; }
+    void setThreadPool(ThreadPool* newPool) { pool = newPool; }
+    ThreadPool* getThreadPool() const { return pool; }
+    arma::uword size() const;
+    size_t bytes() const;
+    void printMemoryReport(ostream& out, const string& name) const;
+
+    float weight(const arma::uword& i) const { return store.column(weightColumn)[i]; }
+    const float* weightData() const { return store.column(weightColumn); }
+    const float* realData(const arma::uword& k) const { return store.column(realColumn + k); }
+    const float* imagData(const arma::uword& k) const { return store.column(imagColumn + k); }
+
+    float intensity(const arma::uword& i, const arma::cx_fvec& betas) const;
+    float sumLogIntensity(const arma::cx_fvec& betas, const int& nThreads = 0) const;
+    float sumIntensity(const arma::cx_fvec& betas, const int& nThreads = 0) const;
+    arma::fvec sumLogIntensityBatch(const arma::cx_fmat& betas, const int& nThreads = 0) const;
+    arma::fvec sumIntensityBatch(const arma::cx_fmat& betas, const int& nThreads = 0) const;
+
+    static float pairwiseSum(const float* values, const arma::uword& n);
+
+  private:
+    static constexpr size_t weightColumn = 0;
+    static constexpr size_t realColumn = 1;
+    static constexpr size_t imagColumn = 1 + nCoefficients;
+    EventStore store;
+    IntensityKernel kernel = IntensityKernels::best();
+    // Not owned, the sums use OpenMP threads when this is null
+    ThreadPool* pool = nullptr;
+
+    // Partial sums are always taken over blocks of this many events, independent of the thread count
+    static constexpr arma::uword blockSize = 256;
+    float blockLogIntensity(const float* betas_re, const float* betas_im, const arma::uword& begin, const arma::uword& end) const;
+    float blockIntensity(const arma::cx_fvec& betas, const arma::uword& begin, const arma::uword& end) const;
+    arma::fmat blockIntensityBatch(const arma::fmat& betas_re, const arma::fmat& betas_im, const arma::uword& begin, const arma::uword& end) const;
+    template <typename Body>
+    void forEachBlock(const arma::uword& nBlocks, const int& nThreads, const Body& body) const;
+};
+
+#endif  // AMPLITUDEBASIS_H
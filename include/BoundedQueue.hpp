@@ -0,0 +1,73 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+using namespace std;
+
+/**
+ * @brief First-in first-out queue between threads that holds at most a fixed number of items
+ *
+ * Producers block while the queue is full, so a fast producer cannot get further ahead of the consumers than the
+ * capacity allows. Closing the queue wakes everybody: pushes fail from then on, and pops drain the remaining items
+ * before failing.
+ */
+template <typename T>
+class BoundedQueue {
+  public:
+    explicit BoundedQueue(const size_t& capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    //!
+    //! @brief Add an item, waiting while the queue is full
+    //!
+    //! \return false if the queue was closed (the item is dropped)
+    //!
+    bool push(T item) {
+      unique_lock<mutex> lock(guard);
+      notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+      if (closed) {
+        return false;
+      }
+      items.push_back(std::move(item));
+      notEmpty.notify_one();
+      return true;
+    }
+
+    //!
+    //! @brief Take the oldest item, waiting while the queue is empty and open
+    //!
+    //! \return false if the queue is closed and empty
+    //!
+    bool pop(T& item) {
+      unique_lock<mutex> lock(guard);
+      notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+      if (items.empty()) {
+        return false;
+      }
+      item = std::move(items.front());
+      items.pop_front();
+      notFull.notify_one();
+      return true;
+    }
+
+    void close() {
+      lock_guard<mutex> lock(guard);
+      closed = true;
+      notFull.notify_all();
+      notEmpty.notify_all();
+    }
+
+  private:
+    const size_t capacity;
+    mutex guard;
+    condition_variable notFull;
+    condition_variable notEmpty;
+    deque<T> items;
+    bool closed = false;
+};
+
+#endif  // BOUNDEDQUEUE_H
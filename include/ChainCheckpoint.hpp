@@ -0,0 +1,79 @@
+#ifndef CHAINCHECKPOINT_H
+#define CHAINCHECKPOINT_H
+#pragma once
+
+#include <H5Cpp.h>
+#include <armadillo>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BoundedQueue.hpp"
+#include "EnsembleSampler.hpp"
+
+using namespace std;
+
+/**
+ * @brief Chain of an EnsembleSampler written incrementally to an HDF5 file, from which a run can be resumed
+ *
+ * The file holds the samples in the chunked, compressed datasets "chain" (steps x walkers x parameters) and
+ * "log_prob" (steps x walkers), which grow as steps are recorded, and the parameter names in "parameters".
+ * Recorded steps are collected into blocks of flushEvery steps, which a background thread appends to the file
+ * while sampling continues. Once a block is synced to disk, the sampler state after its last step (positions, log
+ * probabilities, generator and number of steps) replaces the state file path + ".state", which is written under a
+ * temporary name and renamed, so it always holds one complete state. Resuming truncates the chain to the steps of
+ * that state, dropping any samples written after it. HDF5 itself does not survive a crash in the middle of a write
+ * (without SWMR), so such a crash can still leave a chain file that cannot be opened.
+ */
+class ChainCheckpoint {
+  public:
+    ChainCheckpoint(const string& path, const vector<SamplerParameter>& parameters, const arma::uword& nWalkers,
+        const size_t& flushEvery, const bool& resume = false);
+    ~ChainCheckpoint();
+    ChainCheckpoint(const ChainCheckpoint&) = delete;
+    ChainCheckpoint& operator=(const ChainCheckpoint&) = delete;
+
+    void record(const SamplerState& state);
+    void close();
+    uint64_t numSteps() const { return nSteps; }
+
+    static bool load(const string& path, SamplerState& state);
+
+  private:
+    struct Block {
+      uint64_t firstStep = 0;
+      uint64_t nSteps = 0;
+      vector<float> chain;
+      vector<float> logProbs;
+      SamplerState state;
+    };
+    // Steps per chunk of the datasets
+    static constexpr hsize_t chunkSteps = 64;
+    static constexpr int compressionLevel = 4;
+    string path;
+    arma::uword nWalkers;
+    arma::uword nParameters;
+    size_t flushEvery;
+    // Steps recorded so far, including the steps already in the file when resuming
+    uint64_t nSteps = 0;
+    unique_ptr<H5::H5File> file;
+    unique_ptr<Block> pending;
+    // At most two blocks wait for the writer, so a slow disk holds back the sampler instead of filling memory
+    BoundedQueue<unique_ptr<Block>> blocks;
+    thread writer;
+    bool closed = false;
+    mutex errorGuard;
+    exception_ptr error;
+
+    void create(const vector<SamplerParameter>& parameters);
+    void reopen();
+    void write(const Block& block);
+    void writerLoop();
+    void fail(const exception_ptr& writeError);
+    void rethrowError();
+};
+
+#endif  // CHAINCHECKPOINT_H
@@ -0,0 +1,63 @@
+#ifndef CHUNKEDBASIS_H
+#define CHUNKEDBASIS_H
+#pragma once
+
+#include <armadillo>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "AmplitudeBasis.hpp"
+
+using namespace std;
+
+/**
+ * @brief AmplitudeBasis kept on disk as a sequence of chunks, for samples that do not fit in memory
+ *
+ * Chunks are appended to an anonymous scratch file in the layout of their EventStore. The sums map one chunk at
+ * a time (see AmplitudeBasis::mapFile) and ask the kernel to read the next chunk ahead while the current one is
+ * summed, so at most about two chunks are resident. Chunk sums are accumulated in a fixed order, so results do
+ * not depend on the number of threads, but they can differ in the last bits from an in-memory AmplitudeBasis.
+ */
+class ChunkedBasis {
+  public:
+    ChunkedBasis() = default;
+    ~ChunkedBasis();
+    ChunkedBasis(const ChunkedBasis&) = delete;
+    ChunkedBasis& operator=(const ChunkedBasis&) = delete;
+
+    void open(const string& directory);
+    void close();
+    void append(const AmplitudeBasis& chunk);
+    bool isOpen() const { return fd >= 0; }
+    arma::uword size() const { return nEvents; }
+    size_t numChunks() const { return chunks.size(); }
+    size_t bytes() const { return fileBytes; }
+    // Sum the events of each chunk on this pool (not owned) instead of OpenMP threads
+    void setThreadPool(ThreadPool* newPool) { pool = newPool; }
+    void printMemoryReport(ostream& out, const string& name) const;
+
+    float sumLogIntensity(const arma::cx_fvec& betas, const int& nThreads = 0) const;
+    float sumIntensity(const arma::cx_fvec& betas, const int& nThreads = 0) const;
+    arma::fvec sumLogIntensityBatch(const arma::cx_fmat& betas, const int& nThreads = 0) const;
+    arma::fvec sumIntensityBatch(const arma::cx_fmat& betas, const int& nThreads = 0) const;
+
+  private:
+    struct Chunk {
+      size_t offset;
+      arma::uword nEvents;
+      size_t stride;
+      size_t bytes;
+    };
+    // Chunk offsets are multiples of this, so they can be mapped on any page size
+    static constexpr size_t chunkAlignment = 65536;
+    int fd = -1;
+    vector<Chunk> chunks;
+    size_t fileBytes = 0;
+    arma::uword nEvents = 0;
+    ThreadPool* pool = nullptr;
+
+    template <typename Result, typename Sum>
+    Result sumChunks(const Result& zero, const Sum& sum) const;
+};
+
+#endif  // CHUNKEDBASIS_H
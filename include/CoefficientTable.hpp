@@ -0,0 +1,56 @@
+#ifndef COEFFICIENTTABLE_H
+#define COEFFICIENTTABLE_H
+#pragma once
+// #define ARMA_NO_DEBUG
+
+#include <armadillo>
+#include <ostream>
+#include <vector>
+#include "Amplitude.hpp"
+
+using namespace std;
+
+/**
+ * @brief Piecewise-linear table of the s-dependent amplitude coefficients (Amplitude::massCoefficients)
+ *
+ * The (I - KC)^-1 columns, barrier factors and propagators only depend on s, so they can be tabulated once
+ * instead of being recomputed for every event. The grid starts out uniform with extra nodes at the channel
+ * thresholds and resonance poles, and each interval is bisected until linear interpolation reproduces the
+ * exact coefficients at its midpoint and quarter points to within the tolerance. The error at s is measured
+ * separately for the coefficients of each wave W (S0 or D2) as
+ * \f[
+ * \max_{k \in W} |c_k(s) - \hat{c}_k(s)| / \max_{k \in W} |c_k(s)|
+ * \f]
+ * which does not change when the waves are applied, whatever the angles. The error is only checked at these three
+ * points of each interval, which is where linear interpolation of a smooth function errs most, so it is a
+ * heuristic rather than a guaranteed bound for every event.
+ * Intervals that cannot reach the tolerance (for example because an endpoint cannot be evaluated) are marked,
+ * and events that fall in them are evaluated exactly, as are events outside of the table.
+ */
+class CoefficientTable {
+  public:
+    CoefficientTable(const Amplitude& amplitude, const float& sMin, const float& sMax, const float& tolerance,
+        const arma::uword& nInitial = 64, const arma::uword& maxNodes = 1 << 16);
+
+    bool coefficients(arma::cx_fvec& result, const float& s, const float& theta, const float& phi) const;
+
+    arma::uword size() const { return nodes.size(); }
+    float maxError() const { return maxObservedError; }
+    void printReport(ostream& out) const;
+
+  private:
+    const Amplitude& amplitude;
+    float tolerance;
+    vector<float> nodes;
+    // Coefficients at each node (nCoefficients x nodes.size())
+    arma::cx_fmat values;
+    // Whether each interval [nodes[i], nodes[i + 1]] can be interpolated
+    vector<unsigned char> intervalValid;
+    // Largest error seen at the points checked in accepted intervals
+    float maxObservedError = 0.0f;
+    bool budgetExhausted = false;
+
+    static float error(const arma::cx_fvec& exact, const arma::cx_fvec& interpolated);
+};
+
+#endif  // COEFFICIENTTABLE_H
@@ -0,0 +1,62 @@
+#ifndef CONVERGENCEMONITOR_H
+#define CONVERGENCEMONITOR_H
+#pragma once
+
+#include <armadillo>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * @brief Online convergence diagnostics of an ensemble chain: integrated autocorrelation times and split-R-hat
+ *
+ * The positions of the most recent steps (at most window of them) are kept in a ring buffer as they are recorded.
+ * update() estimates, for every parameter, the integrated autocorrelation time tau from the autocorrelation
+ * function of each walker, computed with an FFT and averaged over walkers, summed up to the first lag M with
+ * M >= 5 tau (Sokal's automatic window). It also computes the Gelman-Rubin potential scale reduction with each
+ * walker's history split into two halves, so a walker still drifting shows up as two disagreeing chains.
+ *
+ * The history is the evidence for both estimates, so the stopping rule compares its length with tau: the window
+ * has to be longer than the wanted multiple of the largest expected tau for the rule to be met.
+ */
+class ConvergenceMonitor {
+  public:
+    // Autocorrelation times are summed up to the first lag that is at least this many times tau
+    static constexpr double windowFactor = 5.0;
+
+    ConvergenceMonitor(const arma::uword& nParameters, const arma::uword& nWalkers, const arma::uword& window);
+
+    void record(const arma::fmat& positions);
+    void update();
+    bool converged(const double& tauFactor, const double& maxTauChange, const double& maxRHat) const;
+
+    // Steps in the history
+    arma::uword numSamples() const { return nSamples; }
+    // Steps recorded since the monitor was created
+    uint64_t numRecorded() const { return nRecorded; }
+    const arma::vec& getTau() const { return tau; }
+    const arma::vec& getRHat() const { return rHat; }
+    double effectiveSamples() const;
+
+    static double integratedTime(const arma::mat& series, bool* reliable = nullptr);
+    static double splitRHat(const arma::mat& series);
+
+  private:
+    arma::uword nParameters;
+    arma::uword nWalkers;
+    arma::uword window;
+    // history(t, w, p) is parameter p of walker w at slot t of the ring buffer
+    arma::fcube history;
+    arma::uword next = 0;
+    arma::uword nSamples = 0;
+    uint64_t nRecorded = 0;
+    arma::vec tau;
+    arma::vec previousTau;
+    arma::vec rHat;
+    // Whether the summation window of each tau fit inside the history
+    arma::uvec reliable;
+
+    arma::mat series(const arma::uword& p) const;
+};
+
+#endif  // CONVERGENCEMONITOR_H
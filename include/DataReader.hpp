@@ -2,30 +2,92 @@
 #define DATAREADER_H
 #pragma once
 
+#include <array>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
+#include <TChain.h>
 #include <TFile.h>
 #include <TTree.h>
+#include "EventSelection.hpp"
 
 using namespace std;
 
-class DataReader {
+// Kinematics of a run of events, one vector per quantity
+struct EventColumns {
+  vector<float> masses;
+  vector<float> weights;
+  vector<float> thetas;
+  vector<float> phis;
+
+  size_t size() const { return masses.size(); }
+  void compact(const vector<unsigned char>& valid);
+  void append(const EventColumns& other);
+};
+
+class DataReader : public EventColumns {
 public:
+  // filePath may be a single file, a glob pattern, or a list file (.txt or .list) naming one file or pattern per line
   DataReader(const string& filePath, const string& treeName);
+  DataReader(const vector<string>& paths, const string& treeName);
   ~DataReader();
+  DataReader(const DataReader&) = delete;
+  DataReader& operator=(const DataReader&) = delete;
 
-  void read();
+  static vector<string> expandPaths(const string& filePath);
+  // Number of entries of the tree in each file, read from the tree headers only (see the definition for the cache)
+  static vector<Long64_t> countEntries(const vector<string>& paths, const string& treeName,
+      const string& countCache = "", const int& nThreads = 0);
+  static void printCounts(ostream& out, const string& name, const vector<string>& paths,
+      const vector<Long64_t>& entries);
+
+  // Read the tree in parallel over its clusters (nThreads = 0 uses the OpenMP default)
+  void read(const int& nThreads = 0);
+  // Only keep the events passing the selection in subsequent reads
+  void setSelection(const EventSelection& newSelection);
+  const EventSelection& getSelection() const { return selection; }
+  // Read only the entries [begin, end) of the tree, replacing the columns
+  void readChunk(const Long64_t& begin, const Long64_t& end);
+  Long64_t numEntries() const;
+  void compact(const vector<unsigned char>& valid);
+  const vector<string>& getFilePaths() const { return filePaths; }
+  const vector<Long64_t>& getFileEntries() const { return fileEntries; }
+  const string& getTreeName() const { return treeName; }
+  void printSummary(ostream& out, const string& name) const;
+
+  // Clusters are the units read by read(), and can also be read one at a time (e.g. to overlap reading with other
+  // work). A FileHandle keeps the file of the last cluster open for the next one.
+  struct FileHandle {
+    unique_ptr<TFile> file;
+    TTree* tree = nullptr;
+    size_t index = static_cast<size_t>(-1);
+  };
+  size_t numClusters() const { return clusters.size(); }
+  void readCluster(const size_t& c, EventColumns& out, FileHandle& handle) const;
 
   int nEvents;
-  vector<float> masses;
-  vector<float> weights;
-  vector<float> thetas;
-  vector<float> phis;
 
 private:
-  TFile* file;
-  TTree* tree;
+  vector<string> filePaths;
+  // Number of entries in each file, and the index of the first entry of each file in the merged columns
+  vector<Long64_t> fileEntries;
+  vector<Long64_t> fileOffsets;
+  // Entries [begin, end) of one file that share a compressed basket cluster
+  struct Cluster {
+    size_t file;
+    Long64_t begin;
+    Long64_t end;
+  };
+  vector<Cluster> clusters;
+  EventSelection selection;
+  // Output columns of readRange, in the order masses, weights, thetas, phis
+  using ColumnSet = array<vector<float>*, 4>;
+  string treeName;
+  // Chain over all files, used for sequential reads (see readChunk)
+  TChain* chain = nullptr;
+  TTree* clusterTree(const size_t& c, FileHandle& handle) const;
+  size_t readRange(TTree* source, const Long64_t& begin, const Long64_t& end, const ColumnSet& out, const size_t& at) const;
 };
 
 #endif  // DATAREADER_H
@@ -0,0 +1,138 @@
+#ifndef ENSEMBLESAMPLER_H
+#define ENSEMBLESAMPLER_H
+#pragma once
+
+#include <armadillo>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Parameter with a uniform prior between lower and upper
+struct SamplerParameter {
+  string name;
+  float lower;
+  float upper;
+};
+
+// Everything needed to continue a run exactly where it stopped
+struct SamplerState {
+  // (nParameters x nWalkers)
+  arma::fmat positions;
+  arma::fvec logProbs;
+  // Text form of the random number generator
+  string rng;
+  uint64_t steps = 0;
+};
+
+/**
+ * @brief Proposal for the walkers of one half of the ensemble, given the walkers of the other half
+ */
+class Move {
+  public:
+    virtual ~Move() = default;
+    //!
+    //! @brief Propose new positions
+    //!
+    //! @param[in] active Positions of the walkers to move (nParameters x n)
+    //! @param[in] complement Positions of the other walkers (nParameters x m)
+    //! @param[out] proposed Proposed positions (nParameters x n)
+    //! @param[out] logFactors Log of the proposal ratio that enters the acceptance probability of each walker
+    //! @param[in,out] rng Random number generator
+    //!
+    virtual void propose(const arma::fmat& active, const arma::fmat& complement, arma::fmat& proposed,
+        arma::fvec& logFactors, mt19937_64& rng) const = 0;
+    // Smallest number of walkers in the complement
+    virtual arma::uword minComplement() const = 0;
+};
+
+// Affine-invariant stretch move (Goodman & Weare 2010)
+class StretchMove : public Move {
+  public:
+    explicit StretchMove(const float& a = 2.0f);
+    void propose(const arma::fmat& active, const arma::fmat& complement, arma::fmat& proposed,
+        arma::fvec& logFactors, mt19937_64& rng) const override;
+    arma::uword minComplement() const override { return 1; }
+
+  private:
+    float a;
+};
+
+// Differential evolution move (ter Braak 2006), gamma0 = 0 uses 2.38 / sqrt(2 nParameters), and every parameter
+// gets its own normal jitter of width sigma
+class DifferentialEvolutionMove : public Move {
+  public:
+    explicit DifferentialEvolutionMove(const float& sigma = 1.0e-5f, const float& gamma0 = 0.0f);
+    void propose(const arma::fmat& active, const arma::fmat& complement, arma::fmat& proposed,
+        arma::fvec& logFactors, mt19937_64& rng) const override;
+    arma::uword minComplement() const override { return 2; }
+
+  private:
+    float sigma;
+    float gamma0;
+};
+
+// Differential evolution snooker move (ter Braak & Vrugt 2008)
+class DifferentialEvolutionSnookerMove : public Move {
+  public:
+    explicit DifferentialEvolutionSnookerMove(const float& gamma = 1.7f);
+    void propose(const arma::fmat& active, const arma::fmat& complement, arma::fmat& proposed,
+        arma::fvec& logFactors, mt19937_64& rng) const override;
+    arma::uword minComplement() const override { return 3; }
+
+  private:
+    float gamma;
+};
+
+/**
+ * @brief Ensemble MCMC sampler that moves one half of the walkers at a time
+ *
+ * Each step picks one move from a weighted mixture, splits the walkers into two random halves and moves each half
+ * using the other as the complement. The proposals of a half are handed to the log probability as one matrix, so
+ * the walkers can be evaluated concurrently (see Likelihood::getExtendedLogLikelihoodWalkers). All random numbers
+ * are drawn on the calling thread from one generator, so a run is reproducible from its seed, and getState and
+ * setState continue it exactly where it stopped.
+ */
+class EnsembleSampler {
+  public:
+    // Log probability of every column of a (nParameters x n) matrix
+    using LogProbability = function<arma::fvec(const arma::fmat&)>;
+
+    EnsembleSampler(const arma::uword& nWalkers, const vector<SamplerParameter>& parameters,
+        const LogProbability& logProbability, const uint64_t& seed = 0);
+
+    void init();
+    void step(const vector<pair<const Move*, float>>& moves);
+
+    SamplerState getState() const;
+    void setState(const SamplerState& state);
+
+    arma::uword numWalkers() const { return nWalkers; }
+    const vector<SamplerParameter>& getParameters() const { return parameters; }
+    const arma::fmat& getPositions() const { return positions; }
+    const arma::fvec& getLogProbs() const { return logProbs; }
+    uint64_t numSteps() const { return steps; }
+    arma::fvec acceptanceFraction() const;
+
+  private:
+    arma::uword nWalkers;
+    vector<SamplerParameter> parameters;
+    LogProbability logProbability;
+    mt19937_64 rng;
+    arma::fmat positions;
+    arma::fvec logProbs;
+    // Accepted proposals per walker since init() or setState()
+    arma::uvec accepted;
+    uint64_t steps = 0;
+    uint64_t stepsSinceStart = 0;
+    // Tries per walker to find a starting position with a finite log probability
+    static constexpr int initTries = 100;
+
+    arma::fvec evaluate(const arma::fmat& proposed) const;
+};
+
+#endif  // ENSEMBLESAMPLER_H
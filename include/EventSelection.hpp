@@ -0,0 +1,45 @@
+#ifndef EVENTSELECTION_H
+#define EVENTSELECTION_H
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Cuts applied to every event while it is read, before it is stored or precomputed
+ *
+ * The default selection keeps every event (see keepsAll). Ranges include both ends, except that the mass window is
+ * [massMin, massMax) so adjacent mass slices do not share events. Events with NaN kinematics fail every range.
+ */
+struct EventSelection {
+  float massMin = 0.0f;
+  float massMax = numeric_limits<float>::infinity();
+  // Smallest |Weight| kept (e.g. a tiny positive value drops zero-weight events but keeps negative weights)
+  float minAbsWeight = 0.0f;
+  float thetaMin = 0.0f;
+  float thetaMax = static_cast<float>(M_PI);
+  float phiMin = -static_cast<float>(M_PI);
+  float phiMax = static_cast<float>(M_PI);
+
+  bool accepts(const float& mass, const float& weight, const float& theta, const float& phi) const {
+    return mass >= massMin && mass < massMax && fabs(weight) >= minAbsWeight
+        && theta >= thetaMin && theta <= thetaMax && phi >= phiMin && phi <= phiMax;
+  }
+
+  // Whether accepts() keeps every event with finite kinematics
+  bool keepsAll() const {
+    const EventSelection all;
+    return massMin <= all.massMin && massMax >= all.massMax && minAbsWeight <= all.minAbsWeight
+        && thetaMin <= all.thetaMin && thetaMax >= all.thetaMax && phiMin <= all.phiMin && phiMax >= all.phiMax;
+  }
+
+  // All cuts in a fixed order (e.g. for the key of cached results)
+  vector<double> parameters() const {
+    return {massMin, massMax, minAbsWeight, thetaMin, thetaMax, phiMin, phiMax};
+  }
+};
+
+#endif  // EVENTSELECTION_H
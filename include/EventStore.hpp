@@ -0,0 +1,59 @@
+#ifndef EVENTSTORE_H
+#define EVENTSTORE_H
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * @brief Contiguous, aligned column storage for per-event quantities
+ *
+ * All columns live in a single allocation. Each column starts on a 64-byte boundary and consecutive
+ * columns are a fixed stride apart, so a run of columns can be viewed as one column-major matrix.
+ * Large stores can optionally be backed by transparent huge pages, or mapped copy-on-write from a file
+ * that holds a previously written store (see mapFile).
+ */
+class EventStore {
+  public:
+    static constexpr size_t alignment = 64;
+
+    EventStore(const size_t& nColumns = 0);
+    ~EventStore();
+    EventStore(const EventStore&) = delete;
+    EventStore& operator=(const EventStore&) = delete;
+    EventStore(EventStore&& other) noexcept;
+    EventStore& operator=(EventStore&& other) noexcept;
+
+    void resize(const size_t& nEvents);
+    void reserve(const size_t& newCapacity);
+    void setUseHugePages(const bool& enable);
+    void mapFile(const int& fd, const size_t& offset, const size_t& newEvents, const size_t& newStride);
+
+    size_t size() const { return nEvents; }
+    size_t capacity() const { return nCapacity; }
+    size_t stride() const { return columnStride; }
+    size_t numColumns() const { return nColumns; }
+    size_t bytes() const { return bufferBytes; }
+    bool hugePages() const { return mapped && !fileBacked; }
+    bool isFileBacked() const { return fileBacked; }
+
+    float* column(const size_t& k) { return buffer + k * columnStride; }
+    const float* column(const size_t& k) const { return buffer + k * columnStride; }
+
+  private:
+    size_t nColumns;
+    size_t nEvents = 0;
+    size_t nCapacity = 0;
+    size_t columnStride = 0;
+    float* buffer = nullptr;
+    size_t bufferBytes = 0;
+    bool mapped = false;
+    bool fileBacked = false;
+    bool useHugePages = false;
+
+    void release();
+};
+
+#endif  // EVENTSTORE_H
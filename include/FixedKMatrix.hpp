@@ -0,0 +1,293 @@
+#ifndef FIXEDKMATRIX_H
+#define FIXEDKMATRIX_H
+#pragma once
+// #define ARMA_NO_DEBUG
+
+#include <array>
+#include <cmath>
+#include <complex>
+#include <sstream>
+#include <stdexcept>
+#include <armadillo>
+#include "KMatrix.hpp"
+#include "SmallSolver.hpp"
+
+using namespace std;
+
+/**
+ * @brief K-matrix with sizes and angular momentum fixed at compile time
+ *
+ * Evaluates the same quantities as KMatrix, but everything lives in std::array storage on the stack, the
+ * barrier factor is selected with if constexpr, and all loops have compile-time trip counts. The
+ * s-independent products of couplings and barrier factors are computed once at construction. KMatrix
+ * remains the general (dynamically sized) implementation, and a FixedKMatrix is built from an initialized
+ * KMatrix.
+ */
+template <size_t NChannels, size_t NAlphas, int J>
+class FixedKMatrix {
+  static_assert(J == 0 || J == 2, "Only J = 0 and J = 2 are supported");
+
+  public:
+    using ChannelVector = array<complex<float>, NChannels>;
+    using AlphaVector = array<complex<float>, NAlphas>;
+    using ChannelMatrix = array<array<complex<float>, NChannels>, NChannels>;
+    using BarrierVector = array<float, NChannels>;
+    using BarrierMatrix = array<array<float, NAlphas>, NChannels>;
+
+    FixedKMatrix() = default;
+
+    //!
+    //! @brief Copy the constants of an initialized KMatrix with matching dimensions
+    //!
+    //! @param[in] kmat Initialized K-matrix with NChannels channels, NAlphas resonances and angular momentum J
+    //!
+    explicit FixedKMatrix(const KMatrix& kmat) {
+      if (kmat.numChannels != NChannels || kmat.numAlphas != NAlphas || kmat.J != J) {
+        stringstream error;
+        error << "Error: Cannot build a (" << NChannels << ", " << NAlphas << ", " << J
+              << ") fixed K-matrix from a (" << kmat.numChannels << ", " << kmat.numAlphas << ", " << kmat.J << ") K-matrix!";
+        throw runtime_error(error.str());
+      }
+      for (size_t i = 0; i < NChannels; i++) {
+        m1s[i] = kmat.getM1s()(i).real();
+        m2s[i] = kmat.getM2s()(i).real();
+        for (size_t j = 0; j < NChannels; j++) {
+          cBkg[i][j] = kmat.getCBkg()(i, j).real();
+        }
+      }
+      for (size_t a = 0; a < NAlphas; a++) {
+        mAlphas2[a] = kmat.getMAlphas()(a).real() * kmat.getMAlphas()(a).real();
+        for (size_t i = 0; i < NChannels; i++) {
+          gAlphas[i][a] = kmat.getGAlphas()(i, a).real();
+          bwAlphas[i][a] = kmat.getBWAlphaMat()(i, a);
+          for (size_t j = 0; j < NChannels; j++) {
+            gigj[a][i][j] = gAlphas[i][a] * gAlphas[j][a];
+            bwAlphas2[a][i][j] = kmat.getBWAlphaMat()(i, a) * kmat.getBWAlphaMat()(j, a);
+          }
+        }
+      }
+    }
+
+    //! @brief See KMatrix::chi_p
+    ChannelVector chi_p(const float& s) const {
+      ChannelVector result;
+      for (size_t i = 0; i < NChannels; i++) {
+        result[i] = complex<float>(1.0f - (m1s[i] + m2s[i]) * (m1s[i] + m2s[i]) / s, 0.0f);
+      }
+      return result;
+    }
+
+    //! @brief See KMatrix::chi_m
+    ChannelVector chi_m(const float& s) const {
+      ChannelVector result;
+      for (size_t i = 0; i < NChannels; i++) {
+        result[i] = complex<float>(1.0f - (m1s[i] - m2s[i]) * (m1s[i] - m2s[i]) / s, 0.0f);
+      }
+      return result;
+    }
+
+    //! @brief See KMatrix::rho
+    ChannelVector rho(const float& s) const {
+      ChannelVector result;
+      for (size_t i = 0; i < NChannels; i++) {
+        const float sum2 = (m1s[i] + m2s[i]) * (m1s[i] + m2s[i]);
+        const float diff2 = (m1s[i] - m2s[i]) * (m1s[i] - m2s[i]);
+        result[i] = sqrt(complex<float>((sum2 - s) * (diff2 - s) / (s * s), 0.0f));
+      }
+      return result;
+    }
+
+    //! @brief See KMatrix::q
+    ChannelVector q(const float& s) const {
+      ChannelVector result;
+      for (size_t i = 0; i < NChannels; i++) {
+        const float sum2 = (m1s[i] + m2s[i]) * (m1s[i] + m2s[i]);
+        const float diff2 = (m1s[i] - m2s[i]) * (m1s[i] - m2s[i]);
+        result[i] = sqrt(complex<float>((sum2 - s) * (diff2 - s) / (4.0f * s), 0.0f));
+      }
+      return result;
+    }
+
+    //! @brief See KMatrix::blatt_weisskopf
+    BarrierVector blatt_weisskopf(const float& s) const {
+      BarrierVector result;
+      if constexpr (J == 0) {
+        result.fill(1.0f);
+      } else {
+        const ChannelVector qs = q(s);
+        for (size_t i = 0; i < NChannels; i++) {
+          const float z = real(qs[i] * qs[i]) / (0.1973f * 0.1973f);
+          result[i] = sqrt(13.0f * z * z / ((z - 3.0f) * (z - 3.0f) + 9.0f * z));
+        }
+      }
+      return result;
+    }
+
+    //! @brief See KMatrix::B
+    BarrierMatrix B(const float& s) const {
+      BarrierMatrix result;
+      const BarrierVector bw = blatt_weisskopf(s);
+      for (size_t i = 0; i < NChannels; i++) {
+        for (size_t a = 0; a < NAlphas; a++) {
+          result[i][a] = bw[i] / bwAlphas[i][a];
+        }
+      }
+      return result;
+    }
+
+    //! @brief See KMatrix::K
+    ChannelMatrix K(const float& s) const {
+      ChannelMatrix result{};
+      const BarrierVector bw = blatt_weisskopf(s);
+      for (size_t a = 0; a < NAlphas; a++) {
+        const float propagator = 1.0f / (s - mAlphas2[a]);
+        for (size_t i = 0; i < NChannels; i++) {
+          for (size_t j = 0; j < NChannels; j++) {
+            float term = gigj[a][i][j] * propagator + cBkg[i][j];
+            if constexpr (J != 0) {
+              term *= bw[i] * bw[j] / bwAlphas2[a][i][j];
+            }
+            result[i][j] += term;
+          }
+        }
+      }
+      return result;
+    }
+
+    //! @brief See KMatrix::K (with Adler zero term)
+    ChannelMatrix K(const float& s, const float& s_0, const float& s_norm) const {
+      ChannelMatrix result = K(s);
+      const float adler = (s - s_0) / s_norm;
+      for (size_t i = 0; i < NChannels; i++) {
+        for (size_t j = 0; j < NChannels; j++) {
+          result[i][j] *= adler;
+        }
+      }
+      return result;
+    }
+
+    //!
+    //! @brief Diagonal of the Chew-Mandelstam matrix (see KMatrix::C)
+    //!
+    //! KMatrix::C evaluates its mass-difference term with \f(m_2 = m_1\f), which makes that term vanish, so
+    //! only the first term is computed here.
+    //!
+    ChannelVector C(const float& s) const {
+      ChannelVector result;
+      const ChannelVector chi = chi_p(s);
+      const ChannelVector rhos = rho(s);
+      for (size_t i = 0; i < NChannels; i++) {
+        result[i] = rhos[i] * log((chi[i] + rhos[i]) / (chi[i] - rhos[i])) / static_cast<float>(arma::datum::pi);
+      }
+      return result;
+    }
+
+    //!
+    //! @brief Calculates the inverse of the "IKC" matrix without throwing (see KMatrix::IKC_inv)
+    //!
+    //! @param[out] result Inverse of (I + K(s)C(s))
+    //! @param[in] s Input mass squared
+    //! \return false if the inverse fails
+    //!
+    bool IKC_inv(ChannelMatrix& result, const float& s) const {
+      return invert(result, K(s), C(s));
+    }
+
+    //! @brief Calculates the inverse of the "IKC" matrix with Adler zero term without throwing
+    bool IKC_inv(ChannelMatrix& result, const float& s, const float& s_0, const float& s_norm) const {
+      return invert(result, K(s, s_0, s_norm), C(s));
+    }
+
+    //!
+    //! @brief Calculates one column of the inverse of the "IKC" matrix (see KMatrix::IKC_inv_col)
+    //!
+    //! @param[out] result Column of (I + K(s)C(s))^-1
+    //! @param[in] s Input mass squared
+    //! @param[in] channel Column to compute
+    //! \return Estimate of the reciprocal condition number of (I + K(s)C(s)) (0 if it is singular)
+    //!
+    float IKC_inv_col(ChannelVector& result, const float& s, const size_t& channel) const {
+      return SmallSolver::solveColumn<NChannels>(IKC(K(s), C(s)), channel, result);
+    }
+
+    //! @brief Calculates one column of the inverse of the "IKC" matrix with Adler zero term in the K-matrix
+    float IKC_inv_col(ChannelVector& result, const float& s, const float& s_0, const float& s_norm, const size_t& channel) const {
+      return SmallSolver::solveColumn<NChannels>(IKC(K(s, s_0, s_norm), C(s)), channel, result);
+    }
+
+    //!
+    //! @brief Calculates the coefficient of each coupling in the amplitude of one channel (see KMatrix::coefficients)
+    //!
+    //! @param[out] result Coefficient of each resonance coupling
+    //! @param[in] s Input mass squared
+    //! @param[in] channel Channel (column of the inverse of the "IKC" matrix) to use
+    //! \return false if the inverse fails or the coefficients are not finite
+    //!
+    bool coefficients(AlphaVector& result, const float& s, const size_t& channel) const {
+      ChannelVector column;
+      return IKC_inv_col(column, s, channel) > 0.0f && fold(result, s, column);
+    }
+
+    //! @brief Calculates the coefficients with the Adler zero term in the K-matrix
+    bool coefficients(AlphaVector& result, const float& s, const float& s_0, const float& s_norm, const size_t& channel) const {
+      ChannelVector column;
+      return IKC_inv_col(column, s, s_0, s_norm, channel) > 0.0f && fold(result, s, column);
+    }
+
+  private:
+    array<float, NChannels> m1s{};
+    array<float, NChannels> m2s{};
+    array<float, NAlphas> mAlphas2{};
+    array<array<float, NAlphas>, NChannels> gAlphas{};
+    array<array<float, NChannels>, NChannels> cBkg{};
+    BarrierMatrix bwAlphas{};
+    // s-independent products g_i g_j and bw_i(m_alpha) bw_j(m_alpha) for each resonance
+    array<array<array<float, NChannels>, NChannels>, NAlphas> gigj{};
+    array<array<array<float, NChannels>, NChannels>, NAlphas> bwAlphas2{};
+
+    static ChannelMatrix IKC(const ChannelMatrix& kmat, const ChannelVector& cdiag) {
+      // C is diagonal, so (KC)_ij = K_ij C_jj
+      ChannelMatrix result;
+      for (size_t i = 0; i < NChannels; i++) {
+        for (size_t j = 0; j < NChannels; j++) {
+          result[i][j] = kmat[i][j] * cdiag[j] + (i == j ? 1.0f : 0.0f);
+        }
+      }
+      return result;
+    }
+
+    static bool invert(ChannelMatrix& result, const ChannelMatrix& kmat, const ChannelVector& cdiag) {
+      const ChannelMatrix ikc = IKC(kmat, cdiag);
+      typename arma::Mat<complex<float>>::template fixed<NChannels, NChannels> dense, inverse;
+      for (size_t i = 0; i < NChannels; i++) {
+        for (size_t j = 0; j < NChannels; j++) {
+          dense(i, j) = ikc[i][j];
+        }
+      }
+      if (!arma::inv(inverse, dense, arma::inv_opts::allow_approx)) {
+        return false;
+      }
+      for (size_t i = 0; i < NChannels; i++) {
+        for (size_t j = 0; j < NChannels; j++) {
+          result[i][j] = inverse(i, j);
+        }
+      }
+      return true;
+    }
+
+    bool fold(AlphaVector& result, const float& s, const ChannelVector& column) const {
+      const BarrierMatrix bmat = B(s);
+      bool finite = true;
+      for (size_t a = 0; a < NAlphas; a++) {
+        complex<float> sum = 0.0f;
+        for (size_t j = 0; j < NChannels; j++) {
+          sum += column[j] * (gAlphas[j][a] * bmat[j][a]);
+        }
+        result[a] = sum / (s - mAlphas2[a]);
+        finite = finite && std::isfinite(result[a].real()) && std::isfinite(result[a].imag());
+      }
+      return finite;
+    }
+};
+
+#endif  // FIXEDKMATRIX_H
@@ -0,0 +1,47 @@
+#ifndef INTENSITYKERNELS_H
+#define INTENSITYKERNELS_H
+#pragma once
+
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * @brief Instruction sets available for the data-term kernel
+ */
+enum class IntensityKernel {
+  Scalar,
+  AVX2,
+  AVX512
+};
+
+/**
+ * @brief Kernels for the weighted sum of log-intensities on split real/imaginary coefficient columns
+ *
+ * Each kernel evaluates
+ * \f[
+ * \sum_j w_j \ln\left|\sum_k c_{jk}\beta_k\right|^2
+ * \f]
+ * over a block of events, where the real (imaginary) part of coefficient k of event j is found at
+ * re[k * stride + j] (im[k * stride + j]). The vector kernels use a polynomial logarithm whose error is
+ * bounded by IntensityKernels::logTolerance; the scalar kernel uses std::log. The best kernel supported by
+ * the running CPU is chosen at runtime.
+ */
+class IntensityKernels {
+  public:
+    // Bound on the relative error of the vectorized logarithm (absolute error for arguments near 1)
+    static constexpr float logTolerance = 3.0e-7f;
+
+    static IntensityKernel best();
+    static bool supported(const IntensityKernel& kernel);
+    static const char* name(const IntensityKernel& kernel);
+
+    static float sumLogIntensity(const IntensityKernel& kernel,
+        const float* re, const float* im, const size_t& stride, const size_t& nCoefficients,
+        const float* weights, const size_t& n,
+        const float* betas_re, const float* betas_im);
+
+    static void logArray(const IntensityKernel& kernel, const float* x, float* result, const size_t& n);
+};
+
+#endif  // INTENSITYKERNELS_H
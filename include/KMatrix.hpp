@@ -18,26 +18,28 @@ class KMatrix {
   public:
     const arma::uword numAlphas;
     const arma::uword numChannels;
-    arma::cx_fmat mAlphas;
-    arma::cx_fmat mChannels;
-    arma::cx_fvec m1s;
-    arma::cx_fvec m2s;
-    arma::cx_fmat gAlphas;
-    arma::cx_fmat cBkg;
-    int J;
-    arma::fmat bwAlphaMat;
-    arma::fcube bwAlphaCube;
+    const int J;
 
     // Constructor
     KMatrix(int numChannels, int numAlphas, int J);
 
-    // Initialize the matrices and vectors
+    // Initialize the matrices and vectors (the only way to change them, since the s-independent constants derived
+    // from them are computed here)
     void initialize(
         const arma::fmat& m_alphas,
         const arma::fmat& m_channels,
         const arma::fmat& g_alphas,
         const arma::fmat& c_bkg);
 
+    const arma::cx_fmat& getMAlphas() const { return mAlphas; }
+    const arma::cx_fmat& getMChannels() const { return mChannels; }
+    const arma::cx_fvec& getM1s() const { return m1s; }
+    const arma::cx_fvec& getM2s() const { return m2s; }
+    const arma::cx_fmat& getGAlphas() const { return gAlphas; }
+    const arma::cx_fmat& getCBkg() const { return cBkg; }
+    const arma::fmat& getBWAlphaMat() const { return bwAlphaMat; }
+    const arma::fcube& getBWAlphaCube() const { return bwAlphaCube; }
+
     // Print the matrices and vectors
     void print() const;
 
@@ -51,17 +53,49 @@ class KMatrix {
     arma::cx_fmat K(const float& s) const;
     arma::cx_fmat K(const float& s, const float& s_0, const float& s_norm) const;
     arma::cx_fmat C(const float& s) const;
-    arma::cx_fmat IKC_inv(const float& s);
-    arma::cx_fmat IKC_inv(const float& s, const float& s_0, const float& s_norm);
+    arma::cx_fmat IKC_inv(const float& s) const;
+    arma::cx_fmat IKC_inv(const float& s, const float& s_0, const float& s_norm) const;
+    bool IKC_inv(arma::cx_fmat& result, const float& s) const;
+    bool IKC_inv(arma::cx_fmat& result, const float& s, const float& s_0, const float& s_norm) const;
+    float IKC_inv_col(arma::cx_fvec& result, const float& s, const arma::uword& channel) const;
+    float IKC_inv_col(arma::cx_fvec& result, const float& s, const float& s_0, const float& s_norm, const arma::uword& channel) const;
     arma::cx_fvec P(const float& s, const arma::cx_fvec& betas) const;
     arma::cx_fvec P(const float& s, const arma::cx_fvec& betas, const arma::fmat& B) const;
-    complex<float> F(const float& s, const arma::cx_fvec& betas, const arma::cx_fvec& ikc_inv_vec);
-    complex<float> F(const float& s, const arma::cx_fvec& betas, const arma::fmat& B, const arma::cx_fvec& ikc_inv_vec);
+    complex<float> F(const float& s, const arma::cx_fvec& betas, const arma::cx_fvec& ikc_inv_vec) const;
+    complex<float> F(const float& s, const arma::cx_fvec& betas, const arma::fmat& B, const arma::cx_fvec& ikc_inv_vec) const;
+    arma::cx_fvec coefficients(const float& s, const arma::fmat& B, const arma::cx_fvec& ikc_inv_vec) const;
+
+    // Batch versions, evaluated over a contiguous array of s values (one row per s in each output)
+    void evaluate(const arma::fvec& s, arma::cx_fmat& rho, arma::fmat& bw, arma::cx_fmat& cdiag, arma::cx_fcube& kmats) const;
+    void evaluate(const arma::fvec& s, const float& s_0, const float& s_norm,
+        arma::cx_fmat& rho, arma::fmat& bw, arma::cx_fmat& cdiag, arma::cx_fcube& kmats) const;
+    arma::fvec IKC_inv_col(arma::cx_fmat& result, const arma::fvec& s, const arma::uword& channel) const;
+    arma::fvec IKC_inv_col(arma::cx_fmat& result, const arma::fvec& s, const float& s_0, const float& s_norm, const arma::uword& channel) const;
 
   private:
+    arma::cx_fmat mAlphas;
+    arma::cx_fmat mChannels;
+    arma::cx_fvec m1s;
+    arma::cx_fvec m2s;
+    arma::cx_fmat gAlphas;
+    arma::cx_fmat cBkg;
+    arma::fmat bwAlphaMat;
+    arma::fcube bwAlphaCube;
+    // s-independent constants, filled by initialize()
+    arma::fvec mAlphas2;
+    arma::fvec sumMass2;
+    arma::fvec diffMass2;
+    arma::fmat cBkgReal;
+    arma::fcube gigj;
+
     function<arma::fvec(const float&)> blattWeisskopfPtr;
-    arma::fvec blatt_weisskopf0(const float& s);
-    arma::fvec blatt_weisskopf2(const float& s);
+    arma::fvec blatt_weisskopf0(const float& s) const;
+    arma::fvec blatt_weisskopf2(const float& s) const;
+    arma::cx_fmat IKC(const arma::cx_fmat& kmat, const float& s) const;
+    static float solveColumn(arma::cx_fvec& result, const arma::cx_fmat& IKC, const arma::uword& channel);
+    void evaluate(const arma::fvec& s, const float& adlerZero, const float& adlerNorm, const bool& adler,
+        arma::cx_fmat& rho, arma::fmat& bw, arma::cx_fmat& cdiag, arma::cx_fcube& kmats) const;
+    arma::fvec IKC_inv_col(arma::cx_fmat& result, const arma::cx_fmat& cdiag, const arma::cx_fcube& kmats, const arma::uword& channel) const;
 };
 
 #endif  // KMATRIX_H
@@ -0,0 +1,48 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+#pragma once
+
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * @brief Four-momentum components of many particles, one contiguous array per component
+ */
+struct FourMomentumColumns {
+  const float* e;
+  const float* px;
+  const float* py;
+  const float* pz;
+};
+
+/**
+ * @brief Batch kinematics for the resonance (p1 + p2) recoiling against a single particle
+ *
+ * Computes the invariant mass of p1 + p2 and the direction of p1 in the resonance rest frame, with
+ * \f[
+ * \hat{z} = -\hat{p}_{\text{recoil}}^{\text{(rest)}},\quad
+ * \hat{y} = \widehat{\vec{p}_{\text{beam}} \times (-\vec{p}_{\text{recoil}})},\quad
+ * \hat{x} = \hat{y}\times\hat{z}
+ * \f]
+ * where the y axis is built from lab-frame momenta. This is the same convention as the ROOT
+ * (TLorentzVector/TLorentzRotation) calculation it replaces, carried out in double precision on plain arrays
+ * so that the arithmetic vectorizes and does not depend on ROOT.
+ */
+class Kinematics {
+  public:
+    // Events processed per pass of the vectorized loops
+    static constexpr size_t blockSize = 256;
+
+    static void resonanceFrame(
+        const FourMomentumColumns& beam,
+        const FourMomentumColumns& recoil,
+        const FourMomentumColumns& p1,
+        const FourMomentumColumns& p2,
+        const size_t& n,
+        float* masses,
+        float* thetas,
+        float* phis);
+};
+
+#endif  // KINEMATICS_H
@@ -4,11 +4,17 @@
 // #define ARMA_NO_DEBUG
 
 #include "Amplitude.hpp"
+#include "AmplitudeBasis.hpp"
+#include "ChunkedBasis.hpp"
+#include "CoefficientTable.hpp"
 #include "DataReader.hpp"
+#include "EventSelection.hpp"
+#include "ThreadPool.hpp"
 #include <string>
 #include <armadillo>
 #include <vector>
-#include <deque>
+#include <memory>
+#include <cstdint>
 
 using namespace std;
 
@@ -21,37 +27,118 @@ public:
              const string& data_tree = "kin",
              const string& acc_tree = "kin",
              const string& gen_tree = "kin");
+  // Constructor for a known number of generated events (e.g. from production records)
+  Likelihood(const string& data_path,
+             const string& acc_path,
+             const Long64_t& n_generated,
+             const string& data_tree = "kin",
+             const string& acc_tree = "kin");
 
   // Setup function
   void setup();
 
+  // Fold the accepted Monte Carlo into a matrix of normalization integrals during setup() (default: true)
+  void setPrecomputeIntegrals(const bool& enable);
+
+  // Number of threads used for the event sums (0 uses the OpenMP default, results do not depend on this)
+  void setNumThreads(const int& numThreads);
+
+  // Interpolate the s-dependent part of the coefficients from a table in setup() instead of evaluating it for
+  // every event (0 evaluates every event exactly, which is the default)
+  void setInterpolationTolerance(const float& tolerance);
+
+  // Cache the per-sample results of setup() in this directory and reuse them in later runs (empty disables the
+  // cache, which is the default)
+  void setCacheDirectory(const string& directory);
+
+  // Stream both samples from disk in chunks so that setup() and the likelihood need roughly this many bytes of
+  // memory, keeping the per-event coefficients in scratch files in directory (0 keeps everything in memory, which
+  // is the default)
+  void setMemoryBudget(const size_t& bytes, const string& directory = "/tmp");
+
+  // Only read the data and accepted Monte Carlo events passing these cuts in setup() (the generated Monte Carlo is
+  // only counted, so it is not affected)
+  void setSelection(const EventSelection& selection);
+
+  // Back the per-event stores with transparent huge pages (must be set before setup())
+  void setUseHugePages(const bool& enable);
+
+  // Print the memory held by the per-event stores
+  void printMemoryReport() const;
+
+  // Evaluate each likelihood call on a single thread, so that the caller can evaluate several walkers at once
+  // without oversubscribing the cores (default: false, calls made inside an OpenMP parallel region are always
+  // single-threaded)
+  void setWalkerParallel(const bool& enable);
+
+  // Run the event sums of every likelihood call (and the walker loop of getExtendedLogLikelihoodWalkers) as tasks
+  // on this pool, which is not owned, instead of OpenMP threads (nullptr, the default, uses OpenMP). Concurrent
+  // walker evaluations then share the pool's threads, so setNumThreads and setWalkerParallel do not apply.
+  void setThreadPool(ThreadPool* pool);
+
+  // The likelihood methods below only read state built by setup(), so after setup() they can be called from any
+  // number of threads at once, and return bitwise-identical results for identical params on every thread
+
+  // Names of the parameters of the methods below, in order: magnitude and phase of every coupling except the
+  // f0(500) (fixed to zero) and the f0(980), whose magnitude is fixed as the reference unless freeF0980 puts it
+  // first
+  static vector<string> parameterNames(const bool& freeF0980 = false);
+
   // Calculate log likelihood
-  float getExtendedLogLikelihood(const arma::Col<float>& params);
+  float getExtendedLogLikelihood(const arma::Col<float>& params) const;
+
+  // Calculate log likelihood for each column of params in a single pass over the events
+  arma::fvec getExtendedLogLikelihoodBatch(const arma::fmat& params) const;
+
+  // Calculate log likelihood for each column of params, evaluating the columns concurrently with one thread each
+  // (each result equals getExtendedLogLikelihood of that column)
+  arma::fvec getExtendedLogLikelihoodWalkers(const arma::fmat& params) const;
 
 private:
   Amplitude amplitude;
   DataReader data;
   DataReader acc;
-  DataReader gen;
-  int nGenerated;
+  // Generated Monte Carlo, which is only counted in setup() unless nGenerated was given
+  string genPath;
+  string genTree;
+  Long64_t nGenerated = 0;
+  bool precomputeIntegrals = true;
+  int nThreads = 0;
+  bool walkerParallel = false;
+  ThreadPool* threadPool = nullptr;
+  float interpolationTolerance = 0.0f;
+  // Only built in setup() when interpolationTolerance > 0
+  unique_ptr<CoefficientTable> coefficientTable;
+  string cacheDirectory;
+  size_t memoryBudget = 0;
+  string scratchDirectory = "/tmp";
+  // Accepted Monte Carlo events per partial normalization integral in setup()
+  static constexpr int integralBlockSize = 4096;
+  // (13 x 13) matrix of accepted Monte Carlo integrals, sum_i w_i conj(c_i) c_i^T / nGenerated
+  arma::cx_fmat normIntegrals;
   void printLoadingBar (const int& progress, const int& total, const int& barWidth = 50) const;
-  deque<arma::cx_fvec> ikc_inv_vec_f0;
-  deque<arma::cx_fvec> ikc_inv_vec_f2;
-  deque<arma::cx_fvec> ikc_inv_vec_a0;
-  deque<arma::cx_fvec> ikc_inv_vec_a2;
-  deque<arma::fmat> bw_f0;
-  deque<arma::fmat> bw_f2;
-  deque<arma::fmat> bw_a0;
-  deque<arma::fmat> bw_a2;
-
-  deque<arma::cx_fvec> ikc_inv_vec_f0_mc;
-  deque<arma::cx_fvec> ikc_inv_vec_f2_mc;
-  deque<arma::cx_fvec> ikc_inv_vec_a0_mc;
-  deque<arma::cx_fvec> ikc_inv_vec_a2_mc;
-  deque<arma::fmat> bw_f0_mc;
-  deque<arma::fmat> bw_f2_mc;
-  deque<arma::fmat> bw_a0_mc;
-  deque<arma::fmat> bw_a2_mc;
+  arma::cx_fvec betasFromParams(const arma::Col<float>& params) const;
+  static void checkParameterCount(const arma::uword& nParameters);
+  int evaluationThreads() const;
+  float logLikelihood(const arma::cx_fvec& betas, const int& threads) const;
+  void buildCoefficientTable(const DataReader& reader);
+  uint64_t cacheKey(const DataReader& reader, const vector<double>& settings) const;
+  void fillBasis(const EventColumns& events, vector<unsigned char>& valid, AmplitudeBasis& basis,
+      const int& threads) const;
+  arma::cx_mat sumIntegrals(const EventColumns& events, vector<unsigned char>& valid, const int& threads) const;
+  void ingest(const bool& readData, const bool& readAcc, vector<unsigned char>& dataValid,
+      vector<unsigned char>& accValid, arma::cx_mat& integrals);
+  Long64_t streamingChunkEvents() const;
+  void setupStreaming();
+  void countGenerated();
+  bool eventCoefficients(arma::cx_fvec& result, const float& mass, const float& theta, const float& phi) const;
+
+  AmplitudeBasis dataBasis;
+  // Only filled when precomputeIntegrals is disabled
+  AmplitudeBasis accBasis;
+  // Only used with a memory budget
+  ChunkedBasis dataChunks;
+  ChunkedBasis accChunks;
 };
 
 #endif  // LIKELIHOOD_H
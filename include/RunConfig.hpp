@@ -0,0 +1,83 @@
+#ifndef RUNCONFIG_H
+#define RUNCONFIG_H
+#pragma once
+
+#include <armadillo>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "EnsembleSampler.hpp"
+#include "EventSelection.hpp"
+
+using namespace std;
+
+/**
+ * @brief Settings of an MCMC run: ensemble size, parameter bounds, event selection, output, stopping rule and the
+ * schedule of move mixtures
+ *
+ * A run is a sequence of stages, each a number of steps with its own weighted mixture of moves. The moves are
+ * created once, when the stage is added, and are owned by the configuration for the whole run, so stages hold
+ * plain pointers that can be passed to EnsembleSampler::step on every step.
+ *
+ * Settings are read from a text file with one "key [name] = values" entry per line ('#' starts a comment):
+ *
+ *     walkers = 70
+ *     seed = 12345
+ *     output = MCMC.h5
+ *     checkpoint_every = 10
+ *     stop_tau_factor = 50
+ *     parameter f0(1370) Phase = 0 tau
+ *     selection mass = 1.0 2.0
+ *     stage = 100
+ *     move stretch = 0.5
+ *     move differential_evolution = 0.3 1e-5 1.0
+ *
+ * Keys that are not in the file keep their current value. The first parameter entry of a file replaces all
+ * current parameters and the first stage entry replaces all current stages, so a file either lists all of them
+ * or none.
+ */
+class RunConfig {
+  public:
+    struct Stage {
+      uint64_t steps = 0;
+      vector<pair<const Move*, float>> moves;
+      // Type of each move, for printing
+      vector<string> moveNames;
+    };
+
+    arma::uword walkers = 70;
+    vector<SamplerParameter> parameters;
+    // Without a seed, every run draws a random one
+    bool fixedSeed = false;
+    uint64_t seed = 0;
+    string output = "MCMC.h5";
+    size_t checkpointEvery = 10;
+    EventSelection selection;
+    // Convergence estimates every autocorrEvery steps, from the last autocorrWindow steps
+    size_t autocorrEvery = 100;
+    size_t autocorrWindow = 5000;
+    // The run stops early once the window spans stopTauFactor autocorrelation times of every parameter, no tau
+    // changed by more than stopTauChange (relative) since the last estimate and every split-R-hat is below
+    // stopRHat; a factor of 0 always runs the full schedule
+    float stopTauFactor = 50.0f;
+    float stopTauChange = 0.01f;
+    float stopRHat = 1.01f;
+
+    void read(const string& path);
+    void addStage(const uint64_t& steps);
+    void addMove(const string& type, const float& weight, const vector<float>& arguments = {});
+    void clearStages();
+    void validate() const;
+    void checkParameters(const vector<string>& expected) const;
+    void print() const;
+    const vector<Stage>& getStages() const { return stages; }
+    uint64_t totalSteps() const;
+
+  private:
+    vector<Stage> stages;
+    vector<unique_ptr<Move>> moves;
+};
+
+#endif  // RUNCONFIG_H
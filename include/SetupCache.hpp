@@ -0,0 +1,42 @@
+#ifndef SETUPCACHE_H
+#define SETUPCACHE_H
+#pragma once
+
+#include <armadillo>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AmplitudeBasis.hpp"
+#include "DataReader.hpp"
+
+using namespace std;
+
+/**
+ * @brief On-disk cache of everything Likelihood::setup() derives from one input sample
+ *
+ * A cache file holds the validity mask of the input events and the kinematics of the surviving events. It also
+ * holds the per-event amplitude basis and/or the (unnormalized) matrix of normalization integrals. The basis is
+ * written in the layout of its EventStore and mapped back copy-on-write, so loading it copies nothing. Every
+ * section starts on a 64 kB boundary so it can be mapped on any page size.
+ *
+ * Files are named after a key that hashes the input files (canonical path, size and modification time), the
+ * tree name, the Amplitude constants, the setup settings and the format version. A changed input or amplitude
+ * therefore never matches an old file.
+ */
+class SetupCache {
+  public:
+    // Bump whenever the file layout or the way the cached quantities are computed changes
+    static constexpr uint32_t version = 2;
+    static constexpr size_t sectionAlignment = 65536;
+
+    static uint64_t key(const vector<string>& filePaths, const string& treeName, const vector<float>& constants,
+        const vector<double>& settings);
+    static string path(const string& directory, const string& name, const uint64_t& key);
+
+    static bool load(const string& path, const uint64_t& key, DataReader& reader, vector<unsigned char>& valid,
+        AmplitudeBasis* basis, arma::cx_mat* integrals);
+    static void save(const string& path, const uint64_t& key, const DataReader& reader,
+        const vector<unsigned char>& valid, const AmplitudeBasis* basis, const arma::cx_mat* integrals);
+};
+
+#endif  // SETUPCACHE_H
@@ -0,0 +1,123 @@
+#ifndef SMALLSOLVER_H
+#define SMALLSOLVER_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * @brief Dense complex solves for the small systems that appear in the K-matrix
+ *
+ * The K-matrices in this analysis have between two and five channels, where a LAPACK call costs far more than
+ * the arithmetic. These kernels have the matrix size as a template parameter so that the elimination loops are
+ * fully unrolled, and they only solve for the single column of the inverse that is needed.
+ */
+class SmallSolver {
+  public:
+    template <size_t N>
+    using Matrix = array<array<complex<float>, N>, N>;
+    template <size_t N>
+    using Vector = array<complex<float>, N>;
+
+    //!
+    //! @brief Solves \f(A x = e_{\text{column}}\f), i.e. computes one column of \f(A^{-1}\f)
+    //!
+    //! Uses the closed-form inverse for N = 2 and LU decomposition with partial pivoting otherwise.
+    //!
+    //! @param[in] A Matrix indexed as A[row][column] (taken by value and overwritten by its LU decomposition)
+    //! @param[in] column Index of the unit vector on the right-hand side
+    //! @param[out] x Solution vector
+    //! \return Estimate of the reciprocal 1-norm condition number of A (0 if A is singular or the solution is not
+    //! finite)
+    //!
+    template <size_t N>
+    static float solveColumn(Matrix<N> A, const size_t& column, Vector<N>& x) {
+      static_assert(N >= 2, "Use a scalar division for 1x1 systems");
+      float normA = 0.0f;
+      for (size_t j = 0; j < N; j++) {
+        float colSum = 0.0f;
+        for (size_t i = 0; i < N; i++) {
+          colSum += abs1(A[i][j]);
+        }
+        normA = std::max(normA, colSum);
+      }
+      float rcond;
+      if constexpr (N == 2) {
+        const complex<float> det = A[0][0] * A[1][1] - A[0][1] * A[1][0];
+        if (abs1(det) == 0.0f) {
+          return 0.0f;
+        }
+        const complex<float> invDet = 1.0f / det;
+        const Matrix<2> inverse = {{
+          {A[1][1] * invDet, -A[0][1] * invDet},
+          {-A[1][0] * invDet, A[0][0] * invDet}
+        }};
+        x[0] = inverse[0][column];
+        x[1] = inverse[1][column];
+        // The full inverse is available, so the condition number is exact (in the abs1 norm)
+        const float normInv = std::max(abs1(inverse[0][0]) + abs1(inverse[1][0]), abs1(inverse[0][1]) + abs1(inverse[1][1]));
+        rcond = 1.0f / (normA * normInv);
+      } else {
+        Vector<N> b{};
+        b[column] = 1.0f;
+        for (size_t k = 0; k < N; k++) {
+          size_t pivot = k;
+          for (size_t i = k + 1; i < N; i++) {
+            if (abs1(A[i][k]) > abs1(A[pivot][k])) {
+              pivot = i;
+            }
+          }
+          if (abs1(A[pivot][k]) == 0.0f) {
+            return 0.0f;
+          }
+          if (pivot != k) {
+            std::swap(A[k], A[pivot]);
+            std::swap(b[k], b[pivot]);
+          }
+          const complex<float> invPivot = 1.0f / A[k][k];
+          for (size_t i = k + 1; i < N; i++) {
+            const complex<float> factor = A[i][k] * invPivot;
+            for (size_t j = k + 1; j < N; j++) {
+              A[i][j] -= factor * A[k][j];
+            }
+            b[i] -= factor * b[k];
+          }
+        }
+        float uMin = abs1(A[0][0]);
+        float uMax = uMin;
+        float normX = 0.0f;
+        for (size_t i = N; i-- > 0;) {
+          complex<float> sum = b[i];
+          for (size_t j = i + 1; j < N; j++) {
+            sum -= A[i][j] * x[j];
+          }
+          x[i] = sum / A[i][i];
+          uMin = std::min(uMin, abs1(A[i][i]));
+          uMax = std::max(uMax, abs1(A[i][i]));
+          normX += abs1(x[i]);
+        }
+        // ||x|| is a lower bound on ||A^-1||, and the spread of the pivots catches matrices that are
+        // ill-conditioned in a direction this column does not probe
+        rcond = std::min(1.0f / (normA * normX), uMin / uMax);
+      }
+      for (size_t i = 0; i < N; i++) {
+        if (!std::isfinite(x[i].real()) || !std::isfinite(x[i].imag())) {
+          return 0.0f;
+        }
+      }
+      return std::isfinite(rcond) ? rcond : 0.0f;
+    }
+
+  private:
+    // |Re z| + |Im z|, the cheap norm LAPACK uses for complex pivoting
+    static float abs1(const complex<float>& z) {
+      return std::fabs(z.real()) + std::fabs(z.imag());
+    }
+};
+
+#endif  // SMALLSOLVER_H
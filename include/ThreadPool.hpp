@@ -0,0 +1,81 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Persistent pool of threads with one task deque per thread and work stealing
+ *
+ * parallelFor splits an index range into tasks and pushes them onto the deque of the calling thread (callers
+ * from outside the pool share one extra deque). Every thread takes the newest task from its own deque and steals
+ * the oldest task from another deque when its own is empty. A caller does not block while its tasks run: it
+ * executes its own and other tasks until its range is done, so loops can be nested (e.g. the event loop of each
+ * walker evaluation inside a loop over walkers) without deadlocks or extra threads.
+ *
+ * The grain size adapts to the number of loops in flight: a loop that runs alone is split finely enough to
+ * occupy every thread, while many concurrent loops (one per walker) are each split into fewer, larger tasks.
+ */
+class ThreadPool {
+  public:
+    // Number of tasks per thread a loop is split into when it is the only one in flight
+    static constexpr size_t tasksPerThread = 4;
+
+    explicit ThreadPool(const size_t& nThreads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Threads taking part in the loops, including the calling thread
+    size_t size() const { return workers.size() + 1; }
+    size_t activeLoops() const { return nActive.load(); }
+
+    void parallelFor(const size_t& n, const function<void(size_t, size_t)>& body);
+
+    static size_t grainSize(const size_t& n, const size_t& nThreads, const size_t& nActive);
+
+  private:
+    struct Loop {
+      const function<void(size_t, size_t)>* body;
+      atomic<size_t> remaining;
+      mutex errorGuard;
+      exception_ptr error;
+    };
+    struct Task {
+      Loop* loop;
+      size_t begin;
+      size_t end;
+    };
+    struct TaskDeque {
+      mutex guard;
+      deque<Task> tasks;
+    };
+
+    // One deque per worker, followed by the deque shared by callers from outside the pool
+    vector<unique_ptr<TaskDeque>> deques;
+    vector<thread> workers;
+    mutex sleepGuard;
+    condition_variable wake;
+    // Tasks pushed but not yet taken, workers sleep while this is zero (only raised under sleepGuard)
+    atomic<long> pending{0};
+    bool stopping = false;
+    atomic<size_t> nActive{0};
+
+    size_t ownDeque() const;
+    bool runOne(const size_t& self);
+    static void run(const Task& task);
+    void workerLoop(const size_t& self);
+};
+
+#endif  // THREADPOOL_H
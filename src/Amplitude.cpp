@@ -1,5 +1,6 @@
 #include "Amplitude.hpp"
 #include "KMatrix.hpp"
+#include <algorithm>
 
 Amplitude::Amplitude() {
   f0_mchannels = {
@@ -78,53 +79,54 @@ Amplitude::Amplitude() {
     {-0.08707, -0.06193, -0.17435}
   };
   kmat_a2.initialize(a2_malphas, a2_mchannels, a2_galphas.t(), a2_cbkg);
+
+  fixed_f0 = FixedKMatrix<5, 5, 0>(kmat_f0);
+  fixed_f2 = FixedKMatrix<4, 4, 2>(kmat_f2);
+  fixed_a0 = FixedKMatrix<2, 2, 0>(kmat_a0);
+  fixed_a2 = FixedKMatrix<3, 2, 2>(kmat_a2);
 }
 
-cx_fvec Amplitude::ikc_inv_vec_f0(const float& s) {
-  try {
-    cx_fmat invMat = kmat_f0.IKC_inv(s, 0.0091125, 1.0);
-    return cx_fvec(invMat.col(2));
-  } catch (const runtime_error& e) {
-    throw;
+cx_fvec Amplitude::ikc_inv_vec_f0(const float& s) const {
+  cx_fvec result;
+  if (kmat_f0.IKC_inv_col(result, s, 0.0091125, 1.0, 2) == 0.0f) {
+    throw runtime_error("Matrix inverse failed!");
   }
+  return result;
 }
-cx_fvec Amplitude::ikc_inv_vec_f2(const float& s) {
-  try {
-    cx_fmat invMat = kmat_f2.IKC_inv(s);
-    return cx_fvec(invMat.col(2));
-  } catch (const runtime_error& e) {
-    throw;
+cx_fvec Amplitude::ikc_inv_vec_f2(const float& s) const {
+  cx_fvec result;
+  if (kmat_f2.IKC_inv_col(result, s, 2) == 0.0f) {
+    throw runtime_error("Matrix inverse failed!");
   }
+  return result;
 }
-cx_fvec Amplitude::ikc_inv_vec_a0(const float& s) {
-  try {
-    cx_fmat invMat = kmat_a0.IKC_inv(s);
-    return cx_fvec(invMat.col(1));
-  } catch (const runtime_error& e) {
-    throw;
+cx_fvec Amplitude::ikc_inv_vec_a0(const float& s) const {
+  cx_fvec result;
+  if (kmat_a0.IKC_inv_col(result, s, 1) == 0.0f) {
+    throw runtime_error("Matrix inverse failed!");
   }
+  return result;
 }
-cx_fvec Amplitude::ikc_inv_vec_a2(const float& s) {
-  try {
-    cx_fmat invMat = kmat_a2.IKC_inv(s);
-    return cx_fvec(invMat.col(1));
-  } catch (const runtime_error& e) {
-    throw;
+cx_fvec Amplitude::ikc_inv_vec_a2(const float& s) const {
+  cx_fvec result;
+  if (kmat_a2.IKC_inv_col(result, s, 1) == 0.0f) {
+    throw runtime_error("Matrix inverse failed!");
   }
+  return result;
 }
 
-fmat Amplitude::bw_f2(const float& s) {
+fmat Amplitude::bw_f2(const float& s) const {
   return kmat_f2.B(s);
 }
-fmat Amplitude::bw_a2(const float& s) {
+fmat Amplitude::bw_a2(const float& s) const {
   return kmat_a2.B(s);
 }
 
-complex<float> Amplitude::S0_wave() {
+complex<float> Amplitude::S0_wave() const {
   return complex<float>(sqrt(1.0 / datum::pi) / 2.0, 0.0);
 }
 
-complex<float> Amplitude::D2_wave(const float& theta, const float& phi) {
+complex<float> Amplitude::D2_wave(const float& theta, const float& phi) const {
   return static_cast<float>(pow(sin(theta), 2)) * exp(complex<float>(0.0, 2.0 * phi)) * static_cast<float>(sqrt(15.0 / datum::pi / 2.0)) / complex<float>(4.0, 0.0);
 }
 
@@ -136,7 +138,7 @@ float Amplitude::intensity(
     const cx_fvec& ikc_inv_vec_f0,
     const cx_fvec& ikc_inv_vec_f2,
     const cx_fvec& ikc_inv_vec_a0,
-    const cx_fvec& ikc_inv_vec_a2) {
+    const cx_fvec& ikc_inv_vec_a2) const {
   complex<float> f_f0 = kmat_f0.F(s, betas.subvec(0, 4), ikc_inv_vec_f0);
   complex<float> f_f2 = kmat_f2.F(s, betas.subvec(5, 8), ikc_inv_vec_f2);
   complex<float> f_a0 = kmat_a0.F(s, betas.subvec(9, 10), ikc_inv_vec_a0);
@@ -158,7 +160,7 @@ float Amplitude::intensity(
     const cx_fvec& ikc_inv_vec_f0,
     const cx_fvec& ikc_inv_vec_f2,
     const cx_fvec& ikc_inv_vec_a0,
-    const cx_fvec& ikc_inv_vec_a2) {
+    const cx_fvec& ikc_inv_vec_a2) const {
   complex<float> f_f0 = kmat_f0.F(s, betas.subvec(0, 4), bw_f0, ikc_inv_vec_f0);
   complex<float> f_f2 = kmat_f2.F(s, betas.subvec(5, 8), bw_f2, ikc_inv_vec_f2);
   complex<float> f_a0 = kmat_a0.F(s, betas.subvec(9, 10), bw_a0, ikc_inv_vec_a0);
@@ -167,3 +169,107 @@ float Amplitude::intensity(
   complex<float> D2 = Amplitude::D2_wave(theta, phi);
   return pow(abs(S0 * (f_f0 + f_a0) + D2 * (f_f2 + f_a2)), 2);
 }
+
+cx_fvec Amplitude::coefficients(
+    const float& s,
+    const float& theta,
+    const float& phi,
+    const fmat& bw_f2,
+    const fmat& bw_a2,
+    const cx_fvec& ikc_inv_vec_f0,
+    const cx_fvec& ikc_inv_vec_f2,
+    const cx_fvec& ikc_inv_vec_a0,
+    const cx_fvec& ikc_inv_vec_a2) const {
+  // The intensity is |c . betas|^2, where c is ordered like the betas (f0, f2, a0, a2)
+  complex<float> S0 = Amplitude::S0_wave();
+  complex<float> D2 = Amplitude::D2_wave(theta, phi);
+  cx_fvec result(13);
+  result.subvec(0, 4) = S0 * kmat_f0.coefficients(s, fmat(5, 5, fill::ones), ikc_inv_vec_f0);
+  result.subvec(5, 8) = D2 * kmat_f2.coefficients(s, bw_f2, ikc_inv_vec_f2);
+  result.subvec(9, 10) = S0 * kmat_a0.coefficients(s, fmat(2, 2, fill::ones), ikc_inv_vec_a0);
+  result.subvec(11, 12) = D2 * kmat_a2.coefficients(s, bw_a2, ikc_inv_vec_a2);
+  return result;
+}
+
+bool Amplitude::coefficients(cx_fvec& result, const float& s, const float& theta, const float& phi) const {
+  if (!massCoefficients(result, s)) {
+    return false;
+  }
+  applyWaves(result, theta, phi);
+  return true;
+}
+
+//!
+//! @brief Calculates the s-dependent part of the per-event coefficients (the coefficients without the S0 and
+//! D2 factors)
+//!
+//! Same columns as ikc_inv_vec_*, but evaluated with the fixed-size K-matrices and failures are reported instead
+//! of thrown.
+//!
+//! @param[out] result Coefficients ordered like the betas (f0, f2, a0, a2)
+//! @param[in] s Input mass squared
+//! \return false if an inverse fails or a coefficient is not finite
+//!
+bool Amplitude::massCoefficients(cx_fvec& result, const float& s) const {
+  FixedKMatrix<5, 5, 0>::AlphaVector c_f0;
+  FixedKMatrix<4, 4, 2>::AlphaVector c_f2;
+  FixedKMatrix<2, 2, 0>::AlphaVector c_a0;
+  FixedKMatrix<3, 2, 2>::AlphaVector c_a2;
+  if (!fixed_f0.coefficients(c_f0, s, 0.0091125, 1.0, 2)
+      || !fixed_f2.coefficients(c_f2, s, 2)
+      || !fixed_a0.coefficients(c_a0, s, 1)
+      || !fixed_a2.coefficients(c_a2, s, 1)) {
+    return false;
+  }
+  result.set_size(13);
+  std::copy(c_f0.begin(), c_f0.end(), result.begin());
+  std::copy(c_f2.begin(), c_f2.end(), result.begin() + 5);
+  std::copy(c_a0.begin(), c_a0.end(), result.begin() + 9);
+  std::copy(c_a2.begin(), c_a2.end(), result.begin() + 11);
+  return result.is_finite();
+}
+
+//!
+//! @brief Multiplies the output of massCoefficients by the S0 (f0, a0) and D2 (f2, a2) waves
+//!
+void Amplitude::applyWaves(cx_fvec& result, const float& theta, const float& phi) const {
+  complex<float> S0 = Amplitude::S0_wave();
+  complex<float> D2 = Amplitude::D2_wave(theta, phi);
+  result.subvec(0, 4) *= S0;
+  result.subvec(5, 8) *= D2;
+  result.subvec(9, 10) *= S0;
+  result.subvec(11, 12) *= D2;
+}
+
+//!
+//! @brief Values of s where the coefficients are not smooth: the channel thresholds and the resonance poles of
+//! all four K-matrices
+//!
+vector<float> Amplitude::singularPoints() const {
+  vector<float> result;
+  for (const KMatrix* kmat : {&kmat_f0, &kmat_f2, &kmat_a0, &kmat_a2}) {
+    for (arma::uword i = 0; i < kmat->numChannels; i++) {
+      result.push_back(std::pow(kmat->getM1s()(i).real() + kmat->getM2s()(i).real(), 2.0f));
+    }
+    for (arma::uword a = 0; a < kmat->numAlphas; a++) {
+      result.push_back(std::pow(kmat->getMAlphas()(a).real(), 2.0f));
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+//!
+//! @brief All K-matrix constants (masses, couplings and backgrounds of every K-matrix) in a fixed order, used
+//! to detect when cached per-event coefficients no longer match the amplitude
+//!
+vector<float> Amplitude::constants() const {
+  vector<float> result;
+  for (const fmat* constant : {&f0_mchannels, &f0_malphas, &f0_galphas, &f0_cbkg,
+                               &f2_mchannels, &f2_malphas, &f2_galphas, &f2_cbkg,
+                               &a0_mchannels, &a0_malphas, &a0_galphas, &a0_cbkg,
+                               &a2_mchannels, &a2_malphas, &a2_galphas, &a2_cbkg}) {
+    result.insert(result.end(), constant->begin(), constant->end());
+  }
+  return result;
+}
@@ -0,0 +1,370 @@
+#include "AmplitudeBasis.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+AmplitudeBasis::AmplitudeBasis() : store(1 + 2 * nCoefficients) {}
+
+//!
+//! @brief Resize the basis, keeping the coefficients of the first min(size(), nEvents) events
+//!
+//! @param[in] nEvents New number of events
+//!
+void AmplitudeBasis::resize(const arma::uword& nEvents) {
+  store.resize(nEvents);
+}
+
+//!
+//! @brief Store the coefficients of a single event
+//!
+//! @param[in] i Event index
+//! @param[in] coefficients Vector of coefficients ordered like the couplings (see Amplitude::coefficients)
+//! @param[in] weight Event weight
+//!
+void AmplitudeBasis::set(const arma::uword& i, const arma::cx_fvec& coefficients, const float& weight) {
+  for (arma::uword k = 0; k < nCoefficients; k++) {
+    store.column(realColumn + k)[i] = coefficients(k).real();
+    store.column(imagColumn + k)[i] = coefficients(k).imag();
+  }
+  store.column(weightColumn)[i] = weight;
+}
+
+//!
+//! @brief Remove invalid events in a single pass, keeping the order of the remaining events
+//!
+//! @param[in] valid Flag for each of the size() events, nonzero to keep the event
+//!
+void AmplitudeBasis::compact(const vector<unsigned char>& valid) {
+  arma::uword nValid = 0;
+  for (arma::uword i = 0; i < size(); i++) {
+    if (!valid[i]) {
+      continue;
+    }
+    if (nValid != i) {
+      for (size_t k = 0; k < store.numColumns(); k++) {
+        store.column(k)[nValid] = store.column(k)[i];
+      }
+    }
+    nValid++;
+  }
+  store.resize(nValid);
+}
+
+//!
+//! @brief Make room for nEvents events, so that appending up to that many never reallocates
+//!
+void AmplitudeBasis::reserve(const arma::uword& nEvents) {
+  store.reserve(nEvents);
+}
+
+//!
+//! @brief Copy the events of another basis to the end of this one
+//!
+//! The capacity at least doubles whenever it is exceeded, so appending many small bases takes linear time.
+//!
+//! @param[in] other Basis to copy from
+//!
+void AmplitudeBasis::append(const AmplitudeBasis& other) {
+  const arma::uword n = size();
+  if (n + other.size() > store.capacity()) {
+    store.reserve(std::max<size_t>(n + other.size(), 2 * store.capacity()));
+  }
+  store.resize(n + other.size());
+  for (size_t k = 0; k < store.numColumns(); k++) {
+    std::copy(other.store.column(k), other.store.column(k) + other.size(), store.column(k) + n);
+  }
+}
+
+//!
+//! @brief Back the next allocation with transparent huge pages (see EventStore::setUseHugePages)
+//!
+//! @param[in] enable Whether to use huge pages
+//!
+void AmplitudeBasis::setUseHugePages(const bool& enable) {
+  store.setUseHugePages(enable);
+}
+
+//!
+//! @brief Map a basis previously written from getStore() (see EventStore::mapFile)
+//!
+//! @param[in] fd Open file descriptor
+//! @param[in] offset Offset of the store in the file (must be a multiple of the page size)
+//! @param[in] nEvents Number of events
+//! @param[in] stride Column stride of the written store
+//!
+void AmplitudeBasis::mapFile(const int& fd, const size_t& offset, const arma::uword& nEvents, const size_t& stride) {
+  store.mapFile(fd, offset, nEvents, stride);
+}
+
+//!
+//! @brief Select the kernel used for the log-intensity sums (defaults to IntensityKernels::best)
+//!
+//! @param[in] newKernel Kernel to use
+//!
+void AmplitudeBasis::setKernel(const IntensityKernel& newKernel) {
+  if (!IntensityKernels::supported(newKernel)) {
+    stringstream error;
+    error << "Error: The " << IntensityKernels::name(newKernel) << " kernel is not supported on this CPU!";
+    throw runtime_error(error.str());
+  }
+  kernel = newKernel;
+}
+
+arma::uword AmplitudeBasis::size() const {
+  return store.size();
+}
+
+size_t AmplitudeBasis::bytes() const {
+  return store.bytes();
+}
+
+//!
+//! @brief Print the memory held by the basis, in total and per event
+//!
+//! @param[in] out Stream to print to
+//! @param[in] name Label for this sample
+//!
+void AmplitudeBasis::printMemoryReport(ostream& out, const string& name) const {
+  const double perEvent = size() > 0 ? static_cast<double>(bytes()) / size() : 0.0;
+  out << name << ": " << size() << " events, " << bytes() / (1024.0 * 1024.0) << " MB"
+      << " (" << perEvent << " bytes/event" << (store.hugePages() ? ", huge pages" : "")
+      << (store.isFileBacked() ? ", mapped from cache" : "") << ")"
+      << ", " << IntensityKernels::name(kernel) << " kernel" << endl;
+  out << "  weight: " << sizeof(float) << " bytes/event" << endl;
+  for (arma::uword m = 0; m < nKMatrices; m++) {
+    out << "  " << kmatrixNames[m] << ": " << 2 * kmatrixSizes[m] * sizeof(float) << " bytes/event" << endl;
+  }
+}
+
+//!
+//! @brief Calculate the (unweighted) intensity of a single event
+//!
+//! \f[
+//! I_i(\beta) = \left|\sum_\alpha c_{i,\alpha}\beta_\alpha\right|^2
+//! \f]
+//!
+//! @param[in] i Event index
+//! @param[in] betas Vector containing complex couplings for each resonance
+//!
+float AmplitudeBasis::intensity(const arma::uword& i, const arma::cx_fvec& betas) const {
+  float amp_re = 0.0;
+  float amp_im = 0.0;
+  for (arma::uword k = 0; k < nCoefficients; k++) {
+    const float c_re = realData(k)[i];
+    const float c_im = imagData(k)[i];
+    amp_re += c_re * betas(k).real() - c_im * betas(k).imag();
+    amp_im += c_re * betas(k).imag() + c_im * betas(k).real();
+  }
+  return amp_re * amp_re + amp_im * amp_im;
+}
+
+//!
+//! @brief Calculate the weighted sum of log-intensities over a block of events
+//!
+//! Dispatches to the selected IntensityKernels kernel, which runs over the contiguous coefficient columns.
+//!
+//! @param[in] betas_re Real parts of the couplings
+//! @param[in] betas_im Imaginary parts of the couplings
+//! @param[in] begin Index of the first event in the block
+//! @param[in] end One past the index of the last event in the block
+//!
+float AmplitudeBasis::blockLogIntensity(const float* betas_re, const float* betas_im, const arma::uword& begin, const arma::uword& end) const {
+  return IntensityKernels::sumLogIntensity(kernel,
+      realData(0) + begin, imagData(0) + begin, store.stride(), nCoefficients,
+      weightData() + begin, end - begin,
+      betas_re, betas_im);
+}
+
+//!
+//! @brief Calculate the weighted sum of intensities over a block of events
+//!
+//! @param[in] betas Vector containing complex couplings for each resonance
+//! @param[in] begin Index of the first event in the block
+//! @param[in] end One past the index of the last event in the block
+//!
+float AmplitudeBasis::blockIntensity(const arma::cx_fvec& betas, const arma::uword& begin, const arma::uword& end) const {
+  float result = 0.0;
+  for (arma::uword i = begin; i < end; i++) {
+    result += weight(i) * intensity(i, betas);
+  }
+  return result;
+}
+
+//!
+//! @brief Calculate the intensities of a block of events for several sets of couplings at once
+//!
+//! The amplitudes of all events in the block are the (len x 13) by (13 x W) complex product of the
+//! coefficients and couplings, which is evaluated as four real matrix products on the split columns.
+//!
+//! @param[in] betas_re Real parts of the couplings, one column per parameter set (13 x W)
+//! @param[in] betas_im Imaginary parts of the couplings, one column per parameter set (13 x W)
+//! @param[in] begin Index of the first event in the block
+//! @param[in] end One past the index of the last event in the block
+//! \return Matrix of intensities with dimension (end - begin, W)
+//!
+arma::fmat AmplitudeBasis::blockIntensityBatch(const arma::fmat& betas_re, const arma::fmat& betas_im, const arma::uword& begin, const arma::uword& end) const {
+  // Views of the store as (stride x 13) matrices, the columns are already laid out that way
+  const arma::fmat re(const_cast<float*>(realData(0)), store.stride(), nCoefficients, false, true);
+  const arma::fmat im(const_cast<float*>(imagData(0)), store.stride(), nCoefficients, false, true);
+  const arma::fmat c_re = re.rows(begin, end - 1);
+  const arma::fmat c_im = im.rows(begin, end - 1);
+  arma::fmat amp_re = c_re * betas_re - c_im * betas_im;
+  arma::fmat amp_im = c_re * betas_im + c_im * betas_re;
+  return arma::square(amp_re) + arma::square(amp_im);
+}
+
+//!
+//! @brief Sum values with a fixed pairwise reduction tree
+//!
+//! The order of additions only depends on n, so the result is reproducible regardless of how the values were
+//! produced.
+//!
+//! @param[in] values Pointer to the values to sum
+//! @param[in] n Number of values
+//!
+float AmplitudeBasis::pairwiseSum(const float* values, const arma::uword& n) {
+  if (n == 0) {
+    return 0.0;
+  }
+  if (n == 1) {
+    return values[0];
+  }
+  const arma::uword half = n / 2;
+  return pairwiseSum(values, half) + pairwiseSum(values + half, n - half);
+}
+
+#ifdef _OPENMP
+static int threadCount(const int& nThreads) {
+  return nThreads > 0 ? nThreads : omp_get_max_threads();
+}
+#endif
+
+//!
+//! @brief Call body(b) for every block b, on the thread pool if one is set and on OpenMP threads otherwise
+//!
+//! Every block writes its own partial sum, so the split into tasks or threads does not change the results.
+//!
+//! @param[in] nBlocks Number of blocks
+//! @param[in] nThreads Number of OpenMP threads to use without a pool (0 uses the OpenMP default)
+//! @param[in] body Function of the block index
+//!
+template <typename Body>
+void AmplitudeBasis::forEachBlock(const arma::uword& nBlocks, [[gnu::unused]] const int& nThreads,
+    const Body& body) const {
+  if (pool != nullptr) {
+    pool->parallelFor(nBlocks, [&](size_t begin, size_t end) {
+      for (size_t b = begin; b < end; b++) {
+        body(b);
+      }
+    });
+    return;
+  }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(threadCount(nThreads))
+#endif
+  for (arma::uword b = 0; b < nBlocks; b++) {
+    body(b);
+  }
+}
+
+//!
+//! @brief Calculate the weighted sum of log-intensities over all events
+//!
+//! Blocks of events are distributed over the thread pool (see setThreadPool) or OpenMP threads and their partial sums are combined with
+//! AmplitudeBasis::pairwiseSum, so the result is bitwise identical for any number of threads.
+//!
+//! @param[in] betas Vector containing complex couplings for each resonance
+//! @param[in] nThreads Number of threads to use without a thread pool (0 uses the OpenMP default)
+//!
+float AmplitudeBasis::sumLogIntensity(const arma::cx_fvec& betas, const int& nThreads) const {
+  const arma::uword n = size();
+  const arma::uword nBlocks = (n + blockSize - 1) / blockSize;
+  vector<float> partials(nBlocks, 0.0f);
+  float betas_re[nCoefficients];
+  float betas_im[nCoefficients];
+  for (arma::uword k = 0; k < nCoefficients; k++) {
+    betas_re[k] = betas(k).real();
+    betas_im[k] = betas(k).imag();
+  }
+  forEachBlock(nBlocks, nThreads, [&](const arma::uword& b) {
+    partials[b] = blockLogIntensity(betas_re, betas_im, b * blockSize, std::min(n, (b + 1) * blockSize));
+  });
+  return pairwiseSum(partials.data(), nBlocks);
+}
+
+//!
+//! @brief Calculate the weighted sum of intensities over all events
+//!
+//! Uses the same fixed block decomposition as AmplitudeBasis::sumLogIntensity.
+//!
+//! @param[in] betas Vector containing complex couplings for each resonance
+//! @param[in] nThreads Number of threads to use without a thread pool (0 uses the OpenMP default)
+//!
+float AmplitudeBasis::sumIntensity(const arma::cx_fvec& betas, const int& nThreads) const {
+  const arma::uword n = size();
+  const arma::uword nBlocks = (n + blockSize - 1) / blockSize;
+  vector<float> partials(nBlocks, 0.0f);
+  forEachBlock(nBlocks, nThreads, [&](const arma::uword& b) {
+    partials[b] = blockIntensity(betas, b * blockSize, std::min(n, (b + 1) * blockSize));
+  });
+  return pairwiseSum(partials.data(), nBlocks);
+}
+
+//!
+//! @brief Calculate the weighted sum of log-intensities over all events for several sets of couplings
+//!
+//! Each block of events is streamed through cache once for all W sets of couplings. Partial sums use the
+//! same fixed block decomposition and reduction tree as AmplitudeBasis::sumLogIntensity, so the results do not
+//! depend on the thread count (they may differ from the single-set result in the last bits).
+//!
+//! @param[in] betas Matrix of complex couplings, one column per parameter set (13 x W)
+//! @param[in] nThreads Number of threads to use without a thread pool (0 uses the OpenMP default)
+//! \return Vector of sums, one per parameter set
+//!
+arma::fvec AmplitudeBasis::sumLogIntensityBatch(const arma::cx_fmat& betas, const int& nThreads) const {
+  const arma::uword n = size();
+  const arma::uword nBlocks = (n + blockSize - 1) / blockSize;
+  const arma::fmat betas_re = arma::real(betas);
+  const arma::fmat betas_im = arma::imag(betas);
+  arma::fmat partials(nBlocks, betas.n_cols, arma::fill::zeros);
+  forEachBlock(nBlocks, nThreads, [&](const arma::uword& b) {
+    const arma::uword begin = b * blockSize;
+    const arma::uword end = std::min(n, (b + 1) * blockSize);
+    const arma::fvec w(const_cast<float*>(weightData() + begin), end - begin, false, true);
+    partials.row(b) = w.t() * arma::log(blockIntensityBatch(betas_re, betas_im, begin, end));
+  });
+  arma::fvec result(betas.n_cols);
+  for (arma::uword w = 0; w < betas.n_cols; w++) {
+    result(w) = pairwiseSum(partials.colptr(w), nBlocks);
+  }
+  return result;
+}
+
+//!
+//! @brief Calculate the weighted sum of intensities over all events for several sets of couplings
+//!
+//! @param[in] betas Matrix of complex couplings, one column per parameter set (13 x W)
+//! @param[in] nThreads Number of threads to use without a thread pool (0 uses the OpenMP default)
+//! \return Vector of sums, one per parameter set
+//!
+arma::fvec AmplitudeBasis::sumIntensityBatch(const arma::cx_fmat& betas, const int& nThreads) const {
+  const arma::uword n = size();
+  const arma::uword nBlocks = (n + blockSize - 1) / blockSize;
+  const arma::fmat betas_re = arma::real(betas);
+  const arma::fmat betas_im = arma::imag(betas);
+  arma::fmat partials(nBlocks, betas.n_cols, arma::fill::zeros);
+  forEachBlock(nBlocks, nThreads, [&](const arma::uword& b) {
+    const arma::uword begin = b * blockSize;
+    const arma::uword end = std::min(n, (b + 1) * blockSize);
+    const arma::fvec w(const_cast<float*>(weightData() + begin), end - begin, false, true);
+    partials.row(b) = w.t() * blockIntensityBatch(betas_re, betas_im, begin, end);
+  });
+  arma::fvec result(betas.n_cols);
+  for (arma::uword w = 0; w < betas.n_cols; w++) {
+    result(w) = pairwiseSum(partials.colptr(w), nBlocks);
+  }
+  return result;
+}
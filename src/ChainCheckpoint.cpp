@@ -0,0 +1,383 @@
+#include "ChainCheckpoint.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char stateMagic[8] = {'K', 'M', 'S', 'T', 'A', 'T', 'E', '\0'};
+constexpr uint32_t stateVersion = 1;
+
+// Layout of the state file, followed by the positions (nParameters x nWalkers), the log probabilities and the
+// text of the generator
+struct StateHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t rngBytes;
+  uint64_t steps;
+  uint64_t nWalkers;
+  uint64_t nParameters;
+};
+
+string statePath(const string& path) {
+  return path + ".state";
+}
+
+bool fileExists(const string& path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0;
+}
+
+runtime_error systemError(const string& action, const string& path) {
+  stringstream error;
+  error << "Error: Failed to " << action << " " << path << " (" << strerror(errno) << ")!";
+  return runtime_error(error.str());
+}
+
+void writeAll(const int& fd, const void* data, const size_t& n, const string& path) {
+  const char* bytes = static_cast<const char*>(data);
+  for (size_t written = 0; written < n;) {
+    const ssize_t result = ::write(fd, bytes + written, n - written);
+    if (result < 0 && errno != EINTR) {
+      throw systemError("write", path);
+    }
+    written += std::max<ssize_t>(result, 0);
+  }
+}
+
+void syncDirectory(const string& path) {
+  const size_t slash = path.find_last_of('/');
+  const string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+  const int fd = open(directory.c_str(), O_RDONLY);
+  if (fd < 0 || fsync(fd) != 0) {
+    const runtime_error error = systemError("sync", directory);
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    throw error;
+  }
+  ::close(fd);
+}
+
+//!
+//! @brief Replace the state file with a new state
+//!
+//! The state is written and synced under a temporary name and renamed over the old file, so the file always holds
+//! either the old or the new state in full, even after a crash or power loss.
+//!
+void writeState(const string& path, const SamplerState& state) {
+  StateHeader header{};
+  memcpy(header.magic, stateMagic, sizeof(stateMagic));
+  header.version = stateVersion;
+  header.rngBytes = state.rng.size();
+  header.steps = state.steps;
+  header.nWalkers = state.positions.n_cols;
+  header.nParameters = state.positions.n_rows;
+  const string temporary = path + ".tmp" + to_string(getpid());
+  const int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw systemError("create", temporary);
+  }
+  try {
+    writeAll(fd, &header, sizeof(header), temporary);
+    writeAll(fd, state.positions.memptr(), state.positions.n_elem * sizeof(float), temporary);
+    writeAll(fd, state.logProbs.memptr(), state.logProbs.n_elem * sizeof(float), temporary);
+    writeAll(fd, state.rng.data(), state.rng.size(), temporary);
+    if (fsync(fd) != 0) {
+      throw systemError("sync", temporary);
+    }
+  } catch (const runtime_error&) {
+    ::close(fd);
+    remove(temporary.c_str());
+    throw;
+  }
+  ::close(fd);
+  if (rename(temporary.c_str(), path.c_str()) != 0) {
+    const runtime_error error = systemError("rename to", path);
+    remove(temporary.c_str());
+    throw error;
+  }
+  syncDirectory(path);
+}
+
+//!
+//! @brief Read the state file, returning false if there is none
+//!
+//! \throws runtime_error if the file exists but is not a complete state file
+//!
+bool readState(const string& path, SamplerState& state) {
+  FILE* in = fopen(path.c_str(), "rb");
+  if (!in) {
+    return false;
+  }
+  StateHeader header{};
+  bool complete = fread(&header, sizeof(header), 1, in) == 1
+      && memcmp(header.magic, stateMagic, sizeof(stateMagic)) == 0 && header.version == stateVersion;
+  if (complete) {
+    state.positions.set_size(header.nParameters, header.nWalkers);
+    state.logProbs.set_size(header.nWalkers);
+    state.rng.assign(header.rngBytes, '\0');
+    complete = fread(state.positions.memptr(), sizeof(float), state.positions.n_elem, in) == state.positions.n_elem
+        && fread(state.logProbs.memptr(), sizeof(float), state.logProbs.n_elem, in) == state.logProbs.n_elem
+        && fread(&state.rng[0], 1, state.rng.size(), in) == state.rng.size();
+    state.steps = header.steps;
+  }
+  fclose(in);
+  if (!complete) {
+    stringstream error;
+    error << "Error: " << path << " is not a complete checkpoint state file!";
+    throw runtime_error(error.str());
+  }
+  return true;
+}
+
+runtime_error hdf5Error(const string& action, const string& path, const H5::Exception& exception) {
+  stringstream error;
+  error << "Error: Failed to " << action << " " << path << " (" << exception.getFuncName() << ": "
+        << exception.getDetailMsg() << ")!";
+  return runtime_error(error.str());
+}
+
+}  // namespace
+
+//!
+//! @brief Open the checkpoint file and start the writer thread
+//!
+//! @param[in] path Path of the HDF5 file
+//! @param[in] parameters Parameters of the sampler, in order
+//! @param[in] nWalkers Number of walkers
+//! @param[in] flushEvery Number of steps per block written to disk
+//! @param[in] resume Append to an existing file instead of replacing it (a missing file is created)
+//! \throws runtime_error if the file cannot be written, or does not match the sampler when resuming
+//!
+ChainCheckpoint::ChainCheckpoint(const string& path, const vector<SamplerParameter>& parameters,
+    const arma::uword& nWalkers, const size_t& flushEvery, const bool& resume)
+  : path(path), nWalkers(nWalkers), nParameters(parameters.size()), flushEvery(std::max<size_t>(1, flushEvery)),
+  blocks(2) {
+  H5::Exception::dontPrint();
+  try {
+    if (resume && fileExists(path)) {
+      reopen();
+    } else {
+      create(parameters);
+    }
+  } catch (const H5::Exception& exception) {
+    throw hdf5Error("open checkpoint file", path, exception);
+  }
+  writer = thread(&ChainCheckpoint::writerLoop, this);
+}
+
+ChainCheckpoint::~ChainCheckpoint() {
+  try {
+    close();
+  } catch (const exception& exception) {
+    cout << exception.what() << endl;
+  }
+}
+
+void ChainCheckpoint::create(const vector<SamplerParameter>& parameters) {
+  // The state of an earlier run does not belong to the new chain
+  if (remove(statePath(path).c_str()) != 0 && errno != ENOENT) {
+    throw systemError("remove", statePath(path));
+  }
+  file = make_unique<H5::H5File>(path, H5F_ACC_TRUNC);
+  const hsize_t chainDims[3] = {0, nWalkers, nParameters};
+  const hsize_t chainMax[3] = {H5S_UNLIMITED, nWalkers, nParameters};
+  const hsize_t chainChunk[3] = {chunkSteps, nWalkers, nParameters};
+  H5::DSetCreatPropList chainProps;
+  chainProps.setChunk(3, chainChunk);
+  H5::DSetCreatPropList logProbProps;
+  logProbProps.setChunk(2, chainChunk);
+  if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0) {
+    for (H5::DSetCreatPropList* props : {&chainProps, &logProbProps}) {
+      props->setShuffle();
+      props->setDeflate(compressionLevel);
+    }
+  }
+  file->createDataSet("chain", H5::PredType::NATIVE_FLOAT, H5::DataSpace(3, chainDims, chainMax), chainProps);
+  file->createDataSet("log_prob", H5::PredType::NATIVE_FLOAT, H5::DataSpace(2, chainDims, chainMax), logProbProps);
+
+  size_t nameLength = 1;
+  for (const SamplerParameter& parameter : parameters) {
+    nameLength = std::max(nameLength, parameter.name.size());
+  }
+  vector<char> names(nParameters * nameLength, '\0');
+  for (size_t p = 0; p < nParameters; p++) {
+    std::copy(parameters[p].name.begin(), parameters[p].name.end(), names.begin() + p * nameLength);
+  }
+  const hsize_t nameDims[1] = {nParameters};
+  H5::StrType nameType(H5::PredType::C_S1, nameLength);
+  file->createDataSet("parameters", nameType, H5::DataSpace(1, nameDims)).write(names.data(), nameType);
+  file->flush(H5F_SCOPE_GLOBAL);
+}
+
+//!
+//! @brief Open an existing file for appending, dropping samples written after the step of the state file
+//!
+void ChainCheckpoint::reopen() {
+  SamplerState state;
+  if (readState(statePath(path), state)) {
+    nSteps = state.steps;
+  }
+  file = make_unique<H5::H5File>(path, H5F_ACC_RDWR);
+  H5::DataSet chain = file->openDataSet("chain");
+  hsize_t chainDims[3];
+  chain.getSpace().getSimpleExtentDims(chainDims);
+  if (chainDims[1] != nWalkers || chainDims[2] != nParameters) {
+    stringstream error;
+    error << "Error: " << path << " holds " << chainDims[1] << " walkers and " << chainDims[2]
+          << " parameters, expected " << nWalkers << " and " << nParameters << "!";
+    throw runtime_error(error.str());
+  }
+  if (chainDims[0] < nSteps) {
+    stringstream error;
+    error << "Error: " << path << " holds " << chainDims[0] << " steps, but its state is at step " << nSteps << "!";
+    throw runtime_error(error.str());
+  }
+  chainDims[0] = nSteps;
+  if (H5Dset_extent(chain.getId(), chainDims) < 0
+      || H5Dset_extent(file->openDataSet("log_prob").getId(), chainDims) < 0) {
+    stringstream error;
+    error << "Error: Failed to truncate " << path << " to " << nSteps << " steps!";
+    throw runtime_error(error.str());
+  }
+}
+
+//!
+//! @brief Record the sampler state after a step, which is written to disk with the rest of its block
+//!
+//! Blocks until the writer has room for the block if the two blocks before it are still being written.
+//!
+//! \throws runtime_error if writing an earlier block failed or the checkpoint is closed
+//!
+void ChainCheckpoint::record(const SamplerState& state) {
+  rethrowError();
+  if (closed) {
+    throw runtime_error("Error: The checkpoint file is closed!");
+  }
+  if (state.positions.n_rows != nParameters || state.positions.n_cols != nWalkers) {
+    throw runtime_error("Error: The sampler state does not match the checkpoint file!");
+  }
+  if (!pending) {
+    pending = make_unique<Block>();
+    pending->firstStep = nSteps;
+    pending->chain.reserve(flushEvery * nWalkers * nParameters);
+    pending->logProbs.reserve(flushEvery * nWalkers);
+  }
+  // Column-major (parameters x walkers) is row-major (walkers x parameters)
+  pending->chain.insert(pending->chain.end(), state.positions.begin(), state.positions.end());
+  pending->logProbs.insert(pending->logProbs.end(), state.logProbs.begin(), state.logProbs.end());
+  pending->nSteps++;
+  pending->state = state;
+  nSteps++;
+  if (pending->nSteps == flushEvery && !blocks.push(std::move(pending))) {
+    // The writer closes the queue when it fails
+    rethrowError();
+    throw runtime_error("Error: The checkpoint writer has stopped!");
+  }
+}
+
+//!
+//! @brief Write the remaining steps, wait for the writer and close the file
+//!
+//! \throws runtime_error if writing any block failed
+//!
+void ChainCheckpoint::close() {
+  if (closed) {
+    return;
+  }
+  closed = true;
+  // A failed push means the writer has stopped with an error, which is rethrown below
+  const bool queued = !pending || blocks.push(std::move(pending));
+  blocks.close();
+  writer.join();
+  try {
+    file->close();
+  } catch (const H5::Exception& exception) {
+    // The wrapper's destructor would retry the failed close, which crashes HDF5, so the handle is given up
+    file.release();
+    rethrowError();
+    throw hdf5Error("close checkpoint file", path, exception);
+  }
+  rethrowError();
+  if (!queued) {
+    throw runtime_error("Error: The checkpoint writer has stopped!");
+  }
+}
+
+void ChainCheckpoint::write(const Block& block) {
+  const hsize_t nWritten = block.firstStep + block.nSteps;
+  const hsize_t dims[3] = {nWritten, nWalkers, nParameters};
+  const hsize_t offset[3] = {block.firstStep, 0, 0};
+  const hsize_t count[3] = {block.nSteps, nWalkers, nParameters};
+  for (int rank : {3, 2}) {
+    H5::DataSet dataSet = file->openDataSet(rank == 3 ? "chain" : "log_prob");
+    dataSet.extend(dims);
+    H5::DataSpace fileSpace = dataSet.getSpace();
+    fileSpace.selectHyperslab(H5S_SELECT_SET, count, offset);
+    const float* values = rank == 3 ? block.chain.data() : block.logProbs.data();
+    dataSet.write(values, H5::PredType::NATIVE_FLOAT, H5::DataSpace(rank, count), fileSpace);
+  }
+  file->flush(H5F_SCOPE_GLOBAL);
+  void* handle = nullptr;
+  if (H5Fget_vfd_handle(file->getId(), H5P_DEFAULT, &handle) < 0 || fsync(*static_cast<int*>(handle)) != 0) {
+    throw systemError("sync", path);
+  }
+  // Only once the samples are on disk does the state move on to them
+  SamplerState state = block.state;
+  state.steps = nWritten;
+  writeState(statePath(path), state);
+}
+
+void ChainCheckpoint::writerLoop() {
+  unique_ptr<Block> block;
+  while (blocks.pop(block)) {
+    try {
+      write(*block);
+    } catch (const H5::Exception& exception) {
+      fail(make_exception_ptr(hdf5Error("write checkpoint to", path, exception)));
+      return;
+    } catch (const exception&) {
+      fail(current_exception());
+      return;
+    }
+  }
+}
+
+//!
+//! @brief Store the error of the writer and close the queue, so a sampler waiting to push a block wakes up and
+//! sees the error instead of waiting forever
+//!
+void ChainCheckpoint::fail(const exception_ptr& writeError) {
+  {
+    lock_guard<mutex> lock(errorGuard);
+    error = writeError;
+  }
+  blocks.close();
+}
+
+void ChainCheckpoint::rethrowError() {
+  lock_guard<mutex> lock(errorGuard);
+  if (error) {
+    rethrow_exception(error);
+  }
+}
+
+//!
+//! @brief Read the sampler state after the last complete step of a checkpoint file
+//!
+//! @param[in] path Path of the HDF5 file
+//! @param[out] state Sampler state, with the number of steps in the file
+//! \return false if the file or its state file does not exist, or no step is complete
+//! \throws runtime_error if the state file exists but cannot be read
+//!
+bool ChainCheckpoint::load(const string& path, SamplerState& state) {
+  return fileExists(path) && readState(statePath(path), state) && state.steps > 0;
+}
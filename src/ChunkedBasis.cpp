@@ -0,0 +1,145 @@
+#include "ChunkedBasis.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+ChunkedBasis::~ChunkedBasis() {
+  close();
+}
+
+//!
+//! @brief Create an empty scratch file, which is removed as soon as it is closed
+//!
+//! @param[in] directory Directory for the scratch file (should have room for the whole basis)
+//! \throws runtime_error if the file cannot be created
+//!
+void ChunkedBasis::open(const string& directory) {
+  close();
+  string path = directory + "/kmatrix-chunks-XXXXXX";
+  fd = mkstemp(&path[0]);
+  if (fd < 0) {
+    stringstream error;
+    error << "Error: Failed to create scratch file in " << directory << "!";
+    throw runtime_error(error.str());
+  }
+  unlink(path.c_str());
+}
+
+void ChunkedBasis::close() {
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+  chunks.clear();
+  fileBytes = 0;
+  nEvents = 0;
+}
+
+//!
+//! @brief Write a chunk to the end of the scratch file
+//!
+//! @param[in] chunk Basis of the chunk (may be compacted)
+//! \throws runtime_error if the write fails
+//!
+void ChunkedBasis::append(const AmplitudeBasis& chunk) {
+  if (chunk.size() == 0) {
+    return;
+  }
+  const EventStore& store = chunk.getStore();
+  Chunk entry{fileBytes, chunk.size(), store.stride(), store.numColumns() * store.stride() * sizeof(float)};
+  const char* data = reinterpret_cast<const char*>(store.column(0));
+  size_t done = 0;
+  while (done < entry.bytes) {
+    const ssize_t count = pwrite(fd, data + done, entry.bytes - done, entry.offset + done);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      stringstream error;
+      error << "Error: Failed to write " << entry.bytes << " bytes to scratch file!";
+      throw runtime_error(error.str());
+    }
+    done += count;
+  }
+  chunks.push_back(entry);
+  fileBytes = (entry.offset + entry.bytes + chunkAlignment - 1) / chunkAlignment * chunkAlignment;
+  nEvents += entry.nEvents;
+}
+
+//!
+//! @brief Map every chunk in turn and accumulate sum(basis) over the chunks in order
+//!
+//! Before a chunk is summed, the next one is requested from the kernel (POSIX_FADV_WILLNEED), so reading it
+//! overlaps with the sum. Mapping the next chunk unmaps the previous one.
+//!
+template <typename Result, typename Sum>
+Result ChunkedBasis::sumChunks(const Result& zero, const Sum& sum) const {
+  Result result = zero;
+  AmplitudeBasis basis;
+  basis.setThreadPool(pool);
+  if (!chunks.empty()) {
+    posix_fadvise(fd, chunks[0].offset, chunks[0].bytes, POSIX_FADV_WILLNEED);
+  }
+  for (size_t c = 0; c < chunks.size(); c++) {
+    if (c + 1 < chunks.size()) {
+      posix_fadvise(fd, chunks[c + 1].offset, chunks[c + 1].bytes, POSIX_FADV_WILLNEED);
+    }
+    basis.mapFile(fd, chunks[c].offset, chunks[c].nEvents, chunks[c].stride);
+    result += sum(basis);
+  }
+  return result;
+}
+
+//!
+//! @brief Calculate the weighted sum of log intensities over all chunks (see AmplitudeBasis::sumLogIntensity)
+//!
+float ChunkedBasis::sumLogIntensity(const arma::cx_fvec& betas, const int& nThreads) const {
+  return sumChunks(0.0, [&](const AmplitudeBasis& basis) {
+    return static_cast<double>(basis.sumLogIntensity(betas, nThreads));
+  });
+}
+
+//!
+//! @brief Calculate the weighted sum of intensities over all chunks (see AmplitudeBasis::sumIntensity)
+//!
+float ChunkedBasis::sumIntensity(const arma::cx_fvec& betas, const int& nThreads) const {
+  return sumChunks(0.0, [&](const AmplitudeBasis& basis) {
+    return static_cast<double>(basis.sumIntensity(betas, nThreads));
+  });
+}
+
+//!
+//! @brief Calculate the weighted sums of log intensities for several sets of couplings in one pass over the chunks
+//!
+arma::fvec ChunkedBasis::sumLogIntensityBatch(const arma::cx_fmat& betas, const int& nThreads) const {
+  const arma::vec zero(betas.n_cols, arma::fill::zeros);
+  return arma::conv_to<arma::fvec>::from(sumChunks(zero, [&](const AmplitudeBasis& basis) {
+    return arma::conv_to<arma::vec>::from(basis.sumLogIntensityBatch(betas, nThreads));
+  }));
+}
+
+//!
+//! @brief Calculate the weighted sums of intensities for several sets of couplings in one pass over the chunks
+//!
+arma::fvec ChunkedBasis::sumIntensityBatch(const arma::cx_fmat& betas, const int& nThreads) const {
+  const arma::vec zero(betas.n_cols, arma::fill::zeros);
+  return arma::conv_to<arma::fvec>::from(sumChunks(zero, [&](const AmplitudeBasis& basis) {
+    return arma::conv_to<arma::vec>::from(basis.sumIntensityBatch(betas, nThreads));
+  }));
+}
+
+//!
+//! @brief Print the size of the basis on disk and the largest chunk, which bounds the resident memory
+//!
+void ChunkedBasis::printMemoryReport(ostream& out, const string& name) const {
+  size_t largest = 0;
+  for (const Chunk& chunk : chunks) {
+    largest = std::max(largest, chunk.bytes);
+  }
+  out << name << ": " << size() << " events in " << numChunks() << " chunks, "
+      << bytes() / (1024.0 * 1024.0) << " MB on disk, largest chunk " << largest / (1024.0 * 1024.0) << " MB" << endl;
+}
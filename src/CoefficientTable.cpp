@@ -0,0 +1,168 @@
+#include "CoefficientTable.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+//!
+//! @brief Builds the table by adaptive bisection
+//!
+//! @param[in] amplitude Amplitude to tabulate (must outlive the table)
+//! @param[in] sMin Lower edge of the table
+//! @param[in] sMax Upper edge of the table
+//! @param[in] tolerance Largest error accepted at the midpoint and quarter points of an interval (see class
+//! description)
+//! @param[in] nInitial Number of intervals in the initial uniform grid
+//! @param[in] maxNodes Largest number of nodes, after which intervals are no longer refined
+//!
+CoefficientTable::CoefficientTable(const Amplitude& amplitude, const float& sMin, const float& sMax,
+    const float& tolerance, const arma::uword& nInitial, const arma::uword& maxNodes)
+  : amplitude(amplitude), tolerance(tolerance) {
+  if (!(sMax > sMin) || !(tolerance > 0.0f) || nInitial < 1) {
+    stringstream error;
+    error << "Error: Invalid coefficient table range [" << sMin << ", " << sMax << "] or tolerance " << tolerance << "!";
+    throw runtime_error(error.str());
+  }
+  // Intervals narrower than this are accepted (or marked as invalid) without further refinement
+  const float minWidth = (sMax - sMin) * 1e-6f;
+
+  struct Node {
+    arma::cx_fvec value;
+    bool valid;
+  };
+  map<float, Node> grid;
+  auto evaluate = [&amplitude](const float& s) {
+    Node node;
+    node.valid = amplitude.massCoefficients(node.value, s);
+    return node;
+  };
+
+  vector<float> initial;
+  for (arma::uword i = 0; i <= nInitial; i++) {
+    initial.push_back(sMin + (sMax - sMin) * static_cast<float>(i) / static_cast<float>(nInitial));
+  }
+  for (const float& point : amplitude.singularPoints()) {
+    if (point > sMin && point < sMax) {
+      initial.push_back(point);
+    }
+  }
+  for (const float& s : initial) {
+    grid.emplace(s, evaluate(s));
+  }
+
+  vector<pair<float, float>> pending;
+  for (auto it = grid.begin(); next(it) != grid.end(); ++it) {
+    pending.emplace_back(it->first, next(it)->first);
+  }
+  vector<pair<float, float>> invalid;
+  while (!pending.empty()) {
+    const auto [a, b] = pending.back();
+    pending.pop_back();
+    const float m = a + (b - a) / 2.0f;
+    const Node& left = grid.at(a);
+    const Node& right = grid.at(b);
+    Node middle = evaluate(m);
+    float err = numeric_limits<float>::infinity();
+    if (left.valid && right.valid && middle.valid) {
+      err = CoefficientTable::error(middle.value, (left.value + right.value) / 2.0f);
+      // The quarter points catch intervals whose error does not peak at the midpoint
+      for (const float& t : {0.25f, 0.75f}) {
+        const Node quarter = evaluate(a + (b - a) * t);
+        if (!quarter.valid) {
+          err = numeric_limits<float>::infinity();
+          break;
+        }
+        err = std::max(err, CoefficientTable::error(quarter.value, (1.0f - t) * left.value + t * right.value));
+      }
+    }
+    if (err <= this->tolerance) {
+      maxObservedError = std::max(maxObservedError, err);
+      continue;
+    }
+    // Intervals one float apart cannot be split any further (m rounds to an endpoint), which happens before
+    // minWidth is reached when the range is narrow
+    if (b - a <= minWidth || !(a < m && m < b) || grid.size() >= maxNodes) {
+      budgetExhausted = budgetExhausted || grid.size() >= maxNodes;
+      invalid.emplace_back(a, b);
+      continue;
+    }
+    grid.emplace(m, std::move(middle));
+    pending.emplace_back(a, m);
+    pending.emplace_back(m, b);
+  }
+
+  nodes.reserve(grid.size());
+  values.set_size(13, grid.size());
+  arma::uword column = 0;
+  for (const auto& [s, node] : grid) {
+    nodes.push_back(s);
+    if (node.valid) {
+      values.col(column) = node.value;
+    } else {
+      values.col(column).fill(arma::datum::nan);
+    }
+    column++;
+  }
+  intervalValid.assign(nodes.size() - 1, 1);
+  for (const auto& [a, b] : invalid) {
+    intervalValid[std::lower_bound(nodes.begin(), nodes.end(), a) - nodes.begin()] = 0;
+  }
+}
+
+//!
+//! @brief Same as Amplitude::coefficients, but with the s-dependent part interpolated from the table
+//!
+//! @param[out] result Coefficients ordered like the betas (f0, f2, a0, a2)
+//! @param[in] s Input mass squared
+//! @param[in] theta Polar angle
+//! @param[in] phi Azimuthal angle
+//! \return false if the coefficients cannot be evaluated
+//!
+bool CoefficientTable::coefficients(arma::cx_fvec& result, const float& s, const float& theta, const float& phi) const {
+  if (!(s >= nodes.front()) || s > nodes.back()) {
+    return amplitude.coefficients(result, s, theta, phi);
+  }
+  // Index of the interval [nodes[i], nodes[i + 1]] containing s
+  const size_t i = std::min<size_t>(std::upper_bound(nodes.begin(), nodes.end(), s) - nodes.begin(), nodes.size() - 1) - 1;
+  if (!intervalValid[i]) {
+    return amplitude.coefficients(result, s, theta, phi);
+  }
+  const float t = (s - nodes[i]) / (nodes[i + 1] - nodes[i]);
+  result = (1.0f - t) * values.col(i) + t * values.col(i + 1);
+  amplitude.applyWaves(result, theta, phi);
+  return true;
+}
+
+//!
+//! @brief Prints the size of the table and the largest interpolation error seen while building it
+//!
+void CoefficientTable::printReport(ostream& out) const {
+  const size_t nInvalid = std::count(intervalValid.begin(), intervalValid.end(), 0);
+  out << "Coefficient table: " << nodes.size() << " nodes over s in [" << nodes.front() << ", " << nodes.back()
+      << "], max interpolation error " << maxObservedError << " (tolerance " << tolerance << "), "
+      << nInvalid << " intervals evaluated exactly" << endl;
+  if (budgetExhausted) {
+    out << "Warning: coefficient table hit its node limit before reaching the tolerance everywhere" << endl;
+  }
+}
+
+//!
+//! @brief Interpolation error of the s-dependent coefficients, as the largest error of the S-wave (f0, a0) and
+//! D-wave (f2, a2) coefficients relative to the largest coefficient of the same wave
+//!
+//! Applying the waves multiplies each group by one complex factor, which leaves its relative error unchanged, so
+//! at the points where it is checked this error does not depend on the angles of the event.
+//!
+float CoefficientTable::error(const arma::cx_fvec& exact, const arma::cx_fvec& interpolated) {
+  const arma::fvec exactSize = arma::abs(exact);
+  const arma::fvec difference = arma::abs(exact - interpolated);
+  float result = 0.0f;
+  for (const arma::uvec& wave : {arma::uvec{0, 1, 2, 3, 4, 9, 10}, arma::uvec{5, 6, 7, 8, 11, 12}}) {
+    const float scale = arma::max(exactSize.elem(wave));
+    const float largest = arma::max(difference.elem(wave));
+    result = std::max(result, scale == 0.0f ? largest : largest / scale);
+  }
+  return result;
+}
@@ -0,0 +1,189 @@
+#include "ConvergenceMonitor.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+//!
+//! @param[in] nParameters Number of parameters
+//! @param[in] nWalkers Number of walkers
+//! @param[in] window Number of most recent steps kept for the estimates
+//! \throws runtime_error if the window is too short to split into two halves of two steps
+//!
+ConvergenceMonitor::ConvergenceMonitor(const arma::uword& nParameters, const arma::uword& nWalkers,
+    const arma::uword& window)
+  : nParameters(nParameters), nWalkers(nWalkers), window(window), history(window, nWalkers, nParameters) {
+  if (window < 4) {
+    stringstream error;
+    error << "Error: The convergence monitor needs a window of at least 4 steps (got " << window << ")!";
+    throw runtime_error(error.str());
+  }
+  tau.set_size(nParameters);
+  tau.fill(numeric_limits<double>::infinity());
+  previousTau = tau;
+  rHat = tau;
+  reliable.zeros(nParameters);
+}
+
+//!
+//! @brief Add the positions after a step to the history, replacing the oldest step once the window is full
+//!
+//! @param[in] positions Walker positions (parameters x walkers)
+//! \throws runtime_error if the positions do not match the monitor
+//!
+void ConvergenceMonitor::record(const arma::fmat& positions) {
+  if (positions.n_rows != nParameters || positions.n_cols != nWalkers) {
+    throw runtime_error("Error: The positions do not match the convergence monitor!");
+  }
+  for (arma::uword p = 0; p < nParameters; p++) {
+    for (arma::uword w = 0; w < nWalkers; w++) {
+      history(next, w, p) = positions(p, w);
+    }
+  }
+  next = (next + 1) % window;
+  nSamples = std::min(nSamples + 1, window);
+  nRecorded++;
+}
+
+//!
+//! @brief History of one parameter, oldest step first (steps x walkers)
+//!
+arma::mat ConvergenceMonitor::series(const arma::uword& p) const {
+  const arma::uword first = nSamples < window ? 0 : next;
+  arma::mat result(nSamples, nWalkers);
+  for (arma::uword w = 0; w < nWalkers; w++) {
+    for (arma::uword t = 0; t < nSamples; t++) {
+      result(t, w) = history((first + t) % window, w, p);
+    }
+  }
+  return result;
+}
+
+//!
+//! @brief Re-estimate the autocorrelation times and split-R-hat of every parameter from the current history
+//!
+void ConvergenceMonitor::update() {
+  previousTau = tau;
+  for (arma::uword p = 0; p < nParameters; p++) {
+    const arma::mat walkerSeries = series(p);
+    bool windowFits = false;
+    tau(p) = integratedTime(walkerSeries, &windowFits);
+    reliable(p) = windowFits;
+    rHat(p) = splitRHat(walkerSeries);
+  }
+}
+
+//!
+//! @brief Whether the chain has converged by the estimates of the last two updates
+//!
+//! @param[in] tauFactor The history must be longer than this many autocorrelation times of every parameter
+//! @param[in] maxTauChange Largest change of any tau since the previous update, relative to tau
+//! @param[in] maxRHat Largest split-R-hat of any parameter
+//! \return true if every parameter meets all three conditions and its summation window fit inside the history
+//!
+bool ConvergenceMonitor::converged(const double& tauFactor, const double& maxTauChange,
+    const double& maxRHat) const {
+  if (nParameters == 0) {
+    return false;
+  }
+  for (arma::uword p = 0; p < nParameters; p++) {
+    const bool longEnough = reliable(p) && nSamples > tauFactor * tau(p);
+    const bool stable = std::fabs(tau(p) - previousTau(p)) <= maxTauChange * tau(p);
+    if (!longEnough || !stable || !(rHat(p) <= maxRHat)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//!
+//! @brief Effective number of independent samples in the history, for the parameter with the largest
+//! autocorrelation time (zero before the first update)
+//!
+//! Only the steps in the window count, walkers x numSamples() / tau: the steps before it (e.g. the burn-in) are
+//! not part of the estimate of tau and are not the samples the run keeps as converged.
+//!
+double ConvergenceMonitor::effectiveSamples() const {
+  const double maxTau = tau.max();
+  if (!std::isfinite(maxTau)) {
+    return 0.0;
+  }
+  return static_cast<double>(nWalkers) * nSamples / std::max(maxTau, 1.0);
+}
+
+//!
+//! @brief Integrated autocorrelation time of an ensemble of chains
+//!
+//! The autocorrelation function of each chain is computed with a zero-padded FFT, normalized, and averaged over
+//! chains. tau(M) = 1 + 2 sum_{t=1}^{M} rho(t) is evaluated at the first lag M >= 5 tau(M).
+//!
+//! @param[in] series One chain per column
+//! @param[out] reliable Whether such a lag exists within the chains (if not, the estimate at the longest lag is
+//! returned and is too small)
+//! \return The autocorrelation time in steps, infinite if no chain ever moved
+//!
+double ConvergenceMonitor::integratedTime(const arma::mat& series, bool* reliable) {
+  if (reliable) {
+    *reliable = false;
+  }
+  const arma::uword n = series.n_rows;
+  if (n < 2) {
+    return numeric_limits<double>::infinity();
+  }
+  arma::uword nFFT = 1;
+  while (nFFT < 2 * n) {
+    nFFT <<= 1;
+  }
+  arma::vec acf(n, arma::fill::zeros);
+  arma::uword nMoving = 0;
+  for (arma::uword c = 0; c < series.n_cols; c++) {
+    const arma::vec centered = series.col(c) - arma::mean(series.col(c));
+    const arma::cx_vec transform = arma::fft(centered, nFFT);
+    const arma::vec circular = arma::real(arma::ifft(transform % arma::conj(transform)));
+    // The padding keeps the circular correlation from wrapping around for lags below n
+    const arma::vec chainACF = circular.head(n);
+    if (chainACF(0) > 0.0) {
+      acf += chainACF / chainACF(0);
+      nMoving++;
+    }
+  }
+  if (nMoving == 0) {
+    return numeric_limits<double>::infinity();
+  }
+  acf /= static_cast<double>(nMoving);
+  const arma::vec taus = 2.0 * arma::cumsum(acf) - 1.0;
+  for (arma::uword m = 0; m < n; m++) {
+    if (m >= windowFactor * taus(m)) {
+      if (reliable) {
+        *reliable = true;
+      }
+      return taus(m);
+    }
+  }
+  return taus(n - 1);
+}
+
+//!
+//! @brief Gelman-Rubin potential scale reduction with every chain split into its first and second half
+//!
+//! @param[in] series One chain per column
+//! \return sqrt(var+ / W) over the 2 x chains halves, infinite if the chains are too short or do not move
+//!
+double ConvergenceMonitor::splitRHat(const arma::mat& series) {
+  const arma::uword half = series.n_rows / 2;
+  if (half < 2 || series.n_cols == 0) {
+    return numeric_limits<double>::infinity();
+  }
+  const arma::mat halves = arma::join_rows(series.head_rows(half), series.tail_rows(half));
+  const arma::rowvec variances = arma::var(halves, 0, 0);
+  const arma::rowvec means = arma::mean(halves, 0);
+  const double within = arma::mean(variances);
+  if (!(within > 0.0)) {
+    return numeric_limits<double>::infinity();
+  }
+  // var(means) is B / n for chains of n steps
+  const double between = arma::var(means);
+  const double pooled = (half - 1.0) / half * within + between;
+  return std::sqrt(pooled / within);
+}
@@ -1,75 +1,510 @@
-#include "TLorentzVector.h"
-#include "TLorentzRotation.h"
+#include "TROOT.h"
 #include "DataReader.hpp"
+#include "Kinematics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-DataReader::DataReader(const string& filePath, const string& treeName) {
-  // Open the ROOT file in read-only mode
-  file = TFile::Open(filePath.c_str(), "READ");
-  // Access the TTree from the ROOT file
-  tree = dynamic_cast<TTree*>(file->Get(treeName.c_str()));
+DataReader::DataReader(const string& filePath, const string& treeName)
+  : DataReader(expandPaths(filePath), treeName) {}
 
-  // Check if the TTree exists
+//!
+//! @brief Open every file once to count its entries and find its clusters, and chain the files in the given order
+//!
+//! @param[in] paths Input files
+//! @param[in] treeName Name of the tree in every file
+//! \throws runtime_error if a file or its tree cannot be opened, since a missing file would silently drop its events
+//!
+DataReader::DataReader(const vector<string>& paths, const string& treeName)
+  : nEvents(0), treeName(treeName), chain(new TChain(treeName.c_str())) {
+  for (const string& path : paths) {
+    unique_ptr<TFile> file(TFile::Open(path.c_str(), "READ"));
+    TTree* tree = file ? dynamic_cast<TTree*>(file->Get(treeName.c_str())) : nullptr;
+    if (!tree) {
+      delete chain;
+      stringstream error;
+      error << "Error: Could not read TTree '" << treeName << "' from " << path << "!";
+      throw runtime_error(error.str());
+    }
+    const Long64_t entries = tree->GetEntries();
+    TTree::TClusterIterator clusterIterator = tree->GetClusterIterator(0);
+    Long64_t clusterStart;
+    while ((clusterStart = clusterIterator()) < entries) {
+      clusters.push_back({filePaths.size(), clusterStart, std::min(clusterIterator.GetNextEntry(), entries)});
+    }
+    filePaths.push_back(path);
+    fileEntries.push_back(entries);
+    fileOffsets.push_back(nEvents);
+    nEvents += entries;
+    chain->Add(path.c_str(), entries);
+  }
+}
+
+DataReader::~DataReader() {
+  delete chain;
+}
+
+//!
+//! @brief Expand a file argument into a list of files
+//!
+//! A path ending in .txt or .list is read as a list with one file or glob pattern per line (empty lines and lines
+//! starting with # are skipped). Anything else is expanded as a glob pattern, and kept as it is if nothing matches
+//! (e.g. a remote URL). Matches of each pattern are sorted.
+//!
+//! @param[in] filePath File, pattern or list file
+//! \throws runtime_error if a list file cannot be read
+//!
+vector<string> DataReader::expandPaths(const string& filePath) {
+  vector<string> patterns;
+  auto endsWith = [&filePath](const string& suffix) {
+    return filePath.size() >= suffix.size() && filePath.compare(filePath.size() - suffix.size(), suffix.size(), suffix) == 0;
+  };
+  if (endsWith(".txt") || endsWith(".list")) {
+    ifstream list(filePath);
+    if (!list) {
+      stringstream error;
+      error << "Error: Could not read file list " << filePath << "!";
+      throw runtime_error(error.str());
+    }
+    string line;
+    while (getline(list, line)) {
+      line.erase(0, line.find_first_not_of(" \t"));
+      line.erase(line.find_last_not_of(" \t\r") + 1);
+      if (!line.empty() && line[0] != '#') {
+        patterns.push_back(line);
+      }
+    }
+  } else {
+    patterns.push_back(filePath);
+  }
+  vector<string> result;
+  for (const string& pattern : patterns) {
+    glob_t matches;
+    if (glob(pattern.c_str(), GLOB_NOCHECK, nullptr, &matches) == 0) {
+      result.insert(result.end(), matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+    } else {
+      result.push_back(pattern);
+    }
+    globfree(&matches);
+  }
+  return result;
+}
+
+//!
+//! @brief Print the number of entries in total and in each file (e.g. for the bookkeeping of generated events)
+//!
+void DataReader::printCounts(ostream& out, const string& name, const vector<string>& paths,
+    const vector<Long64_t>& entries) {
+  Long64_t total = 0;
+  for (const Long64_t& count : entries) {
+    total += count;
+  }
+  out << name << ": " << total << " events in " << paths.size() << " file(s)" << endl;
+  const size_t maxFiles = 20;
+  for (size_t f = 0; f < paths.size() && paths.size() > 1; f++) {
+    if (f == maxFiles) {
+      out << "  (" << paths.size() - maxFiles << " more files)" << endl;
+      break;
+    }
+    out << "  " << paths[f] << ": " << entries[f] << " events" << endl;
+  }
+}
+
+void DataReader::printSummary(ostream& out, const string& name) const {
+  printCounts(out, name, filePaths, fileEntries);
+}
+
+#ifdef _OPENMP
+static int threadCount(const int& nThreads) {
+  return nThreads > 0 ? nThreads : omp_get_max_threads();
+}
+#endif
+
+//!
+//! @brief Identity of a local file for the entry count cache (empty if it cannot be found, e.g. a remote URL)
+//!
+static string countCacheKey(const string& path, const string& treeName) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    return "";
+  }
+  stringstream key;
+  key << info.st_size << " " << info.st_mtim.tv_sec << " " << info.st_mtim.tv_nsec << " " << treeName << " " << path;
+  return key.str();
+}
+
+//!
+//! @brief Count the entries of the tree in each file without building a reader
+//!
+//! Only the file and tree headers are read, and every file is closed right away. Files are opened in parallel,
+//! since opening dominates on networked filesystems. If countCache names a file, counts of local files whose
+//! size and modification time are unchanged are taken from it without opening them, and new counts are added.
+//! Each line of the cache holds "count size seconds nanoseconds tree path", and lines that do not are ignored.
+//!
+//! @param[in] paths Input files
+//! @param[in] treeName Name of the tree in every file
+//! @param[in] countCache Entry count cache file (empty to always open the files)
+//! @param[in] nThreads Number of threads (0 uses the OpenMP default)
+//! \return Number of entries in each file
+//! \throws runtime_error if a file or its tree cannot be opened, since a missing file would silently bias the count
+//!
+vector<Long64_t> DataReader::countEntries(const vector<string>& paths, const string& treeName,
+    const string& countCache, [[gnu::unused]] const int& nThreads) {
+  map<string, Long64_t> cached;
+  if (!countCache.empty()) {
+    ifstream in(countCache);
+    string line;
+    while (getline(in, line)) {
+      // A damaged line (e.g. edited by hand) only means that its file is opened and counted again
+      istringstream fields(line);
+      Long64_t count;
+      string key;
+      if (fields >> count && count >= 0 && getline(fields, key) && key.size() > 1 && key[0] == ' ') {
+        cached[key.substr(1)] = count;
+      }
+    }
+  }
+  vector<Long64_t> entries(paths.size(), -1);
+  vector<string> keys(paths.size());
+  for (size_t f = 0; f < paths.size(); f++) {
+    keys[f] = countCache.empty() ? "" : countCacheKey(paths[f], treeName);
+    auto found = cached.find(keys[f]);
+    if (!keys[f].empty() && found != cached.end()) {
+      entries[f] = found->second;
+    }
+  }
+
+  ROOT::EnableThreadSafety();
+  size_t failedFile = paths.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threadCount(nThreads))
+#endif
+  for (size_t f = 0; f < paths.size(); f++) {
+    if (entries[f] >= 0) {
+      continue;
+    }
+    unique_ptr<TFile> file(TFile::Open(paths[f].c_str(), "READ"));
+    TTree* tree = file ? dynamic_cast<TTree*>(file->Get(treeName.c_str())) : nullptr;
+    if (tree) {
+      entries[f] = tree->GetEntries();
+    } else {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+      failedFile = f;
+    }
+  }
+  if (failedFile < paths.size()) {
+    stringstream error;
+    error << "Error: Could not read TTree '" << treeName << "' from " << paths[failedFile] << "!";
+    throw runtime_error(error.str());
+  }
+
+  bool updated = false;
+  for (size_t f = 0; f < paths.size(); f++) {
+    if (!keys[f].empty() && cached.find(keys[f]) == cached.end()) {
+      cached[keys[f]] = entries[f];
+      updated = true;
+    }
+  }
+  if (updated) {
+    const string temporary = countCache + ".tmp" + to_string(getpid());
+    {
+      ofstream out(temporary);
+      for (const auto& entry : cached) {
+        out << entry.second << " " << entry.first << "\n";
+      }
+    }
+    if (rename(temporary.c_str(), countCache.c_str()) != 0) {
+      cout << "Warning: Failed to write entry count cache " << countCache << endl;
+      remove(temporary.c_str());
+    }
+  }
+  return entries;
+}
+
+//!
+//! @brief Select the events kept by read() and readChunk()
+//!
+//! Rejected events are dropped as they are read, before they take any space in the columns.
+//!
+//! @param[in] newSelection Cuts (the default EventSelection keeps every event)
+//!
+void DataReader::setSelection(const EventSelection& newSelection) {
+  selection = newSelection;
+}
+
+//!
+//! @brief Read the kinematics of every selected event of every file into one set of columns
+//!
+//! Every file is split at its cluster boundaries so that every compressed basket is read and decompressed by
+//! exactly one thread. The clusters of all files are shared out together, so many small files and a few large ones
+//! are both spread over all threads. Each thread opens its own handle on a file (TTree is not thread-safe), reusing
+//! it while its clusters come from the same file. The event order matches the chain.
+//!
+//! Without a selection, the columns are sized once and every cluster is written straight to the offset of its
+//! entries. With a selection, every cluster collects its selected events separately, and the clusters are then
+//! joined in order, so only selected events are ever stored.
+//!
+//! @param[in] nThreads Number of threads (0 uses the OpenMP default)
+//! \throws runtime_error if a thread cannot open a file or tree
+//!
+void DataReader::read([[gnu::unused]] const int& nThreads) {
+  const Long64_t nEntries = numEntries();
+  const bool selecting = !selection.keepsAll();
+  const ColumnSet columns = {&masses, &weights, &thetas, &phis};
+  for (vector<float>* column : columns) {
+    column->assign(selecting ? 0 : nEntries, 0.0f);
+  }
+  vector<EventColumns> selected(selecting ? clusters.size() : 0);
+
+  ROOT::EnableThreadSafety();
+  size_t failedFile = filePaths.size();
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threadCount(nThreads))
+#endif
+  {
+    FileHandle handle;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (size_t c = 0; c < clusters.size(); c++) {
+      TTree* tree = clusterTree(c, handle);
+      if (!tree) {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+        failedFile = clusters[c].file;
+        continue;
+      }
+      if (selecting) {
+        readRange(tree, clusters[c].begin, clusters[c].end, {&selected[c].masses, &selected[c].weights,
+            &selected[c].thetas, &selected[c].phis}, 0);
+      } else {
+        readRange(tree, clusters[c].begin, clusters[c].end, columns, fileOffsets[clusters[c].file] + clusters[c].begin);
+      }
+    }
+  }
+  if (failedFile < filePaths.size()) {
+    stringstream error;
+    error << "Error: Could not read TTree '" << treeName << "' from " << filePaths[failedFile] << "!";
+    throw runtime_error(error.str());
+  }
+  if (selecting) {
+    size_t nSelected = 0;
+    for (const EventColumns& cluster : selected) {
+      nSelected += cluster.size();
+    }
+    for (vector<float>* column : columns) {
+      column->reserve(nSelected);
+    }
+    for (EventColumns& cluster : selected) {
+      append(cluster);
+      cluster = EventColumns();
+    }
+    cout << "Selected " << nSelected << " of " << nEntries << " events" << endl;
+  }
+  nEvents = masses.size();
+}
+
+//!
+//! @brief Tree holding a cluster, opened through (and kept open by) a handle
+//!
+//! \return Tree, or nullptr if the file or tree cannot be opened
+//!
+TTree* DataReader::clusterTree(const size_t& c, FileHandle& handle) const {
+  if (clusters[c].file != handle.index) {
+    handle.index = clusters[c].file;
+    handle.file.reset(TFile::Open(filePaths[handle.index].c_str(), "READ"));
+    handle.tree = handle.file ? dynamic_cast<TTree*>(handle.file->Get(treeName.c_str())) : nullptr;
+  }
+  return handle.tree;
+}
+
+//!
+//! @brief Read the kinematics of the selected events of one cluster
+//!
+//! Reading clusters 0, ..., numClusters() - 1 in order and appending them gives the same columns as read(). Each
+//! thread needs its own handle.
+//!
+//! @param[in] c Cluster index
+//! @param[out] out Columns to replace with the selected events of the cluster
+//! @param[in,out] handle File handle of the calling thread
+//! \throws runtime_error if the file or tree cannot be opened
+//!
+void DataReader::readCluster(const size_t& c, EventColumns& out, FileHandle& handle) const {
+  TTree* tree = clusterTree(c, handle);
   if (!tree) {
-    cout << "Error: TTree '" << treeName << "' not found!" << endl;
-    return;
+    stringstream error;
+    error << "Error: Could not read TTree '" << treeName << "' from " << filePaths[clusters[c].file] << "!";
+    throw runtime_error(error.str());
   }
+  out = EventColumns();
+  readRange(tree, clusters[c].begin, clusters[c].end, {&out.masses, &out.weights, &out.thetas, &out.phis}, 0);
+}
 
-  nEvents = tree->GetEntries();
+//!
+//! @brief Read the kinematics of the selected entries among [begin, end) of the chain, so that a sample can be
+//! processed in chunks that fit in memory
+//!
+//! @param[in] begin First entry
+//! @param[in] end One past the last entry (clamped to the number of entries)
+//!
+void DataReader::readChunk(const Long64_t& begin, const Long64_t& end) {
+  const Long64_t last = std::min(end, numEntries());
+  const ColumnSet columns = {&masses, &weights, &thetas, &phis};
+  for (vector<float>* column : columns) {
+    column->clear();
+  }
+  if (last > begin) {
+    readRange(chain, begin, last, columns, 0);
+  }
+  nEvents = masses.size();
 }
 
-DataReader::~DataReader() {
-  // Close the ROOT file
-  if (file)
-    file->Close();
+Long64_t DataReader::numEntries() const {
+  return fileOffsets.empty() ? 0 : fileOffsets.back() + fileEntries.back();
 }
 
-void DataReader::read() {
+//!
+//! @brief Read the entries [begin, end) of a tree and write the selected events to the columns
+//!
+//! Selected events are written in order from index at, and columns that are too short are grown.
+//!
+//! @param[in] source Tree to read
+//! @param[in] begin First entry
+//! @param[in] end One past the last entry
+//! @param[out] out Columns of masses, weights, thetas and phis
+//! @param[in] at Index of the first event written
+//! \return Number of events written
+//!
+size_t DataReader::readRange(TTree* source, const Long64_t& begin, const Long64_t& end, const ColumnSet& out,
+    const size_t& at) const {
   // Variables to hold branch values
   float weight, e_beam, px_beam, py_beam, pz_beam;
   float e_fs[3], px_fs[3], py_fs[3], pz_fs[3];
 
-  // Set branch addresses
-  tree->SetBranchAddress("Weight", &weight);
-  tree->SetBranchAddress("E_Beam", &e_beam);
-  tree->SetBranchAddress("Px_Beam", &px_beam);
-  tree->SetBranchAddress("Py_Beam", &py_beam);
-  tree->SetBranchAddress("Pz_Beam", &pz_beam);
-  tree->SetBranchAddress("E_FinalState", &e_fs);
-  tree->SetBranchAddress("Px_FinalState", &px_fs);
-  tree->SetBranchAddress("Py_FinalState", &py_fs);
-  tree->SetBranchAddress("Pz_FinalState", &pz_fs);
-
-  // Loop over the tree entries
-  Long64_t numEntries = tree->GetEntries();
-  for (Long64_t entry = 0; entry < numEntries; entry++) {
-    tree->GetEntry(entry);
-
-    TLorentzVector beam(px_beam, py_beam, pz_beam, e_beam);
-    TLorentzVector recoil(px_fs[0], py_fs[0], pz_fs[0], e_fs[0]);
-    TLorentzVector p1(px_fs[1], py_fs[1], pz_fs[1], e_fs[1]);
-    TLorentzVector p2(px_fs[2], py_fs[2], pz_fs[2], e_fs[2]);
-
-    TLorentzVector resonance = p1 + p2;
-    TLorentzRotation resRestBoost(-resonance.BoostVector());
-
-    TLorentzVector beam_res = resRestBoost * beam;
-    TLorentzVector recoil_res = resRestBoost * recoil;
-    TLorentzVector p1_res = resRestBoost * p1;
-    
-    TVector3 z = -1.0 * recoil_res.Vect().Unit();
-    TVector3 y = (beam.Vect().Cross(-recoil.Vect())).Unit();
-    TVector3 x = y.Cross(z);
-
-    TVector3 angles(
-        p1_res.Vect().Dot(x),
-        p1_res.Vect().Dot(y),
-        p1_res.Vect().Dot(z)
-        );
-    // Perform the calculation or store the values
-    // Example: storing values in vectors
-    masses.push_back(resonance.M());
-    thetas.push_back(angles.Theta());
-    phis.push_back(angles.Phi());
-    weights.push_back(weight);
+  // Only read (and cache) the branches used below
+  source->SetBranchStatus("*", false);
+  for (const char* branch : {"Weight", "E_Beam", "Px_Beam", "Py_Beam", "Pz_Beam",
+                             "E_FinalState", "Px_FinalState", "Py_FinalState", "Pz_FinalState"}) {
+    source->SetBranchStatus(branch, true);
+  }
+  source->SetBranchAddress("Weight", &weight);
+  source->SetBranchAddress("E_Beam", &e_beam);
+  source->SetBranchAddress("Px_Beam", &px_beam);
+  source->SetBranchAddress("Py_Beam", &py_beam);
+  source->SetBranchAddress("Pz_Beam", &pz_beam);
+  source->SetBranchAddress("E_FinalState", &e_fs);
+  source->SetBranchAddress("Px_FinalState", &px_fs);
+  source->SetBranchAddress("Py_FinalState", &py_fs);
+  source->SetBranchAddress("Pz_FinalState", &pz_fs);
+  source->SetCacheSize(32 * 1024 * 1024);
+  source->AddBranchToCache("*", true);
+  source->SetCacheEntryRange(begin, end);
+
+  // Four-momentum columns of the beam and the three final state particles (recoil, p1, p2), followed by the
+  // masses, weights, thetas and phis of the same events, filled for at most chunkSize entries at a time
+  const Long64_t chunkSize = 65536;
+  const size_t stride = std::min(chunkSize, end - begin);
+  vector<float> columns(20 * stride);
+  auto column = [&columns, &stride](const size_t& particle, const size_t& component) {
+    return columns.data() + (4 * particle + component) * stride;
+  };
+  auto particle = [&column](const size_t& p) {
+    return FourMomentumColumns{column(p, 0), column(p, 1), column(p, 2), column(p, 3)};
+  };
+  float* chunkMasses = column(4, 0);
+  float* chunkWeights = column(4, 1);
+  float* chunkThetas = column(4, 2);
+  float* chunkPhis = column(4, 3);
+  const bool selecting = !selection.keepsAll();
+  size_t written = 0;
+  for (Long64_t chunkBegin = begin; chunkBegin < end; chunkBegin += chunkSize) {
+    const Long64_t chunkEnd = std::min(chunkBegin + chunkSize, end);
+    const size_t n = chunkEnd - chunkBegin;
+    for (Long64_t entry = chunkBegin; entry < chunkEnd; entry++) {
+      source->GetEntry(entry);
+      const size_t k = entry - chunkBegin;
+      column(0, 0)[k] = e_beam;
+      column(0, 1)[k] = px_beam;
+      column(0, 2)[k] = py_beam;
+      column(0, 3)[k] = pz_beam;
+      for (size_t p = 0; p < 3; p++) {
+        column(p + 1, 0)[k] = e_fs[p];
+        column(p + 1, 1)[k] = px_fs[p];
+        column(p + 1, 2)[k] = py_fs[p];
+        column(p + 1, 3)[k] = pz_fs[p];
+      }
+      chunkWeights[k] = weight;
+    }
+    Kinematics::resonanceFrame(particle(0), particle(1), particle(2), particle(3), n,
+        chunkMasses, chunkThetas, chunkPhis);
+    size_t nSelected = n;
+    if (selecting) {
+      // Move the selected events to the front of the chunk, keeping their order
+      nSelected = 0;
+      for (size_t k = 0; k < n; k++) {
+        if (selection.accepts(chunkMasses[k], chunkWeights[k], chunkThetas[k], chunkPhis[k])) {
+          chunkMasses[nSelected] = chunkMasses[k];
+          chunkWeights[nSelected] = chunkWeights[k];
+          chunkThetas[nSelected] = chunkThetas[k];
+          chunkPhis[nSelected] = chunkPhis[k];
+          nSelected++;
+        }
+      }
+    }
+    for (size_t c = 0; c < out.size(); c++) {
+      if (out[c]->size() < at + written + nSelected) {
+        out[c]->resize(at + written + nSelected);
+      }
+      std::copy(column(4, c), column(4, c) + nSelected, out[c]->data() + at + written);
+    }
+    written += nSelected;
   }
+  // The branch addresses point at this stack frame
+  source->ResetBranchAddresses();
+  return written;
+}
+
+void EventColumns::compact(const vector<unsigned char>& valid) {
+  // Single pass over all columns, keeping the order of the remaining events
+  size_t nValid = 0;
+  for (size_t i = 0; i < masses.size(); i++) {
+    if (!valid[i]) {
+      continue;
+    }
+    masses[nValid] = masses[i];
+    weights[nValid] = weights[i];
+    thetas[nValid] = thetas[i];
+    phis[nValid] = phis[i];
+    nValid++;
+  }
+  masses.resize(nValid);
+  weights.resize(nValid);
+  thetas.resize(nValid);
+  phis.resize(nValid);
+}
+
+void EventColumns::append(const EventColumns& other) {
+  masses.insert(masses.end(), other.masses.begin(), other.masses.end());
+  weights.insert(weights.end(), other.weights.begin(), other.weights.end());
+  thetas.insert(thetas.end(), other.thetas.begin(), other.thetas.end());
+  phis.insert(phis.end(), other.phis.begin(), other.phis.end());
+}
+
+void DataReader::compact(const vector<unsigned char>& valid) {
+  EventColumns::compact(valid);
+  nEvents = size();
 }
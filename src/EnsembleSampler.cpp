@@ -0,0 +1,290 @@
+#include "EnsembleSampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+//!
+//! @brief Pick k distinct indices in [0, n)
+//!
+static void pickDistinct(arma::uword* picked, const arma::uword& k, const arma::uword& n, mt19937_64& rng) {
+  uniform_int_distribution<arma::uword> pick(0, n - 1);
+  for (arma::uword i = 0; i < k; i++) {
+    bool repeated = true;
+    while (repeated) {
+      picked[i] = pick(rng);
+      repeated = std::find(picked, picked + i, picked[i]) != picked + i;
+    }
+  }
+}
+
+StretchMove::StretchMove(const float& a) : a(a) {
+  if (a <= 1.0f) {
+    stringstream error;
+    error << "Error: The stretch move scale must be larger than 1 (got " << a << ")!";
+    throw runtime_error(error.str());
+  }
+}
+
+//!
+//! @brief Move each walker along the line through a random complement walker, x' = c + z (x - c)
+//!
+//! z is drawn from g(z) ~ 1 / sqrt(z) on [1 / a, a], and the proposal ratio is z^(nParameters - 1).
+//!
+void StretchMove::propose(const arma::fmat& active, const arma::fmat& complement, arma::fmat& proposed,
+    arma::fvec& logFactors, mt19937_64& rng) const {
+  uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  uniform_int_distribution<arma::uword> pick(0, complement.n_cols - 1);
+  const float nDim = active.n_rows;
+  proposed.set_size(active.n_rows, active.n_cols);
+  logFactors.set_size(active.n_cols);
+  for (arma::uword i = 0; i < active.n_cols; i++) {
+    const float root = (a - 1.0f) * uniform(rng) + 1.0f;
+    const float z = root * root / a;
+    const arma::uword j = pick(rng);
+    proposed.col(i) = complement.col(j) + z * (active.col(i) - complement.col(j));
+    logFactors(i) = (nDim - 1.0f) * std::log(z);
+  }
+}
+
+DifferentialEvolutionMove::DifferentialEvolutionMove(const float& sigma, const float& gamma0)
+  : sigma(sigma), gamma0(gamma0) {}
+
+//!
+//! @brief Move each walker by the scaled difference of two random complement walkers, plus a small jitter
+//!
+//! The jitter is drawn independently for every parameter (sigma times a standard normal from rng), so the proposals
+//! are not confined to the span of the walker differences. The proposal is symmetric, so the proposal ratio is 1.
+//!
+void DifferentialEvolutionMove::propose(const arma::fmat& active, const arma::fmat& complement,
+    arma::fmat& proposed, arma::fvec& logFactors, mt19937_64& rng) const {
+  normal_distribution<float> normal(0.0f, 1.0f);
+  const float gamma = gamma0 > 0.0f ? gamma0 : 2.38f / std::sqrt(2.0f * active.n_rows);
+  proposed.set_size(active.n_rows, active.n_cols);
+  logFactors.zeros(active.n_cols);
+  arma::uword picked[2];
+  for (arma::uword i = 0; i < active.n_cols; i++) {
+    pickDistinct(picked, 2, complement.n_cols, rng);
+    proposed.col(i) = active.col(i) + gamma * (complement.col(picked[1]) - complement.col(picked[0]));
+    for (arma::uword k = 0; k < active.n_rows; k++) {
+      proposed(k, i) += sigma * normal(rng);
+    }
+  }
+}
+
+DifferentialEvolutionSnookerMove::DifferentialEvolutionSnookerMove(const float& gamma) : gamma(gamma) {}
+
+//!
+//! @brief Move each walker along the line through a random complement walker z, by the scaled difference of the
+//! projections of two more complement walkers onto that line
+//!
+//! The proposal ratio is (|x' - z| / |x - z|)^(nParameters - 1).
+//!
+void DifferentialEvolutionSnookerMove::propose(const arma::fmat& active, const arma::fmat& complement,
+    arma::fmat& proposed, arma::fvec& logFactors, mt19937_64& rng) const {
+  const float nDim = active.n_rows;
+  proposed.set_size(active.n_rows, active.n_cols);
+  logFactors.set_size(active.n_cols);
+  arma::uword picked[3];
+  for (arma::uword i = 0; i < active.n_cols; i++) {
+    pickDistinct(picked, 3, complement.n_cols, rng);
+    const arma::fvec delta = active.col(i) - complement.col(picked[0]);
+    const float norm = arma::norm(delta);
+    if (norm == 0.0f) {
+      proposed.col(i) = active.col(i);
+      logFactors(i) = 0.0f;
+      continue;
+    }
+    const arma::fvec u = delta / norm;
+    proposed.col(i) = active.col(i)
+        + gamma * (arma::dot(u, complement.col(picked[1])) - arma::dot(u, complement.col(picked[2]))) * u;
+    logFactors(i) = (nDim - 1.0f) * (std::log(arma::norm(proposed.col(i) - complement.col(picked[0])))
+        - std::log(norm));
+  }
+}
+
+//!
+//! @param[in] nWalkers Number of walkers (at least 6, so each half can serve as the complement of every move)
+//! @param[in] parameters Names and bounds of the parameters
+//! @param[in] logProbability Log probability of the columns of a matrix of positions, only called for positions
+//! inside the bounds
+//! @param[in] seed Seed of the random number generator
+//! \throws runtime_error if there are too few walkers or the bounds are empty
+//!
+EnsembleSampler::EnsembleSampler(const arma::uword& nWalkers, const vector<SamplerParameter>& parameters,
+    const LogProbability& logProbability, const uint64_t& seed)
+  : nWalkers(nWalkers), parameters(parameters), logProbability(logProbability), rng(seed) {
+  if (nWalkers < 6) {
+    stringstream error;
+    error << "Error: The ensemble needs at least 6 walkers (got " << nWalkers << ")!";
+    throw runtime_error(error.str());
+  }
+  for (const SamplerParameter& parameter : parameters) {
+    if (!(parameter.lower < parameter.upper)) {
+      stringstream error;
+      error << "Error: Empty range [" << parameter.lower << ", " << parameter.upper << "] for " << parameter.name
+            << "!";
+      throw runtime_error(error.str());
+    }
+  }
+}
+
+//!
+//! @brief Draw the starting positions uniformly within the bounds
+//!
+//! \throws runtime_error if a walker finds no position with a finite log probability
+//!
+void EnsembleSampler::init() {
+  uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  positions.set_size(parameters.size(), nWalkers);
+  logProbs.set_size(nWalkers);
+  logProbs.fill(-std::numeric_limits<float>::infinity());
+  for (int attempt = 0; attempt < initTries; attempt++) {
+    const arma::uvec pending = arma::find_nonfinite(logProbs);
+    if (pending.is_empty()) {
+      break;
+    }
+    for (const arma::uword& w : pending) {
+      for (size_t p = 0; p < parameters.size(); p++) {
+        positions(p, w) = parameters[p].lower + (parameters[p].upper - parameters[p].lower) * uniform(rng);
+      }
+    }
+    logProbs.elem(pending) = evaluate(positions.cols(pending));
+  }
+  const arma::uvec stuck = arma::find_nonfinite(logProbs);
+  if (!stuck.is_empty()) {
+    stringstream error;
+    error << "Error: No starting position with a finite log probability found for " << stuck.n_elem
+          << " walkers!";
+    throw runtime_error(error.str());
+  }
+  accepted.zeros(nWalkers);
+  steps = 0;
+  stepsSinceStart = 0;
+}
+
+//!
+//! @brief Advance every walker by one step
+//!
+//! @param[in] moves Moves (not owned) with their relative weights, one of them is picked for the whole step
+//! \throws runtime_error if the sampler has no positions yet or the moves are unusable
+//!
+void EnsembleSampler::step(const vector<pair<const Move*, float>>& moves) {
+  if (logProbs.n_elem != nWalkers) {
+    throw runtime_error("Error: The sampler has no positions, call init() or setState() first!");
+  }
+  if (moves.empty()) {
+    throw runtime_error("Error: No moves given!");
+  }
+  vector<float> weights;
+  for (const pair<const Move*, float>& move : moves) {
+    weights.push_back(move.second);
+  }
+  discrete_distribution<size_t> choose(weights.begin(), weights.end());
+  const Move& move = *moves[choose(rng)].first;
+  const arma::uword half = nWalkers / 2;
+  if (half < move.minComplement()) {
+    throw runtime_error("Error: Too few walkers for the selected move!");
+  }
+
+  vector<arma::uword> order(nWalkers);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), rng);
+  const arma::uvec shuffled(order);
+  uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  for (int h = 0; h < 2; h++) {
+    const arma::uvec active = h == 0 ? shuffled.head(half) : shuffled.tail(nWalkers - half);
+    const arma::uvec complement = h == 0 ? shuffled.tail(nWalkers - half) : shuffled.head(half);
+    arma::fmat proposed;
+    arma::fvec logFactors;
+    move.propose(positions.cols(active), positions.cols(complement), proposed, logFactors, rng);
+    const arma::fvec proposedLogProbs = evaluate(proposed);
+    for (arma::uword i = 0; i < active.n_elem; i++) {
+      const arma::uword w = active(i);
+      if (std::log(uniform(rng)) < logFactors(i) + proposedLogProbs(i) - logProbs(w)) {
+        positions.col(w) = proposed.col(i);
+        logProbs(w) = proposedLogProbs(i);
+        accepted(w)++;
+      }
+    }
+  }
+  steps++;
+  stepsSinceStart++;
+}
+
+//!
+//! @brief Evaluate the log probability, which is -infinity outside the bounds (or where it is not a number)
+//!
+arma::fvec EnsembleSampler::evaluate(const arma::fmat& proposed) const {
+  arma::fvec result(proposed.n_cols);
+  result.fill(-std::numeric_limits<float>::infinity());
+  vector<arma::uword> inside;
+  for (arma::uword i = 0; i < proposed.n_cols; i++) {
+    bool within = true;
+    for (size_t p = 0; p < parameters.size() && within; p++) {
+      within = proposed(p, i) >= parameters[p].lower && proposed(p, i) <= parameters[p].upper;
+    }
+    if (within) {
+      inside.push_back(i);
+    }
+  }
+  if (inside.empty()) {
+    return result;
+  }
+  const arma::uvec columns(inside);
+  const arma::fvec values = logProbability(proposed.cols(columns));
+  for (arma::uword i = 0; i < columns.n_elem; i++) {
+    if (!std::isnan(values(i))) {
+      result(columns(i)) = values(i);
+    }
+  }
+  return result;
+}
+
+SamplerState EnsembleSampler::getState() const {
+  SamplerState state;
+  state.positions = positions;
+  state.logProbs = logProbs;
+  stringstream text;
+  text << rng;
+  state.rng = text.str();
+  state.steps = steps;
+  return state;
+}
+
+//!
+//! @brief Continue from a state returned by getState (e.g. restored from a ChainCheckpoint)
+//!
+//! \throws runtime_error if the state does not match the number of walkers and parameters
+//!
+void EnsembleSampler::setState(const SamplerState& state) {
+  if (state.positions.n_rows != parameters.size() || state.positions.n_cols != nWalkers
+      || state.logProbs.n_elem != nWalkers) {
+    stringstream error;
+    error << "Error: The sampler state has " << state.positions.n_cols << " walkers and "
+          << state.positions.n_rows << " parameters, expected " << nWalkers << " and " << parameters.size() << "!";
+    throw runtime_error(error.str());
+  }
+  stringstream text(state.rng);
+  text >> rng;
+  if (text.fail()) {
+    throw runtime_error("Error: Invalid random number generator state!");
+  }
+  positions = state.positions;
+  logProbs = state.logProbs;
+  steps = state.steps;
+  accepted.zeros(nWalkers);
+  stepsSinceStart = 0;
+}
+
+//!
+//! @brief Fraction of accepted proposals of each walker since init() or setState()
+//!
+arma::fvec EnsembleSampler::acceptanceFraction() const {
+  if (stepsSinceStart == 0) {
+    return arma::fvec(nWalkers, arma::fill::zeros);
+  }
+  return arma::conv_to<arma::fvec>::from(accepted) / static_cast<float>(stepsSinceStart);
+}
@@ -0,0 +1,186 @@
+#include "EventStore.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+//!
+//! @brief Constructor for EventStore class
+//!
+//! @param[in] nColumns The number of per-event columns
+//!
+EventStore::EventStore(const size_t& nColumns) : nColumns(nColumns) {}
+
+EventStore::~EventStore() {
+  release();
+}
+
+EventStore::EventStore(EventStore&& other) noexcept
+  : nColumns(other.nColumns), nEvents(other.nEvents), nCapacity(other.nCapacity),
+  columnStride(other.columnStride), buffer(other.buffer), bufferBytes(other.bufferBytes),
+  mapped(other.mapped), fileBacked(other.fileBacked), useHugePages(other.useHugePages) {
+    other.buffer = nullptr;
+    other.bufferBytes = 0;
+    other.nEvents = 0;
+    other.nCapacity = 0;
+    other.columnStride = 0;
+  }
+
+EventStore& EventStore::operator=(EventStore&& other) noexcept {
+  if (this != &other) {
+    release();
+    nColumns = other.nColumns;
+    nEvents = other.nEvents;
+    nCapacity = other.nCapacity;
+    columnStride = other.columnStride;
+    buffer = other.buffer;
+    bufferBytes = other.bufferBytes;
+    mapped = other.mapped;
+    fileBacked = other.fileBacked;
+    useHugePages = other.useHugePages;
+    other.buffer = nullptr;
+    other.bufferBytes = 0;
+    other.nEvents = 0;
+    other.nCapacity = 0;
+    other.columnStride = 0;
+  }
+  return *this;
+}
+
+//!
+//! @brief Request transparent huge pages for subsequent allocations of at least 2 MB
+//!
+//! @param[in] enable Whether to use huge pages
+//!
+void EventStore::setUseHugePages(const bool& enable) {
+  useHugePages = enable;
+}
+
+void EventStore::release() {
+  if (!buffer) {
+    return;
+  }
+#ifdef __linux__
+  if (mapped) {
+    munmap(buffer, bufferBytes);
+  } else {
+    free(buffer);
+  }
+#else
+  free(buffer);
+#endif
+  buffer = nullptr;
+  bufferBytes = 0;
+  mapped = false;
+  fileBacked = false;
+}
+
+//!
+//! @brief Replace the contents of the store with a private (copy-on-write) mapping of a file region
+//!
+//! The region must hold numColumns() columns of newStride floats each, laid out like column(0), i.e. the
+//! bytes of a store written with the same number of columns. Nothing is copied: pages are read from the file
+//! on first access, and writes (e.g. from compaction) never reach the file.
+//!
+//! @param[in] fd Open file descriptor
+//! @param[in] offset Offset of the region in the file (must be a multiple of the page size)
+//! @param[in] newEvents Number of events in the region
+//! @param[in] newStride Column stride of the region, in floats (a multiple of alignment / sizeof(float))
+//! \throws runtime_error if the mapping fails
+//!
+void EventStore::mapFile(const int& fd, const size_t& offset, const size_t& newEvents, const size_t& newStride) {
+  if (newStride < newEvents || newStride % (alignment / sizeof(float)) != 0) {
+    stringstream error;
+    error << "Error: Invalid stride " << newStride << " for " << newEvents << " mapped events!";
+    throw runtime_error(error.str());
+  }
+  const size_t newBytes = max<size_t>(nColumns * newStride * sizeof(float), alignment);
+#ifdef __linux__
+  void* ptr = mmap(nullptr, newBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+  if (ptr == MAP_FAILED) {
+    stringstream error;
+    error << "Error: Failed to map " << newBytes << " bytes of event store from file!";
+    throw runtime_error(error.str());
+  }
+  release();
+  buffer = static_cast<float*>(ptr);
+  bufferBytes = newBytes;
+  mapped = true;
+  fileBacked = true;
+  columnStride = newStride;
+  nCapacity = newStride;
+  nEvents = newEvents;
+#else
+  (void) fd;
+  (void) offset;
+  throw runtime_error("Error: Mapping event stores from files is only supported on Linux!");
+#endif
+}
+
+//!
+//! @brief Resize the store, keeping the values of the first min(size(), nEvents) events
+//!
+//! Shrinking never reallocates. Growing beyond the capacity reallocates to exactly nEvents (see reserve). The
+//! values of the added events are unspecified (they may hold events removed by an earlier shrink) until set.
+//!
+//! @param[in] newEvents New number of events
+//!
+void EventStore::resize(const size_t& newEvents) {
+  reserve(newEvents);
+  nEvents = newEvents;
+}
+
+//!
+//! @brief Make room for at least newCapacity events without changing size()
+//!
+//! Reallocates to exactly newCapacity (rounded up to a multiple of the alignment) if that exceeds the capacity.
+//! Only the first size() events are copied, the values beyond them are unspecified.
+//!
+//! @param[in] newCapacity Number of events to make room for
+//!
+void EventStore::reserve(const size_t& newCapacity) {
+  if (newCapacity <= nCapacity) {
+    return;
+  }
+  const size_t floatsPerLine = alignment / sizeof(float);
+  const size_t newStride = (newCapacity + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+  size_t newBytes = max<size_t>(nColumns * newStride * sizeof(float), alignment);
+  float* newBuffer = nullptr;
+  bool newMapped = false;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (useHugePages && newBytes >= hugePageSize) {
+    size_t mapBytes = (newBytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+    void* ptr = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr != MAP_FAILED) {
+      madvise(ptr, mapBytes, MADV_HUGEPAGE);
+      newBuffer = static_cast<float*>(ptr);
+      newBytes = mapBytes;
+      newMapped = true;
+    }
+  }
+#endif
+  if (!newBuffer) {
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, newBytes) != 0) {
+      stringstream error;
+      error << "Error: Failed to allocate " << newBytes << " bytes for event store!";
+      throw runtime_error(error.str());
+    }
+    memset(ptr, 0, newBytes);
+    newBuffer = static_cast<float*>(ptr);
+  }
+  for (size_t k = 0; k < nColumns && nEvents > 0; k++) {
+    memcpy(newBuffer + k * newStride, buffer + k * columnStride, nEvents * sizeof(float));
+  }
+  release();
+  buffer = newBuffer;
+  bufferBytes = newBytes;
+  mapped = newMapped;
+  columnStride = newStride;
+  nCapacity = newStride;
+}
@@ -0,0 +1,367 @@
+#include "IntensityKernels.hpp"
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define KMATRIX_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// Coefficients of the Cephes single-precision logarithm, log(1 + x) for x in [sqrt(1/2) - 1, sqrt(2) - 1]
+static constexpr float logP0 = 7.0376836292e-2f;
+static constexpr float logP1 = -1.1514610310e-1f;
+static constexpr float logP2 = 1.1676998740e-1f;
+static constexpr float logP3 = -1.2420140846e-1f;
+static constexpr float logP4 = 1.4249322787e-1f;
+static constexpr float logP5 = -1.6668057665e-1f;
+static constexpr float logP6 = 2.0000714765e-1f;
+static constexpr float logP7 = -2.4999993993e-1f;
+static constexpr float logP8 = 3.3333331174e-1f;
+static constexpr float logQ1 = -2.12194440e-4f;
+static constexpr float logQ2 = 0.693359375f;
+static constexpr float sqrtHalf = 0.707106781186547524f;
+
+//!
+//! @brief Scalar version of the polynomial logarithm used by the vector kernels
+//!
+//! Used for the remainder of a block that does not fill a whole vector, so every event in a block is
+//! treated the same way. Arguments that are not positive, normal and finite fall back to std::log.
+//!
+static float polyLog(const float& value) {
+  if (!(value >= FLT_MIN && value <= FLT_MAX)) {
+    return std::log(value);
+  }
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  float e = static_cast<float>(static_cast<int32_t>(bits >> 23) - 126);
+  bits = (bits & 0x807FFFFFu) | 0x3F000000u;
+  float x;
+  memcpy(&x, &bits, sizeof(x));
+  if (x < sqrtHalf) {
+    e -= 1.0f;
+    x = x + x - 1.0f;
+  } else {
+    x = x - 1.0f;
+  }
+  const float z = x * x;
+  float y = logP0;
+  y = y * x + logP1;
+  y = y * x + logP2;
+  y = y * x + logP3;
+  y = y * x + logP4;
+  y = y * x + logP5;
+  y = y * x + logP6;
+  y = y * x + logP7;
+  y = y * x + logP8;
+  y = y * x * z;
+  y += logQ1 * e;
+  y -= 0.5f * z;
+  return x + y + logQ2 * e;
+}
+
+static float scalarSumLogIntensity(
+    const float* re, const float* im, const size_t& stride, const size_t& nCoefficients,
+    const float* weights, const size_t& begin, const size_t& n,
+    const float* betas_re, const float* betas_im, const bool& exactLog) {
+  float result = 0.0f;
+  for (size_t j = begin; j < n; j++) {
+    float amp_re = 0.0f;
+    float amp_im = 0.0f;
+    for (size_t k = 0; k < nCoefficients; k++) {
+      const float c_re = re[k * stride + j];
+      const float c_im = im[k * stride + j];
+      amp_re += c_re * betas_re[k] - c_im * betas_im[k];
+      amp_im += c_re * betas_im[k] + c_im * betas_re[k];
+    }
+    const float intensity = amp_re * amp_re + amp_im * amp_im;
+    result += weights[j] * (exactLog ? std::log(intensity) : polyLog(intensity));
+  }
+  return result;
+}
+
+#ifdef KMATRIX_X86_KERNELS
+
+__attribute__((target("avx2,fma")))
+static __m256 logAVX2(__m256 x) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  // Lanes that are not positive, normal and finite are patched up with std::log afterwards
+  __m256i bits = _mm256_castps_si256(x);
+  __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+  bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(static_cast<int>(0x807FFFFFu))), _mm256_set1_epi32(0x3F000000));
+  __m256 m = _mm256_castsi256_ps(bits);
+  __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(sqrtHalf), _CMP_LT_OQ);
+  e = _mm256_sub_ps(e, _mm256_and_ps(one, small));
+  m = _mm256_add_ps(_mm256_sub_ps(m, one), _mm256_and_ps(m, small));
+  const __m256 z = _mm256_mul_ps(m, m);
+  __m256 y = _mm256_set1_ps(logP0);
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(logP1));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(logP2));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(logP3));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(logP4));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(logP5));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(logP6));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(logP7));
+  y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(logP8));
+  y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+  y = _mm256_fmadd_ps(e, _mm256_set1_ps(logQ1), y);
+  y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+  return _mm256_fmadd_ps(e, _mm256_set1_ps(logQ2), _mm256_add_ps(m, y));
+}
+
+__attribute__((target("avx2,fma")))
+static __m256 safeLogAVX2(__m256 x) {
+  __m256 result = logAVX2(x);
+  __m256 valid = _mm256_and_ps(_mm256_cmp_ps(x, _mm256_set1_ps(FLT_MIN), _CMP_GE_OQ), _mm256_cmp_ps(x, _mm256_set1_ps(FLT_MAX), _CMP_LE_OQ));
+  if (_mm256_movemask_ps(valid) != 0xFF) {
+    alignas(32) float values[8];
+    alignas(32) float logs[8];
+    _mm256_store_ps(values, x);
+    _mm256_store_ps(logs, result);
+    const int mask = _mm256_movemask_ps(valid);
+    for (int lane = 0; lane < 8; lane++) {
+      if (!(mask & (1 << lane))) {
+        logs[lane] = std::log(values[lane]);
+      }
+    }
+    result = _mm256_load_ps(logs);
+  }
+  return result;
+}
+
+__attribute__((target("avx2,fma")))
+static float horizontalSumAVX2(__m256 x) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+static float avx2SumLogIntensity(
+    const float* re, const float* im, const size_t& stride, const size_t& nCoefficients,
+    const float* weights, const size_t& n,
+    const float* betas_re, const float* betas_im) {
+  __m256 acc = _mm256_setzero_ps();
+  size_t j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m256 amp_re = _mm256_setzero_ps();
+    __m256 amp_im = _mm256_setzero_ps();
+    for (size_t k = 0; k < nCoefficients; k++) {
+      const __m256 c_re = _mm256_loadu_ps(re + k * stride + j);
+      const __m256 c_im = _mm256_loadu_ps(im + k * stride + j);
+      const __m256 b_re = _mm256_set1_ps(betas_re[k]);
+      const __m256 b_im = _mm256_set1_ps(betas_im[k]);
+      amp_re = _mm256_fmadd_ps(c_re, b_re, _mm256_fnmadd_ps(c_im, b_im, amp_re));
+      amp_im = _mm256_fmadd_ps(c_re, b_im, _mm256_fmadd_ps(c_im, b_re, amp_im));
+    }
+    const __m256 intensity = _mm256_fmadd_ps(amp_re, amp_re, _mm256_mul_ps(amp_im, amp_im));
+    acc = _mm256_fmadd_ps(_mm256_loadu_ps(weights + j), safeLogAVX2(intensity), acc);
+  }
+  return horizontalSumAVX2(acc) + scalarSumLogIntensity(re, im, stride, nCoefficients, weights, j, n, betas_re, betas_im, false);
+}
+
+// GCC 12 warns about the deliberately undefined pass-through operands inside its own AVX-512 intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+__attribute__((target("avx512f")))
+static __m512 logAVX512(__m512 x) {
+  const __m512 one = _mm512_set1_ps(1.0f);
+  __m512i bits = _mm512_castps_si512(x);
+  __m512 e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126)));
+  bits = _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(static_cast<int>(0x807FFFFFu))), _mm512_set1_epi32(0x3F000000));
+  __m512 m = _mm512_castsi512_ps(bits);
+  const __mmask16 small = _mm512_cmp_ps_mask(m, _mm512_set1_ps(sqrtHalf), _CMP_LT_OQ);
+  e = _mm512_mask_sub_ps(e, small, e, one);
+  m = _mm512_mask_add_ps(_mm512_sub_ps(m, one), small, _mm512_sub_ps(m, one), m);
+  const __m512 z = _mm512_mul_ps(m, m);
+  __m512 y = _mm512_set1_ps(logP0);
+  y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(logP1));
+  y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(logP2));
+  y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(logP3));
+  y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(logP4));
+  y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(logP5));
+  y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(logP6));
+  y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(logP7));
+  y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(logP8));
+  y = _mm512_mul_ps(_mm512_mul_ps(y, m), z);
+  y = _mm512_fmadd_ps(e, _mm512_set1_ps(logQ1), y);
+  y = _mm512_fnmadd_ps(z, _mm512_set1_ps(0.5f), y);
+  return _mm512_fmadd_ps(e, _mm512_set1_ps(logQ2), _mm512_add_ps(m, y));
+}
+
+__attribute__((target("avx512f")))
+static __m512 safeLogAVX512(__m512 x) {
+  __m512 result = logAVX512(x);
+  const __mmask16 valid = _mm512_cmp_ps_mask(x, _mm512_set1_ps(FLT_MIN), _CMP_GE_OQ)
+    & _mm512_cmp_ps_mask(x, _mm512_set1_ps(FLT_MAX), _CMP_LE_OQ);
+  if (valid != 0xFFFF) {
+    alignas(64) float values[16];
+    alignas(64) float logs[16];
+    _mm512_store_ps(values, x);
+    _mm512_store_ps(logs, result);
+    for (int lane = 0; lane < 16; lane++) {
+      if (!(valid & (1 << lane))) {
+        logs[lane] = std::log(values[lane]);
+      }
+    }
+    result = _mm512_load_ps(logs);
+  }
+  return result;
+}
+
+__attribute__((target("avx512f")))
+static float avx512SumLogIntensity(
+    const float* re, const float* im, const size_t& stride, const size_t& nCoefficients,
+    const float* weights, const size_t& n,
+    const float* betas_re, const float* betas_im) {
+  __m512 acc = _mm512_setzero_ps();
+  size_t j = 0;
+  for (; j + 16 <= n; j += 16) {
+    __m512 amp_re = _mm512_setzero_ps();
+    __m512 amp_im = _mm512_setzero_ps();
+    for (size_t k = 0; k < nCoefficients; k++) {
+      const __m512 c_re = _mm512_loadu_ps(re + k * stride + j);
+      const __m512 c_im = _mm512_loadu_ps(im + k * stride + j);
+      const __m512 b_re = _mm512_set1_ps(betas_re[k]);
+      const __m512 b_im = _mm512_set1_ps(betas_im[k]);
+      amp_re = _mm512_fmadd_ps(c_re, b_re, _mm512_fnmadd_ps(c_im, b_im, amp_re));
+      amp_im = _mm512_fmadd_ps(c_re, b_im, _mm512_fmadd_ps(c_im, b_re, amp_im));
+    }
+    const __m512 intensity = _mm512_fmadd_ps(amp_re, amp_re, _mm512_mul_ps(amp_im, amp_im));
+    acc = _mm512_fmadd_ps(_mm512_loadu_ps(weights + j), safeLogAVX512(intensity), acc);
+  }
+  // Fixed-order horizontal sum (_mm512_reduce_add_ps leaves the order to the compiler)
+  alignas(64) float lanes[16];
+  _mm512_store_ps(lanes, acc);
+  float result = 0.0f;
+  for (int lane = 0; lane < 16; lane++) {
+    result += lanes[lane];
+  }
+  return result + scalarSumLogIntensity(re, im, stride, nCoefficients, weights, j, n, betas_re, betas_im, false);
+}
+
+#pragma GCC diagnostic pop
+
+__attribute__((target("avx2,fma")))
+static void avx2Log(const float* x, float* result, const size_t& n) {
+  size_t j = 0;
+  for (; j + 8 <= n; j += 8) {
+    _mm256_storeu_ps(result + j, safeLogAVX2(_mm256_loadu_ps(x + j)));
+  }
+  for (; j < n; j++) {
+    result[j] = polyLog(x[j]);
+  }
+}
+
+__attribute__((target("avx512f")))
+static void avx512Log(const float* x, float* result, const size_t& n) {
+  size_t j = 0;
+  for (; j + 16 <= n; j += 16) {
+    _mm512_storeu_ps(result + j, safeLogAVX512(_mm512_loadu_ps(x + j)));
+  }
+  for (; j < n; j++) {
+    result[j] = polyLog(x[j]);
+  }
+}
+
+#endif  // KMATRIX_X86_KERNELS
+
+//!
+//! @brief Check whether the running CPU supports a kernel
+//!
+//! @param[in] kernel Kernel to check
+//!
+bool IntensityKernels::supported(const IntensityKernel& kernel) {
+  switch (kernel) {
+    case IntensityKernel::Scalar:
+      return true;
+#ifdef KMATRIX_X86_KERNELS
+    case IntensityKernel::AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case IntensityKernel::AVX512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+//!
+//! @brief Select the widest kernel supported by the running CPU
+//!
+//! The choice is made once per process.
+//!
+IntensityKernel IntensityKernels::best() {
+  static const IntensityKernel kernel = supported(IntensityKernel::AVX512) ? IntensityKernel::AVX512
+    : supported(IntensityKernel::AVX2) ? IntensityKernel::AVX2
+    : IntensityKernel::Scalar;
+  return kernel;
+}
+
+const char* IntensityKernels::name(const IntensityKernel& kernel) {
+  switch (kernel) {
+    case IntensityKernel::AVX2:
+      return "AVX2";
+    case IntensityKernel::AVX512:
+      return "AVX-512";
+    default:
+      return "scalar";
+  }
+}
+
+//!
+//! @brief Calculate the weighted sum of log-intensities over a block of events
+//!
+//! @param[in] kernel Kernel to use (must be supported by the running CPU)
+//! @param[in] re Real parts of the coefficients, coefficient k of event j at re[k * stride + j]
+//! @param[in] im Imaginary parts of the coefficients, laid out like re
+//! @param[in] stride Distance between consecutive coefficient columns
+//! @param[in] nCoefficients Number of coefficients (couplings) per event
+//! @param[in] weights Event weights
+//! @param[in] n Number of events
+//! @param[in] betas_re Real parts of the couplings
+//! @param[in] betas_im Imaginary parts of the couplings
+//!
+float IntensityKernels::sumLogIntensity(const IntensityKernel& kernel,
+    const float* re, const float* im, const size_t& stride, const size_t& nCoefficients,
+    const float* weights, const size_t& n,
+    const float* betas_re, const float* betas_im) {
+  switch (kernel) {
+#ifdef KMATRIX_X86_KERNELS
+    case IntensityKernel::AVX2:
+      return avx2SumLogIntensity(re, im, stride, nCoefficients, weights, n, betas_re, betas_im);
+    case IntensityKernel::AVX512:
+      return avx512SumLogIntensity(re, im, stride, nCoefficients, weights, n, betas_re, betas_im);
+#endif
+    default:
+      return scalarSumLogIntensity(re, im, stride, nCoefficients, weights, 0, n, betas_re, betas_im, true);
+  }
+}
+
+//!
+//! @brief Elementwise natural logarithm with the given kernel
+//!
+//! @param[in] kernel Kernel to use (must be supported by the running CPU)
+//! @param[in] x Input values
+//! @param[out] result Output values
+//! @param[in] n Number of values
+//!
+void IntensityKernels::logArray(const IntensityKernel& kernel, const float* x, float* result, const size_t& n) {
+  switch (kernel) {
+#ifdef KMATRIX_X86_KERNELS
+    case IntensityKernel::AVX2:
+      avx2Log(x, result, n);
+      return;
+    case IntensityKernel::AVX512:
+      avx512Log(x, result, n);
+      return;
+#endif
+    default:
+      for (size_t j = 0; j < n; j++) {
+        result[j] = std::log(x[j]);
+      }
+  }
+}
@@ -1,4 +1,5 @@
 #include "KMatrix.hpp"
+#include "SmallSolver.hpp"
 
 //!
 //! @brief Constructor for KMatrix class
@@ -7,9 +8,9 @@
 //! @param[in] numAlphas The number of resonances in the K-matrix
 //! @param[in] J The total anglular momentum of all resonances in the K-matrix
 //!
-KMatrix::KMatrix(int numChannels, int numAlphas, int J) : numAlphas(numAlphas), numChannels(numChannels),
+KMatrix::KMatrix(int numChannels, int numAlphas, int J) : numAlphas(numAlphas), numChannels(numChannels), J(J),
   mAlphas(1, numAlphas), mChannels(numChannels, 2),
-  gAlphas(numChannels, numAlphas), cBkg(numChannels, numChannels), J(J) {
+  gAlphas(numChannels, numAlphas), cBkg(numChannels, numChannels) {
     if (J == 0) {
       blattWeisskopfPtr = bind(&KMatrix::blatt_weisskopf0, this, placeholders::_1);
     } else if (J == 2) {
@@ -66,6 +67,16 @@ void KMatrix::initialize(
   gAlphas = arma::conv_to<arma::cx_fmat>::from(g_alphas);
   cBkg = arma::conv_to<arma::cx_fmat>::from(c_bkg);
 
+  // Hoist everything that does not depend on s out of K() and the batch evaluation
+  mAlphas2 = arma::square(m_alphas.row(0).t());
+  sumMass2 = arma::square(m_channels.col(0) + m_channels.col(1));
+  diffMass2 = arma::square(m_channels.col(0) - m_channels.col(1));
+  cBkgReal = c_bkg;
+  gigj = arma::fcube(numChannels, numChannels, numAlphas);
+  for (size_t k = 0; k < numAlphas; k++) {
+    gigj.slice(k) = g_alphas.col(k) * g_alphas.col(k).t();
+  }
+
   if (J == 0) {
     bwAlphaMat = arma::fmat(numChannels, numAlphas, arma::fill::ones);
     bwAlphaCube = arma::fcube(numChannels, numChannels, numAlphas, arma::fill::ones);
@@ -173,7 +184,7 @@ arma::cx_fvec KMatrix::q(const float& s) const {
 //! @param[in] s Input mass squared
 //! \return Vector containing result of this operation for each channel
 //!
-arma::fvec KMatrix::blatt_weisskopf0(const float& s [[gnu::unused]]) {
+arma::fvec KMatrix::blatt_weisskopf0(const float& s [[gnu::unused]]) const {
   return arma::fvec(numChannels, arma::fill::ones);
 }
 
@@ -189,7 +200,7 @@ arma::fvec KMatrix::blatt_weisskopf0(const float& s [[gnu::unused]]) {
 //! @param[in] s Input mass squared
 //! \return Vector containing result of this operation for each channel
 //!
-arma::fvec KMatrix::blatt_weisskopf2(const float& s) {
+arma::fvec KMatrix::blatt_weisskopf2(const float& s) const {
   arma::fvec z = arma::real(arma::square(KMatrix::q(s)) / (0.1973 * 0.1973));
   arma::fvec result = arma::sqrt(13.0 * arma::square(z) / (arma::square(z - 3.0) + 9.0 * z));
   return result;
@@ -260,16 +271,12 @@ arma::fcube KMatrix::B2(const float& s) const {
 //! \return Matrix containing result of this operation with dimension (numChannels, numChannels)
 //!
 arma::cx_fmat KMatrix::K(const float& s) const {
-  arma::cx_fmat result(numChannels, numChannels, arma::fill::zeros);
-  arma::cx_fcube gigj = arma::zeros<arma::cx_fcube>(numChannels, numChannels, numAlphas);
+  arma::fmat result(numChannels, numChannels, arma::fill::zeros);
+  arma::fcube b2 = KMatrix::B2(s);
   for (size_t k = 0; k < numAlphas; k++) {
-    gigj.slice(k) += gAlphas.col(k) * gAlphas.col(k).st();
-    gigj.slice(k) /= (s - (mAlphas(k) * mAlphas(k)));
-    gigj.slice(k) = gigj.slice(k) + cBkg;
+    result += (gigj.slice(k) / (s - mAlphas2(k)) + cBkgReal) % b2.slice(k);
   }
-  gigj %= arma::conv_to<arma::cx_fcube>::from(B2(s));
-  result += arma::sum(gigj, 2);
-  return result;
+  return arma::conv_to<arma::cx_fmat>::from(result);
 }
 
 //!
@@ -285,17 +292,7 @@ arma::cx_fmat KMatrix::K(const float& s) const {
 //! \return Matrix containing result of this operation with dimension (numChannels, numChannels)
 //!
 arma::cx_fmat KMatrix::K(const float& s, const float& s_0, const float& s_norm) const {
-  arma::cx_fmat result(numChannels, numChannels, arma::fill::zeros);
-  arma::cx_fcube gigj = arma::zeros<arma::cx_fcube>(numChannels, numChannels, numAlphas);
-  for (size_t k = 0; k < numAlphas; k++) {
-    gigj.slice(k) = gAlphas.col(k) * gAlphas.col(k).st();
-    gigj.slice(k) /= (s - mAlphas(k) * mAlphas(k));
-    gigj.slice(k) = gigj.slice(k) + cBkg;
-  }
-  gigj %= arma::conv_to<arma::cx_fcube>::from(B2(s));
-  result += arma::sum(gigj, 2);
-  result *= (s - s_0) / s_norm;
-  return result;
+  return KMatrix::K(s) * ((s - s_0) / s_norm);
 }
 
 //!
@@ -339,18 +336,14 @@ arma::cx_fmat KMatrix::C(const float& s) const {
 //!
 //! @param[in] s Input mass squared
 //! \return Matrix containing the result of this calculation with dimensions of (numChannels, numChannels)
+//! \throws runtime_error if the inverse fails
 //!
-arma::cx_fmat KMatrix::IKC_inv(const float& s) {
-  arma::cx_fmat kmat = KMatrix::K(s);
-  arma::cx_fmat cmat = KMatrix::C(s);
-  arma::cx_fmat IKC = arma::eye<arma::fmat>(numChannels, numChannels) + kmat * cmat;
-  try {
-    // arma::cx_fmat result = arma::cx_fmat(numChannels, numChannels, arma::fill::zeros);
-    return arma::inv(IKC, arma::inv_opts::allow_approx);
-    //return result;
-  } catch (const runtime_error& e) {
+arma::cx_fmat KMatrix::IKC_inv(const float& s) const {
+  arma::cx_fmat result;
+  if (!KMatrix::IKC_inv(result, s)) {
     throw runtime_error("Matrix inverse failed!");
   }
+  return result;
 }
 
 //!
@@ -364,18 +357,107 @@ arma::cx_fmat KMatrix::IKC_inv(const float& s) {
 //! @param[in] s_0 Location of Adler zero
 //! @param[in] s_norm Normalization factor for Adler zero term
 //! \return Matrix containing the result of this calculation with dimensions of (numChannels, numChannels)
+//! \throws runtime_error if the inverse fails
 //!
-arma::cx_fmat KMatrix::IKC_inv(const float& s, const float& s_0, const float& s_norm) {
-  arma::cx_fmat kmat = KMatrix::K(s, s_0, s_norm);
-  arma::cx_fmat cmat = KMatrix::C(s);
-  arma::cx_fmat IKC = arma::eye<arma::fmat>(numChannels, numChannels) + kmat * cmat;
-  try {
-    //arma::cx_fmat result = arma::cx_fmat(numChannels, numChannels, arma::fill::zeros);
-    return arma::inv(IKC, arma::inv_opts::allow_approx);
-    // return result;
-  } catch (const runtime_error& e) {
+arma::cx_fmat KMatrix::IKC_inv(const float& s, const float& s_0, const float& s_norm) const {
+  arma::cx_fmat result;
+  if (!KMatrix::IKC_inv(result, s, s_0, s_norm)) {
     throw runtime_error("Matrix inverse failed!");
   }
+  return result;
+}
+
+//!
+//! @brief Calculates the inverse of the "IKC" matrix without throwing
+//!
+//! @param[out] result Matrix containing the result of this calculation with dimensions of (numChannels, numChannels)
+//! @param[in] s Input mass squared
+//! \return false if the inverse fails
+//!
+bool KMatrix::IKC_inv(arma::cx_fmat& result, const float& s) const {
+  return arma::inv(result, KMatrix::IKC(KMatrix::K(s), s), arma::inv_opts::allow_approx);
+}
+
+//!
+//! @brief Calculates the inverse of the "IKC" matrix with Adler zero term in K-Matrix without throwing
+//!
+//! @param[out] result Matrix containing the result of this calculation with dimensions of (numChannels, numChannels)
+//! @param[in] s Input mass squared
+//! @param[in] s_0 Location of Adler zero
+//! @param[in] s_norm Normalization factor for Adler zero term
+//! \return false if the inverse fails
+//!
+bool KMatrix::IKC_inv(arma::cx_fmat& result, const float& s, const float& s_0, const float& s_norm) const {
+  return arma::inv(result, KMatrix::IKC(KMatrix::K(s, s_0, s_norm), s), arma::inv_opts::allow_approx);
+}
+
+//!
+//! @brief Calculates a single column of the inverse of the "IKC" matrix
+//!
+//! Only the column that enters the amplitude is needed, so this solves \f((I + K(s)C(s))x = e_{\text{channel}}\f)
+//! rather than forming the full inverse. Matrices with 2-5 channels use the unrolled kernels in SmallSolver.
+//!
+//! @param[out] result Vector containing the requested column of the inverse
+//! @param[in] s Input mass squared
+//! @param[in] channel Index of the column
+//! \return Estimate of the reciprocal condition number of the "IKC" matrix (0 if the solve fails)
+//!
+float KMatrix::IKC_inv_col(arma::cx_fvec& result, const float& s, const arma::uword& channel) const {
+  return KMatrix::solveColumn(result, KMatrix::IKC(KMatrix::K(s), s), channel);
+}
+
+//!
+//! @brief Calculates a single column of the inverse of the "IKC" matrix with Adler zero term in K-Matrix
+//!
+//! @param[out] result Vector containing the requested column of the inverse
+//! @param[in] s Input mass squared
+//! @param[in] s_0 Location of Adler zero
+//! @param[in] s_norm Normalization factor for Adler zero term
+//! @param[in] channel Index of the column
+//! \return Estimate of the reciprocal condition number of the "IKC" matrix (0 if the solve fails)
+//!
+float KMatrix::IKC_inv_col(arma::cx_fvec& result, const float& s, const float& s_0, const float& s_norm, const arma::uword& channel) const {
+  return KMatrix::solveColumn(result, KMatrix::IKC(KMatrix::K(s, s_0, s_norm), s), channel);
+}
+
+arma::cx_fmat KMatrix::IKC(const arma::cx_fmat& kmat, const float& s) const {
+  // C is diagonal, so K * C only scales the columns of K
+  arma::cx_fmat result = kmat.each_row() % KMatrix::C(s).diag().st();
+  result.diag() += 1.0f;
+  return result;
+}
+
+template <size_t N>
+static float solveFixed(arma::cx_fvec& result, const arma::cx_fmat& IKC, const arma::uword& channel) {
+  SmallSolver::Matrix<N> A;
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      A[i][j] = IKC(i, j);
+    }
+  }
+  SmallSolver::Vector<N> x;
+  const float rcond = SmallSolver::solveColumn<N>(A, channel, x);
+  result.set_size(N);
+  for (size_t i = 0; i < N; i++) {
+    result(i) = x[i];
+  }
+  return rcond;
+}
+
+float KMatrix::solveColumn(arma::cx_fvec& result, const arma::cx_fmat& IKC, const arma::uword& channel) {
+  switch (IKC.n_rows) {
+    case 2: return solveFixed<2>(result, IKC, channel);
+    case 3: return solveFixed<3>(result, IKC, channel);
+    case 4: return solveFixed<4>(result, IKC, channel);
+    case 5: return solveFixed<5>(result, IKC, channel);
+    default: break;
+  }
+  arma::cx_fvec unit(IKC.n_rows, arma::fill::zeros);
+  unit(channel) = 1.0f;
+  if (!arma::solve(result, IKC, unit, arma::solve_opts::allow_ugly) || !result.is_finite()) {
+    return 0.0f;
+  }
+  return arma::rcond(IKC);
 }
 
 //!
@@ -426,12 +508,184 @@ arma::cx_fvec KMatrix::P(const float& s, const arma::cx_fvec& betas, const arma:
 //! @param[in] betas Vector containing complex couplings for each resonance
 //! @param[in] ikc_inv_vec Vector containing a row of the inverse of the "IKC" matrix for the channel specified at initialization
 //!
-complex<float> KMatrix::F(const float& s, const arma::cx_fvec& betas, const arma::cx_fvec& ikc_inv_vec) {
+complex<float> KMatrix::F(const float& s, const arma::cx_fvec& betas, const arma::cx_fvec& ikc_inv_vec) const {
   arma::cx_fvec p_vec = KMatrix::P(s, betas);
   return arma::dot(ikc_inv_vec, p_vec);
 }
 
-complex<float> KMatrix::F(const float& s, const arma::cx_fvec& betas, const arma::fmat& B, const arma::cx_fvec& ikc_inv_vec) {
+complex<float> KMatrix::F(const float& s, const arma::cx_fvec& betas, const arma::fmat& B, const arma::cx_fvec& ikc_inv_vec) const {
   arma::cx_fvec p_vec = KMatrix::P(s, betas, B);
   return arma::dot(ikc_inv_vec, p_vec);
 }
+
+//!
+//! @brief Calculates the coefficient of each coupling in the complex amplitude
+//!
+//! Since \f(F(s, \beta)\f) is linear in the couplings, it can be written as \f(F = \sum_\alpha c_\alpha(s)\beta_\alpha\f) with
+//!
+//! \f[
+//! c_\alpha(s) = \sum_j (I - K(s)C(s))^{-1}_j \left(\frac{g_{j,\alpha}}{m_\alpha^2 - s}\right) B_{j}^J(s, m_\alpha)
+//! \f]
+//!
+//! None of these depend on the couplings, so they can be calculated once per event.
+//!
+//! @param[in] s Input mass squared
+//! @param[in] B Matrix of Blatt-Weisskopf ratios (see KMatrix::B)
+//! @param[in] ikc_inv_vec Vector containing a row of the inverse of the "IKC" matrix for the channel specified at initialization
+//! \return Vector containing the coefficient of each resonance coupling
+//!
+arma::cx_fvec KMatrix::coefficients(const float& s, const arma::fmat& B, const arma::cx_fvec& ikc_inv_vec) const {
+  arma::cx_fmat gB = gAlphas % arma::conv_to<arma::cx_fmat>::from(B);
+  arma::cx_fvec result = gB.st() * ikc_inv_vec;
+  for (size_t j = 0; j < numAlphas; j++) {
+    result(j) /= (s - mAlphas(j) * mAlphas(j));
+  }
+  return result;
+}
+
+//!
+//! @brief Evaluates the phase space, barrier factors, Chew-Mandelstam diagonal and K-matrix for many values of s
+//!
+//! All quantities are computed in one pass with the s-independent constants hoisted into initialize(). Each
+//! output has one row per value of s, so the inner loops run over contiguous values of s.
+//!
+//! @param[in] s Input masses squared
+//! @param[out] rho Phase space factors (n_s x numChannels)
+//! @param[out] bw Blatt-Weisskopf barrier factors (n_s x numChannels)
+//! @param[out] cdiag Diagonal of the Chew-Mandelstam matrix (n_s x numChannels)
+//! @param[out] kmats K-matrices, where kmats(e, i, j) is element (i, j) of K(s(e)) (n_s x numChannels x numChannels)
+//!
+void KMatrix::evaluate(const arma::fvec& s, arma::cx_fmat& rho, arma::fmat& bw, arma::cx_fmat& cdiag, arma::cx_fcube& kmats) const {
+  KMatrix::evaluate(s, 0.0, 1.0, false, rho, bw, cdiag, kmats);
+}
+
+//!
+//! @brief Evaluates the phase space, barrier factors, Chew-Mandelstam diagonal and K-matrix with Adler zero term
+//! for many values of s
+//!
+//! @param[in] s Input masses squared
+//! @param[in] s_0 Location of Adler zero
+//! @param[in] s_norm Normalization factor for Adler zero term
+//! @param[out] rho Phase space factors (n_s x numChannels)
+//! @param[out] bw Blatt-Weisskopf barrier factors (n_s x numChannels)
+//! @param[out] cdiag Diagonal of the Chew-Mandelstam matrix (n_s x numChannels)
+//! @param[out] kmats K-matrices, where kmats(e, i, j) is element (i, j) of K(s(e)) (n_s x numChannels x numChannels)
+//!
+void KMatrix::evaluate(const arma::fvec& s, const float& s_0, const float& s_norm,
+    arma::cx_fmat& rho, arma::fmat& bw, arma::cx_fmat& cdiag, arma::cx_fcube& kmats) const {
+  KMatrix::evaluate(s, s_0, s_norm, true, rho, bw, cdiag, kmats);
+}
+
+void KMatrix::evaluate(const arma::fvec& s, const float& adlerZero, const float& adlerNorm, const bool& adler,
+    arma::cx_fmat& rho, arma::fmat& bw, arma::cx_fmat& cdiag, arma::cx_fcube& kmats) const {
+  const arma::uword n = s.n_elem;
+  rho.set_size(n, numChannels);
+  bw.set_size(n, numChannels);
+  cdiag.set_size(n, numChannels);
+  const float* sPtr = s.memptr();
+
+  for (arma::uword i = 0; i < numChannels; i++) {
+    complex<float>* rhoCol = rho.colptr(i);
+    float* bwCol = bw.colptr(i);
+    complex<float>* cCol = cdiag.colptr(i);
+    for (arma::uword e = 0; e < n; e++) {
+      const float x = (sumMass2(i) - sPtr[e]) * (diffMass2(i) - sPtr[e]);
+      const complex<float> r = sqrt(complex<float>(x / (sPtr[e] * sPtr[e]), 0.0f));
+      const complex<float> chi = complex<float>(1.0f - sumMass2(i) / sPtr[e], 0.0f);
+      rhoCol[e] = r;
+      // Only the first term of C(); its mass-difference term vanishes (see C())
+      cCol[e] = r * log((chi + r) / (chi - r)) / static_cast<float>(arma::datum::pi);
+      if (J == 2) {
+        const float z = x / (4.0f * sPtr[e]) / (0.1973f * 0.1973f);
+        bwCol[e] = sqrt(13.0f * z * z / ((z - 3.0f) * (z - 3.0f) + 9.0f * z));
+      } else {
+        bwCol[e] = 1.0f;
+      }
+    }
+  }
+
+  arma::fcube kreal(n, numChannels, numChannels, arma::fill::zeros);
+  arma::fvec propagator(n);
+  for (arma::uword k = 0; k < numAlphas; k++) {
+    for (arma::uword e = 0; e < n; e++) {
+      propagator(e) = 1.0f / (sPtr[e] - mAlphas2(k));
+    }
+    for (arma::uword j = 0; j < numChannels; j++) {
+      const float* bwj = bw.colptr(j);
+      for (arma::uword i = 0; i < numChannels; i++) {
+        const float* bwi = bw.colptr(i);
+        const float g = gigj(i, j, k);
+        const float c = cBkgReal(i, j);
+        const float invBwAlpha = 1.0f / bwAlphaCube(i, j, k);
+        float* out = kreal.slice(j).colptr(i);
+        for (arma::uword e = 0; e < n; e++) {
+          out[e] += (g * propagator(e) + c) * (bwi[e] * bwj[e] * invBwAlpha);
+        }
+      }
+    }
+  }
+  if (adler) {
+    const arma::fvec factor = (s - adlerZero) / adlerNorm;
+    kreal.each_slice([&factor](arma::fmat& slice) { slice.each_col() %= factor; });
+  }
+  kmats = arma::conv_to<arma::cx_fcube>::from(kreal);
+}
+
+//!
+//! @brief Calculates a single column of the inverse of the "IKC" matrix for many values of s
+//!
+//! @param[out] result Requested column of the inverse for each value of s (n_s x numChannels)
+//! @param[in] s Input masses squared
+//! @param[in] channel Index of the column
+//! \return Estimate of the reciprocal condition number of the "IKC" matrix for each value of s (0 where the solve
+//! fails)
+//!
+arma::fvec KMatrix::IKC_inv_col(arma::cx_fmat& result, const arma::fvec& s, const arma::uword& channel) const {
+  arma::cx_fmat rho, cdiag;
+  arma::fmat bw;
+  arma::cx_fcube kmats;
+  KMatrix::evaluate(s, rho, bw, cdiag, kmats);
+  return KMatrix::IKC_inv_col(result, cdiag, kmats, channel);
+}
+
+//!
+//! @brief Calculates a single column of the inverse of the "IKC" matrix with Adler zero term in K-Matrix for
+//! many values of s
+//!
+//! @param[out] result Requested column of the inverse for each value of s (n_s x numChannels)
+//! @param[in] s Input masses squared
+//! @param[in] s_0 Location of Adler zero
+//! @param[in] s_norm Normalization factor for Adler zero term
+//! @param[in] channel Index of the column
+//! \return Estimate of the reciprocal condition number of the "IKC" matrix for each value of s (0 where the solve
+//! fails)
+//!
+arma::fvec KMatrix::IKC_inv_col(arma::cx_fmat& result, const arma::fvec& s, const float& s_0, const float& s_norm, const arma::uword& channel) const {
+  arma::cx_fmat rho, cdiag;
+  arma::fmat bw;
+  arma::cx_fcube kmats;
+  KMatrix::evaluate(s, s_0, s_norm, rho, bw, cdiag, kmats);
+  return KMatrix::IKC_inv_col(result, cdiag, kmats, channel);
+}
+
+arma::fvec KMatrix::IKC_inv_col(arma::cx_fmat& result, const arma::cx_fmat& cdiag, const arma::cx_fcube& kmats, const arma::uword& channel) const {
+  const arma::uword n = cdiag.n_rows;
+  result.set_size(n, numChannels);
+  arma::fvec rcond(n);
+  arma::cx_fmat ikc(numChannels, numChannels);
+  arma::cx_fvec column;
+  for (arma::uword e = 0; e < n; e++) {
+    for (arma::uword j = 0; j < numChannels; j++) {
+      for (arma::uword i = 0; i < numChannels; i++) {
+        ikc(i, j) = kmats(e, i, j) * cdiag(e, j) + (i == j ? 1.0f : 0.0f);
+      }
+    }
+    rcond(e) = KMatrix::solveColumn(column, ikc, channel);
+    if (rcond(e) > 0.0f) {
+      result.row(e) = column.st();
+    } else {
+      result.row(e).fill(arma::datum::nan);
+    }
+  }
+  return rcond;
+}
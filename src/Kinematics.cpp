@@ -0,0 +1,100 @@
+#include "Kinematics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//!
+//! @brief Compute the mass of p1 + p2 and the helicity angles of p1 for a range of events
+//!
+//! @param[in] beam Beam four-momenta
+//! @param[in] recoil Recoil four-momenta
+//! @param[in] p1 Four-momenta of the first resonance daughter
+//! @param[in] p2 Four-momenta of the second resonance daughter
+//! @param[in] n Number of events
+//! @param[out] masses Invariant mass of p1 + p2 (negative if the mass squared is negative, like TLorentzVector::M)
+//! @param[out] thetas Polar angle of p1 in the resonance rest frame
+//! @param[out] phis Azimuthal angle of p1 in the resonance rest frame
+//!
+void Kinematics::resonanceFrame(
+    const FourMomentumColumns& beam,
+    const FourMomentumColumns& recoil,
+    const FourMomentumColumns& p1,
+    const FourMomentumColumns& p2,
+    const size_t& n,
+    float* masses,
+    float* thetas,
+    float* phis) {
+  // Components of p1 along the helicity axes
+  double ax[blockSize], ay[blockSize], az[blockSize];
+  for (size_t begin = 0; begin < n; begin += blockSize) {
+    const size_t count = std::min(blockSize, n - begin);
+
+    // Branch-free arithmetic only, so that this loop vectorizes
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (size_t k = 0; k < count; k++) {
+      const size_t i = begin + k;
+      // Resonance four-momentum and its mass
+      const double re = static_cast<double>(p1.e[i]) + p2.e[i];
+      const double rx = static_cast<double>(p1.px[i]) + p2.px[i];
+      const double ry = static_cast<double>(p1.py[i]) + p2.py[i];
+      const double rz = static_cast<double>(p1.pz[i]) + p2.pz[i];
+      const double m2 = re * re - rx * rx - ry * ry - rz * rz;
+      masses[i] = static_cast<float>(std::copysign(std::sqrt(std::fabs(m2)), m2));
+
+      // Boost into the resonance rest frame (boost vector -r/E, as in TLorentzVector::Boost)
+      const double bx = -rx / re;
+      const double by = -ry / re;
+      const double bz = -rz / re;
+      const double b2 = bx * bx + by * by + bz * bz;
+      const double gamma = 1.0 / std::sqrt(1.0 - b2);
+      // gamma - 1 vanishes with b2, so offsetting the denominator by the smallest normal double reproduces the
+      // b2 = 0 case of ROOT without a branch
+      const double gamma2 = (gamma - 1.0) / (b2 + numeric_limits<double>::min());
+
+      const double rcx = recoil.px[i], rcy = recoil.py[i], rcz = recoil.pz[i], rce = recoil.e[i];
+      const double rcbp = bx * rcx + by * rcy + bz * rcz;
+      const double recoilX = rcx + gamma2 * rcbp * bx + gamma * bx * rce;
+      const double recoilY = rcy + gamma2 * rcbp * by + gamma * by * rce;
+      const double recoilZ = rcz + gamma2 * rcbp * bz + gamma * bz * rce;
+
+      const double p1x = p1.px[i], p1y = p1.py[i], p1z = p1.pz[i], p1e = p1.e[i];
+      const double p1bp = bx * p1x + by * p1y + bz * p1z;
+      const double restX = p1x + gamma2 * p1bp * bx + gamma * bx * p1e;
+      const double restY = p1y + gamma2 * p1bp * by + gamma * by * p1e;
+      const double restZ = p1z + gamma2 * p1bp * bz + gamma * bz * p1e;
+
+      // z = -unit(recoil in the rest frame)
+      const double recoilMag = std::sqrt(recoilX * recoilX + recoilY * recoilY + recoilZ * recoilZ);
+      // A zero vector stays zero, like TVector3::Unit
+      const double zScale = -1.0 / (recoilMag + numeric_limits<double>::min());
+      const double zx = recoilX * zScale, zy = recoilY * zScale, zz = recoilZ * zScale;
+
+      // y = unit(beam x (-recoil)) in the lab frame
+      const double bmx = beam.px[i], bmy = beam.py[i], bmz = beam.pz[i];
+      const double yx0 = -(bmy * rcz - bmz * rcy);
+      const double yy0 = -(bmz * rcx - bmx * rcz);
+      const double yz0 = -(bmx * rcy - bmy * rcx);
+      const double yMag = std::sqrt(yx0 * yx0 + yy0 * yy0 + yz0 * yz0);
+      const double yScale = 1.0 / (yMag + numeric_limits<double>::min());
+      const double yx = yx0 * yScale, yy = yy0 * yScale, yz = yz0 * yScale;
+
+      // x = y x z
+      const double xx = yy * zz - yz * zy;
+      const double xy = yz * zx - yx * zz;
+      const double xz = yx * zy - yy * zx;
+
+      ax[k] = restX * xx + restY * xy + restZ * xz;
+      ay[k] = restX * yx + restY * yy + restZ * yz;
+      az[k] = restX * zx + restY * zy + restZ * zz;
+    }
+
+    for (size_t k = 0; k < count; k++) {
+      // Same conventions as TVector3::Theta and TVector3::Phi
+      const double perp = std::sqrt(ax[k] * ax[k] + ay[k] * ay[k]);
+      thetas[begin + k] = static_cast<float>((perp == 0.0 && az[k] == 0.0) ? 0.0 : std::atan2(perp, az[k]));
+      phis[begin + k] = static_cast<float>((ax[k] == 0.0 && ay[k] == 0.0) ? 0.0 : std::atan2(ay[k], ax[k]));
+    }
+  }
+}
@@ -3,7 +3,21 @@
 #include "Likelihood.hpp"
 #include "Amplitude.hpp"
 #include "DataReader.hpp"
+#include "SetupCache.hpp"
+#include "BoundedQueue.hpp"
+#include "TROOT.h"
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 Likelihood::Likelihood(const string& data_path,
                        const string& acc_path,
@@ -14,83 +28,661 @@ Likelihood::Likelihood(const string& data_path,
   : amplitude(),
   data(data_path, data_tree),
   acc(acc_path, acc_tree),
-  gen(gen_path, gen_tree) {
-    data.read();
-    acc.read();
-    nGenerated = gen.nEvents;
+  genPath(gen_path),
+  genTree(gen_tree) {
+    data.printSummary(cout, "Data");
+    acc.printSummary(cout, "Accepted MC");
   }
 
+Likelihood::Likelihood(const string& data_path,
+                       const string& acc_path,
+                       const Long64_t& n_generated,
+                       const string& data_tree,
+                       const string& acc_tree)
+  : amplitude(),
+  data(data_path, data_tree),
+  acc(acc_path, acc_tree),
+  nGenerated(n_generated) {
+    data.printSummary(cout, "Data");
+    acc.printSummary(cout, "Accepted MC");
+    cout << "Generated MC: " << nGenerated << " events (given)" << endl;
+  }
+
+#ifdef _OPENMP
+static int threadCount(const int& nThreads) {
+  return nThreads > 0 ? nThreads : omp_get_max_threads();
+}
+#endif
+
+//!
+//! @brief Sum matrices with a fixed pairwise reduction tree (see AmplitudeBasis::pairwiseSum)
+//!
+static arma::cx_mat pairwiseSum(const vector<arma::cx_mat>& values, const size_t& begin, const size_t& end) {
+  if (end - begin == 1) {
+    return values[begin];
+  }
+  const size_t middle = begin + (end - begin) / 2;
+  return pairwiseSum(values, begin, middle) + pairwiseSum(values, middle, end);
+}
+
+//!
+//! @brief Append s = mass^2 of every invalid event to rejected
+//!
+static void collectRejected(const EventColumns& events, const vector<unsigned char>& valid, vector<float>& rejected) {
+  for (size_t i = 0; i < events.size(); i++) {
+    if (!valid[i]) {
+      rejected.push_back(events.masses[i] * events.masses[i]);
+    }
+  }
+}
+
+//!
+//! @brief Print the number of events rejected in setup() and the ranges of s they cover
+//!
+//! Rejected values of s are merged into ranges wherever neighbouring values are closer than 1% of the
+//! full rejected span.
+//!
+static void printRejectionSummary(const string& name, vector<float> rejected, const size_t& total) {
+  cout << name << ": rejected " << rejected.size() << " of " << total << " events" << endl;
+  if (rejected.empty()) {
+    return;
+  }
+  std::sort(rejected.begin(), rejected.end());
+  const float gap = std::max(1.0e-4f, 0.01f * (rejected.back() - rejected.front()));
+  const size_t maxRanges = 20;
+  size_t nRanges = 0;
+  size_t first = 0;
+  for (size_t i = 1; i <= rejected.size(); i++) {
+    if (i == rejected.size() || rejected[i] - rejected[i - 1] > gap) {
+      if (nRanges < maxRanges) {
+        cout << "  s in [" << rejected[first] << ", " << rejected[i - 1] << "] GeV^2: " << i - first << " events" << endl;
+      }
+      nRanges++;
+      first = i;
+    }
+  }
+  if (nRanges > maxRanges) {
+    cout << "  (" << nRanges - maxRanges << " more ranges)" << endl;
+  }
+}
+
+bool Likelihood::eventCoefficients(arma::cx_fvec& result, const float& mass, const float& theta, const float& phi) const {
+  if (coefficientTable) {
+    return coefficientTable->coefficients(result, pow(mass, 2), theta, phi);
+  }
+  return amplitude.coefficients(result, pow(mass, 2), theta, phi);
+}
+
+//!
+//! @brief Build the coefficient table over the mass range of one sample (only if interpolation is enabled)
+//!
+//! Each sample gets its own table, so its coefficients (and any cache of them) depend on that sample only.
+//!
+void Likelihood::buildCoefficientTable(const DataReader& reader) {
+  coefficientTable.reset();
+  if (interpolationTolerance <= 0.0f || reader.masses.empty()) {
+    return;
+  }
+  const auto range = std::minmax_element(reader.masses.begin(), reader.masses.end());
+  if (*range.second > *range.first) {
+    coefficientTable = make_unique<CoefficientTable>(amplitude, pow(*range.first, 2), pow(*range.second, 2), interpolationTolerance);
+    coefficientTable->printReport(cout);
+  }
+}
+
+//!
+//! @brief Key of the setup cache of one sample (0 if caching is disabled or the input cannot be found)
+//!
+uint64_t Likelihood::cacheKey(const DataReader& reader, const vector<double>& settings) const {
+  if (cacheDirectory.empty()) {
+    return 0;
+  }
+  vector<double> allSettings = reader.getSelection().parameters();
+  allSettings.insert(allSettings.end(), settings.begin(), settings.end());
+  return SetupCache::key(reader.getFilePaths(), reader.getTreeName(), amplitude.constants(), allSettings);
+}
+
+//!
+//! @brief Store the coefficients of every event of a sample in a basis and flag the events that could be evaluated
+//!
+//! @param[in] events Events
+//! @param[out] valid Validity of every event
+//! @param[out] basis Basis with one (possibly invalid) slot per event
+//! @param[in] threads Number of threads (0 uses the OpenMP default)
+//!
+void Likelihood::fillBasis(const EventColumns& events, vector<unsigned char>& valid, AmplitudeBasis& basis,
+    [[gnu::unused]] const int& threads) const {
+  const int n = events.size();
+  valid.assign(n, 0);
+  basis.resize(n);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 256) num_threads(threadCount(threads))
+#endif
+  for (int i = 0; i < n; i++) {
+    arma::cx_fvec coefficients;
+    valid[i] = eventCoefficients(coefficients, events.masses[i], events.thetas[i], events.phis[i]);
+    if (valid[i]) {
+      basis.set(i, coefficients, events.weights[i]);
+    }
+  }
+}
+
+//!
+//! @brief Sum the (13 x 13) matrix sum_i w_i conj(c_i) c_i^T over the valid events of a sample
+//!
+//! The sum is accumulated in double precision over fixed blocks of events that are summed in a fixed order.
+//!
+//! @param[in] events Events
+//! @param[out] valid Validity of every event
+//! @param[in] threads Number of threads (0 uses the OpenMP default)
+//! \return Unnormalized matrix of integrals
+//!
+arma::cx_mat Likelihood::sumIntegrals(const EventColumns& events, vector<unsigned char>& valid,
+    [[gnu::unused]] const int& threads) const {
+  const int n = events.size();
+  valid.assign(n, 0);
+  const int nIntegralBlocks = std::max(1, (n + integralBlockSize - 1) / integralBlockSize);
+  vector<arma::cx_mat> partialIntegrals(nIntegralBlocks, arma::cx_mat(13, 13, arma::fill::zeros));
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threadCount(threads))
+#endif
+  for (int b = 0; b < nIntegralBlocks; b++) {
+    const int end = std::min(n, (b + 1) * integralBlockSize);
+    arma::cx_fvec coefficients;
+    for (int i = b * integralBlockSize; i < end; i++) {
+      valid[i] = eventCoefficients(coefficients, events.masses[i], events.thetas[i], events.phis[i]);
+      if (valid[i]) {
+        arma::cx_vec c = arma::conv_to<arma::cx_vec>::from(coefficients);
+        partialIntegrals[b] += static_cast<double>(events.weights[i]) * arma::conj(c) * c.st();
+      }
+    }
+  }
+  return pairwiseSum(partialIntegrals, 0, partialIntegrals.size());
+}
+
+//!
+//! @brief Read the data and accepted Monte Carlo, then precalculate the per-event amplitude coefficients of the data
+//! and the normalization integrals of the accepted Monte Carlo
+//!
+//! If a cache directory is set, each sample is loaded from its cache file when one matches, and written to it
+//! otherwise. The samples that are not cached are read and precalculated together in a pipeline (see ingest), except
+//! with interpolation, where each sample is read in full first so its coefficient table can span its mass range. If
+//! a memory budget is set, the samples are streamed instead (see setupStreaming). In every case the results do not
+//! depend on the number of threads.
+//!
 void Likelihood::setup() {
+  if (nGenerated <= 0) {
+    countGenerated();
+  }
   cout << "Precalculating inverse of (I - KC)" << endl;
+  if (memoryBudget > 0) {
+    setupStreaming();
+    printMemoryReport();
+    return;
+  }
+  dataChunks.close();
+  accChunks.close();
+  coefficientTable.reset();
+
+  vector<unsigned char> dataValid;
+  const uint64_t dataKey = cacheKey(data, {interpolationTolerance});
+  const string dataCache = dataKey ? SetupCache::path(cacheDirectory, "data", dataKey) : "";
+  const bool dataCached = dataKey && SetupCache::load(dataCache, dataKey, data, dataValid, &dataBasis, nullptr);
+  if (dataCached) {
+    cout << "Data: loaded " << data.nEvents << " of " << dataValid.size() << " events from " << dataCache << endl;
+  }
+  vector<unsigned char> accValid;
+  arma::cx_mat integrals;
+  const uint64_t accKey = cacheKey(acc, {interpolationTolerance, static_cast<double>(precomputeIntegrals)});
+  const string accCache = accKey ? SetupCache::path(cacheDirectory, "acc", accKey) : "";
+  const bool accCached = accKey && SetupCache::load(accCache, accKey, acc, accValid,
+      precomputeIntegrals ? nullptr : &accBasis, precomputeIntegrals ? &integrals : nullptr);
+  if (accCached) {
+    cout << "Monte Carlo: loaded " << acc.nEvents << " of " << accValid.size() << " events from " << accCache << endl;
+  }
+
+  if (interpolationTolerance <= 0.0f) {
+    ingest(!dataCached, !accCached, dataValid, accValid, integrals);
+  } else {
+    if (!dataCached) {
+      cout << "Data" << endl;
+      data.read(nThreads);
+      buildCoefficientTable(data);
+      fillBasis(data, dataValid, dataBasis, nThreads);
+      vector<float> rejected;
+      collectRejected(data, dataValid, rejected);
+      printRejectionSummary("Data", rejected, dataValid.size());
+      dataBasis.compact(dataValid);
+      data.compact(dataValid);
+    }
+    if (!accCached) {
+      cout << "Monte Carlo" << endl;
+      acc.read(nThreads);
+      buildCoefficientTable(acc);
+      if (precomputeIntegrals) {
+        integrals = sumIntegrals(acc, accValid, nThreads);
+      } else {
+        fillBasis(acc, accValid, accBasis, nThreads);
+        accBasis.compact(accValid);
+      }
+      vector<float> rejected;
+      collectRejected(acc, accValid, rejected);
+      printRejectionSummary("Monte Carlo", rejected, accValid.size());
+      acc.compact(accValid);
+    }
+    coefficientTable.reset();
+  }
+
+  if (dataKey && !dataCached) {
+    SetupCache::save(dataCache, dataKey, data, dataValid, &dataBasis, nullptr);
+  }
+  if (accKey && !accCached) {
+    SetupCache::save(accCache, accKey, acc, accValid, precomputeIntegrals ? nullptr : &accBasis,
+        precomputeIntegrals ? &integrals : nullptr);
+  }
+  if (precomputeIntegrals) {
+    normIntegrals = arma::conv_to<arma::cx_fmat>::from(integrals / static_cast<double>(nGenerated));
+  }
+  printMemoryReport();
+}
+
+//!
+//! @brief Read and precalculate the data and/or accepted Monte Carlo in a producer/consumer pipeline
+//!
+//! Reader threads take the clusters of both samples in an interleaved order (see DataReader::readCluster) and push
+//! them to a bounded queue, so both files are read at once and reading never gets more than a few chunks ahead of
+//! the precalculation. Worker threads pop the chunks and evaluate their coefficients (or integrals) as they arrive.
+//! Finished chunks are appended to the sample in cluster order as soon as all earlier chunks are in, so the events
+//! end up in the same order as with DataReader::read, and the integrals are summed over the clusters with a fixed
+//! pairwise tree. Startup therefore takes about as long as the slower of reading and precalculating, and the result
+//! does not depend on the number of threads.
+//!
+//! @param[in] readData Whether to read and precalculate the data
+//! @param[in] readAcc Whether to read and precalculate the accepted Monte Carlo
+//! @param[out] dataValid Validity of every selected data event
+//! @param[out] accValid Validity of every selected accepted Monte Carlo event
+//! @param[out] integrals Unnormalized integral matrix (only if readAcc and integrals are precomputed)
+//! \throws runtime_error (or any other exception from a pipeline thread) if reading or precalculating fails
+//!
+void Likelihood::ingest(const bool& readData, const bool& readAcc, vector<unsigned char>& dataValid,
+    vector<unsigned char>& accValid, arma::cx_mat& integrals) {
+  struct Chunk {
+    Chunk(const size_t& sample, const size_t& cluster) : sample(sample), cluster(cluster) {}
+    size_t sample;
+    size_t cluster;
+    EventColumns events;
+    vector<unsigned char> valid;
+    AmplitudeBasis basis;
+    arma::cx_mat integrals;
+    vector<float> rejected;
+  };
+  struct Sample {
+    Sample(const string& name, DataReader* reader, AmplitudeBasis* basis, vector<unsigned char>* valid,
+        const bool& integralsOnly)
+      : name(name), reader(reader), basis(basis), valid(valid), integralsOnly(integralsOnly) {}
+    string name;
+    DataReader* reader;
+    AmplitudeBasis* basis;
+    vector<unsigned char>* valid;
+    bool integralsOnly;
+    // Chunks waiting for an earlier chunk, the next cluster to append, and the appended results
+    vector<unique_ptr<Chunk>> pending;
+    size_t next = 0;
+    vector<arma::cx_mat> integrals;
+    vector<float> rejected;
+    mutex guard;
+  };
+  vector<unique_ptr<Sample>> samples;
+  if (readData) {
+    samples.push_back(make_unique<Sample>("Data", &data, &dataBasis, &dataValid, false));
+  }
+  if (readAcc) {
+    samples.push_back(make_unique<Sample>("Monte Carlo", &acc, &accBasis, &accValid, precomputeIntegrals));
+  }
+  if (samples.empty()) {
+    return;
+  }
+
+  // Interleave the clusters of the samples, so they are read at the same time
+  vector<pair<size_t, size_t>> items;
+  for (size_t c = 0, remaining = samples.size(); remaining > 0; c++) {
+    remaining = 0;
+    for (size_t k = 0; k < samples.size(); k++) {
+      if (c < samples[k]->reader->numClusters()) {
+        items.emplace_back(k, c);
+        remaining++;
+      }
+    }
+  }
+  for (unique_ptr<Sample>& sample : samples) {
+    DataReader& reader = *sample->reader;
+    sample->pending.resize(reader.numClusters());
+    sample->valid->clear();
+    static_cast<EventColumns&>(reader) = EventColumns();
+    if (reader.getSelection().keepsAll()) {
+      // The sizes are known up front, so the columns never reallocate
+      for (vector<float>* column : {&reader.masses, &reader.weights, &reader.thetas, &reader.phis}) {
+        column->reserve(reader.numEntries());
+      }
+      sample->valid->reserve(reader.numEntries());
+      if (!sample->integralsOnly) {
+        sample->basis->reserve(reader.numEntries());
+      }
+    }
+    if (!sample->integralsOnly) {
+      sample->basis->resize(0);
+    }
+  }
+
+#ifdef _OPENMP
+  const int nTotal = threadCount(nThreads);
+#else
+  const int nTotal = std::max(1u, thread::hardware_concurrency());
+#endif
+  const int nReaders = std::max(1, nTotal / 4);
+  const int nWorkers = std::max(1, nTotal - nReaders);
+  cout << "Reading " << items.size() << " chunks with " << nReaders << " reader and " << nWorkers
+       << " precalculation threads" << endl;
+  BoundedQueue<unique_ptr<Chunk>> queue(2 * nWorkers);
+  atomic<size_t> nextItem(0);
+  atomic<int> activeReaders(nReaders);
+  mutex errorGuard;
+  exception_ptr error;
+  auto fail = [&]() {
+    lock_guard<mutex> lock(errorGuard);
+    if (!error) {
+      error = current_exception();
+    }
+    queue.close();
+  };
+  // Append every finished chunk of a sample that has no earlier chunk outstanding
+  auto append = [](Sample& sample, unique_ptr<Chunk> chunk) {
+    lock_guard<mutex> lock(sample.guard);
+    sample.pending[chunk->cluster] = std::move(chunk);
+    while (sample.next < sample.pending.size() && sample.pending[sample.next]) {
+      Chunk& ready = *sample.pending[sample.next];
+      sample.valid->insert(sample.valid->end(), ready.valid.begin(), ready.valid.end());
+      sample.rejected.insert(sample.rejected.end(), ready.rejected.begin(), ready.rejected.end());
+      sample.reader->append(ready.events);
+      if (sample.integralsOnly) {
+        sample.integrals.push_back(ready.integrals);
+      } else {
+        sample.basis->append(ready.basis);
+      }
+      sample.pending[sample.next].reset();
+      sample.next++;
+    }
+  };
+
+  ROOT::EnableThreadSafety();
+  vector<thread> threads;
+  for (int r = 0; r < nReaders; r++) {
+    threads.emplace_back([&]() {
+      try {
+        vector<DataReader::FileHandle> handles(samples.size());
+        for (size_t i = nextItem++; i < items.size(); i = nextItem++) {
+          auto chunk = make_unique<Chunk>(items[i].first, items[i].second);
+          samples[chunk->sample]->reader->readCluster(chunk->cluster, chunk->events, handles[chunk->sample]);
+          if (!queue.push(std::move(chunk))) {
+            break;
+          }
+        }
+      } catch (...) {
+        fail();
+      }
+      if (--activeReaders == 0) {
+        queue.close();
+      }
+    });
+  }
+  for (int w = 0; w < nWorkers; w++) {
+    threads.emplace_back([&]() {
+      try {
+        unique_ptr<Chunk> chunk;
+        while (queue.pop(chunk)) {
+          Sample& sample = *samples[chunk->sample];
+          if (sample.integralsOnly) {
+            chunk->integrals = sumIntegrals(chunk->events, chunk->valid, 1);
+          } else {
+            fillBasis(chunk->events, chunk->valid, chunk->basis, 1);
+            chunk->basis.compact(chunk->valid);
+          }
+          collectRejected(chunk->events, chunk->valid, chunk->rejected);
+          chunk->events.compact(chunk->valid);
+          append(sample, std::move(chunk));
+        }
+      } catch (...) {
+        fail();
+      }
+    });
+  }
+  for (thread& t : threads) {
+    t.join();
+  }
+  if (error) {
+    rethrow_exception(error);
+  }
+
+  for (unique_ptr<Sample>& sample : samples) {
+    sample->reader->nEvents = sample->reader->size();
+    printRejectionSummary(sample->name, sample->rejected, sample->valid->size());
+    if (sample->integralsOnly) {
+      integrals = sample->integrals.empty() ? arma::cx_mat(13, 13, arma::fill::zeros)
+                                            : pairwiseSum(sample->integrals, 0, sample->integrals.size());
+    }
+  }
+}
+
+//!
+//! @brief Count the generated Monte Carlo from its tree headers (see DataReader::countEntries)
+//!
+//! The counts are cached next to the setup cache when a cache directory is set.
+//!
+//! \throws runtime_error if there are no generated events
+//!
+void Likelihood::countGenerated() {
+  const vector<string> paths = DataReader::expandPaths(genPath);
+  const vector<Long64_t> entries = DataReader::countEntries(paths, genTree,
+      cacheDirectory.empty() ? "" : cacheDirectory + "/entry-counts.txt", nThreads);
+  DataReader::printCounts(cout, "Generated MC", paths, entries);
+  nGenerated = 0;
+  for (const Long64_t& count : entries) {
+    nGenerated += count;
+  }
+  if (nGenerated <= 0) {
+    stringstream error;
+    error << "Error: No generated events in " << genPath << "!";
+    throw runtime_error(error.str());
+  }
+}
+
+//!
+//! @brief Number of events per chunk in streaming mode
+//!
+//! A chunk needs its kinematics, validity flags and basis in memory during setup, and the evaluation keeps one
+//! chunk mapped while the next is read ahead, so two chunks of basis must fit in the budget. Chunks are a multiple
+//! of the integral block size.
+//!
+Long64_t Likelihood::streamingChunkEvents() const {
+  const size_t bytesPerEvent = 2 * (1 + 2 * AmplitudeBasis::nCoefficients) * sizeof(float) + 4 * sizeof(float) + 1;
+  const Long64_t nBlocks = memoryBudget / (bytesPerEvent * integralBlockSize);
+  return std::max<Long64_t>(1, nBlocks) * integralBlockSize;
+}
+
+//!
+//! @brief Read both samples sequentially in chunks of streamingChunkEvents(), keeping no per-event state in memory
+//!
+//! The data basis (and the accepted Monte Carlo basis, if the integrals are not precomputed) is written to chunked
+//! scratch files, and the integrals are summed chunk by chunk in a fixed order. The setup cache is not used. With
+//! interpolation enabled, the table of each sample spans the mass range of its first chunk, and events outside that
+//! range are evaluated exactly.
+//!
+void Likelihood::setupStreaming() {
+  const Long64_t chunkEvents = streamingChunkEvents();
+  cout << "Streaming in chunks of " << chunkEvents << " events (memory budget "
+       << memoryBudget / (1024.0 * 1024.0) << " MB)" << endl;
+  AmplitudeBasis chunkBasis;
+  vector<unsigned char> valid;
+  // Selected events and the values of s of those rejected, over all chunks
+  size_t nSelected = 0;
+  vector<float> rejected;
+  // The selection cuts are reported apart from the events that cannot be evaluated, as with DataReader::read
+  auto printSelection = [&nSelected](const DataReader& reader) {
+    if (!reader.getSelection().keepsAll()) {
+      cout << "Selected " << nSelected << " of " << reader.numEntries() << " events" << endl;
+    }
+  };
+
   cout << "Data" << endl;
-  vector<int> badDataIndices;
-  arma::cx_fvec ikc_inv_f0(5, arma::fill::zeros);
-  arma::cx_fvec ikc_inv_f2(4, arma::fill::zeros);
-  arma::cx_fvec ikc_inv_a0(2, arma::fill::zeros);
-  arma::cx_fvec ikc_inv_a2(3, arma::fill::zeros);
-  arma::fmat bw_f2_matrix(4, 4, arma::fill::zeros);
-  arma::fmat bw_a2_matrix(3, 3, arma::fill::zeros);
-  for (int i = 0; i < data.nEvents; i++) {
-    try {
-      float s = pow(data.masses[i], 2);
-      ikc_inv_f0 = amplitude.ikc_inv_vec_f0(s);
-      ikc_inv_f2 = amplitude.ikc_inv_vec_f2(s);
-      ikc_inv_a0 = amplitude.ikc_inv_vec_a0(s);
-      ikc_inv_a2 = amplitude.ikc_inv_vec_a2(s);
-      bw_f2_matrix = amplitude.bw_f2(s);
-      bw_a2_matrix = amplitude.bw_a2(s);
-
-      ikc_inv_vec_f0.push_back(ikc_inv_f0);
-      ikc_inv_vec_f2.push_back(ikc_inv_f2);
-      ikc_inv_vec_a0.push_back(ikc_inv_a0);
-      ikc_inv_vec_a2.push_back(ikc_inv_a2);
-      bw_f2.push_back(bw_f2_matrix);
-      bw_a2.push_back(bw_a2_matrix);
-    } catch (const runtime_error& e) {
-      cout << "One or more matrix inverses failed for event " << i << endl;
-      badDataIndices.push_back(i);
-    }
-  }
-
-  for (auto it = badDataIndices.rbegin(); it != badDataIndices.rend(); it++) {
-    data.masses.erase(data.masses.begin() + *it);
-    data.weights.erase(data.weights.begin() + *it);
-    data.thetas.erase(data.thetas.begin() + *it);
-    data.phis.erase(data.phis.begin() + *it);
+  dataChunks.open(scratchDirectory);
+  Long64_t nEntries = data.numEntries();
+  for (Long64_t begin = 0; begin < nEntries; begin += chunkEvents) {
+    data.readChunk(begin, begin + chunkEvents);
+    if (begin == 0) {
+      buildCoefficientTable(data);
+    }
+    fillBasis(data, valid, chunkBasis, nThreads);
+    collectRejected(data, valid, rejected);
+    nSelected += valid.size();
+    chunkBasis.compact(valid);
+    dataChunks.append(chunkBasis);
   }
+  printSelection(data);
+  printRejectionSummary("Data", rejected, nSelected);
+
   cout << "Monte Carlo" << endl;
-  vector<int> badMCIndices;
-  for (int i = 0; i < acc.nEvents; i++) {
-    try {
-      float s = pow(acc.masses[i], 2);
-      ikc_inv_f0 = amplitude.ikc_inv_vec_f0(s);
-      ikc_inv_f2 = amplitude.ikc_inv_vec_f2(s);
-      ikc_inv_a0 = amplitude.ikc_inv_vec_a0(s);
-      ikc_inv_a2 = amplitude.ikc_inv_vec_a2(s);
-      bw_f2_matrix = amplitude.bw_f2(s);
-      bw_a2_matrix = amplitude.bw_a2(s);
-
-      ikc_inv_vec_f0_mc.push_back(ikc_inv_f0);
-      ikc_inv_vec_f2_mc.push_back(ikc_inv_f2);
-      ikc_inv_vec_a0_mc.push_back(ikc_inv_a0);
-      ikc_inv_vec_a2_mc.push_back(ikc_inv_a2);
-      bw_f2_mc.push_back(bw_f2_matrix);
-      bw_a2_mc.push_back(bw_a2_matrix);
-    } catch (const runtime_error& e) {
-      cout << "One or more matrix inverses failed for event " << i << endl;
-      badMCIndices.push_back(i);
-    }
-  }
-
-  for (auto it = badMCIndices.rbegin(); it != badMCIndices.rend(); it++) {
-    acc.masses.erase(acc.masses.begin() + *it);
-    acc.weights.erase(acc.weights.begin() + *it);
-    acc.thetas.erase(acc.thetas.begin() + *it);
-    acc.phis.erase(acc.phis.begin() + *it);
-  }
-}
-
-float Likelihood::getExtendedLogLikelihood(const arma::Col<float>& params) {
+  if (!precomputeIntegrals) {
+    accChunks.open(scratchDirectory);
+  } else {
+    accChunks.close();
+  }
+  arma::cx_mat integrals(13, 13, arma::fill::zeros);
+  nSelected = 0;
+  rejected.clear();
+  nEntries = acc.numEntries();
+  for (Long64_t begin = 0; begin < nEntries; begin += chunkEvents) {
+    acc.readChunk(begin, begin + chunkEvents);
+    if (begin == 0) {
+      buildCoefficientTable(acc);
+    }
+    if (precomputeIntegrals) {
+      integrals += sumIntegrals(acc, valid, nThreads);
+    } else {
+      fillBasis(acc, valid, chunkBasis, nThreads);
+      chunkBasis.compact(valid);
+      accChunks.append(chunkBasis);
+    }
+    collectRejected(acc, valid, rejected);
+    nSelected += valid.size();
+  }
+  printSelection(acc);
+  printRejectionSummary("Monte Carlo", rejected, nSelected);
+  coefficientTable.reset();
+  if (precomputeIntegrals) {
+    normIntegrals = arma::conv_to<arma::cx_fmat>::from(integrals / static_cast<double>(nGenerated));
+  }
+  // Only the chunked bases are needed from here on
+  for (DataReader* reader : {&data, &acc}) {
+    reader->readChunk(0, 0);
+    for (vector<float>* column : {&reader->masses, &reader->weights, &reader->thetas, &reader->phis}) {
+      column->shrink_to_fit();
+    }
+  }
+}
+
+void Likelihood::setPrecomputeIntegrals(const bool& enable) {
+  precomputeIntegrals = enable;
+}
+
+void Likelihood::setInterpolationTolerance(const float& tolerance) {
+  interpolationTolerance = tolerance;
+}
+
+void Likelihood::setMemoryBudget(const size_t& bytes, const string& directory) {
+  memoryBudget = bytes;
+  scratchDirectory = directory;
+}
+
+void Likelihood::setSelection(const EventSelection& selection) {
+  data.setSelection(selection);
+  acc.setSelection(selection);
+}
+
+void Likelihood::setCacheDirectory(const string& directory) {
+  cacheDirectory = directory;
+}
+
+void Likelihood::setNumThreads(const int& numThreads) {
+  nThreads = numThreads;
+}
+
+void Likelihood::setWalkerParallel(const bool& enable) {
+  walkerParallel = enable;
+}
+
+void Likelihood::setThreadPool(ThreadPool* pool) {
+  threadPool = pool;
+  for (AmplitudeBasis* basis : {&dataBasis, &accBasis}) {
+    basis->setThreadPool(pool);
+  }
+  for (ChunkedBasis* chunks : {&dataChunks, &accChunks}) {
+    chunks->setThreadPool(pool);
+  }
+}
+
+void Likelihood::setUseHugePages(const bool& enable) {
+  dataBasis.setUseHugePages(enable);
+  accBasis.setUseHugePages(enable);
+}
+
+void Likelihood::printMemoryReport() const {
+  cout << "Memory usage" << endl;
+  if (dataChunks.isOpen()) {
+    dataChunks.printMemoryReport(cout, "Data amplitude basis");
+  } else {
+    dataBasis.printMemoryReport(cout, "Data amplitude basis");
+  }
+  if (accChunks.isOpen()) {
+    accChunks.printMemoryReport(cout, "Accepted MC amplitude basis");
+  } else if (!precomputeIntegrals) {
+    accBasis.printMemoryReport(cout, "Accepted MC amplitude basis");
+  }
+  for (const DataReader* reader : {&data, &acc}) {
+    size_t kinematicsBytes = (reader->masses.capacity() + reader->weights.capacity()
+        + reader->thetas.capacity() + reader->phis.capacity()) * sizeof(float);
+    cout << (reader == &data ? "Data" : "Accepted MC") << " kinematics: "
+         << kinematicsBytes / (1024.0 * 1024.0) << " MB ("
+         << (reader->masses.empty() ? 0.0 : static_cast<double>(kinematicsBytes) / reader->masses.size())
+         << " bytes/event)" << endl;
+  }
+}
+
+vector<string> Likelihood::parameterNames(const bool& freeF0980) {
+  vector<string> names;
+  if (freeF0980) {
+    names.push_back("f0(980) Magnitude");
+  }
+  for (const string resonance : {"f0(1370)", "f0(1500)", "f0(1710)", "f2(1270)", "f2(1525)", "f2(1810)", "f2(1950)",
+                                 "a0(980)", "a0(1450)", "a2(1320)", "a2(1700)"}) {
+    names.push_back(resonance + " Magnitude");
+    names.push_back(resonance + " Phase");
+  }
+  return names;
+}
+
+//!
+//! \throws runtime_error unless there are 22 or 23 parameters (see parameterNames)
+//!
+void Likelihood::checkParameterCount(const arma::uword& nParameters) {
+  if (nParameters != 22 && nParameters != 23) {
+    stringstream error;
+    error << "Error: Expected 22 or 23 parameters, got " << nParameters << "!";
+    throw runtime_error(error.str());
+  }
+}
+
+arma::cx_fvec Likelihood::betasFromParams(const arma::Col<float>& params) const {
+  checkParameterCount(params.size());
   cx_fvec betas;
   if (params.size() == 23) {
     betas = {
@@ -108,7 +700,7 @@ float Likelihood::getExtendedLogLikelihood(const arma::Col<float>& params) {
       polar<float>(params[19], params[20]),  // a2(1320)
       polar<float>(params[21], params[22]),  // a2(1700)
     };
-  } else if (params.size() == 22) {
+  } else {
     betas = {
       polar<float>(0.0, 0.0),                // f0(500)
       polar<float>(100.0, 0.0),          // f0(980)
@@ -125,47 +717,112 @@ float Likelihood::getExtendedLogLikelihood(const arma::Col<float>& params) {
       polar<float>(params[20], params[21]),  // a2(1700)
     };
   }
-  arma::fmat bw_f0 = arma::fmat(5, 5, arma::fill::ones);
-  arma::fmat bw_a0 = arma::fmat(2, 2, arma::fill::ones);
-  float log_likelihood = 0.0;
-  for (size_t i = 0; i < data.masses.size(); i++) {
-    log_likelihood += data.weights[i]
-      * log(
-          amplitude.intensity(
-            betas,
-            pow(data.masses[i], 2),
-            data.thetas[i],
-            data.phis[i],
-            bw_f0,
-            bw_f2[i],
-            bw_a0,
-            bw_a2[i],
-            ikc_inv_vec_f0[i],
-            ikc_inv_vec_f2[i],
-            ikc_inv_vec_a0[i],
-            ikc_inv_vec_a2[i]
-            )
-          );
-  }
-  for (size_t i = 0; i < acc.masses.size(); i++) {
-    log_likelihood -= acc.weights[i] * amplitude.intensity(
-        betas,
-        pow(acc.masses[i], 2),
-        acc.thetas[i],
-        acc.phis[i],
-        bw_f0,
-        bw_f2_mc[i],
-        bw_a0,
-        bw_a2_mc[i],
-        ikc_inv_vec_f0_mc[i],
-        ikc_inv_vec_f2_mc[i],
-        ikc_inv_vec_a0_mc[i],
-        ikc_inv_vec_a2_mc[i]
-        ) / nGenerated;
+  return betas;
+}
+
+//!
+//! @brief Number of threads for the event sums of one likelihood call
+//!
+//! Calls made concurrently for several walkers (in walker-parallel mode or from inside an OpenMP parallel region)
+//! sum their events on the calling thread, the event sums do not depend on the number of threads. With a thread
+//! pool the number is unused, the pool sizes the tasks itself.
+//!
+int Likelihood::evaluationThreads() const {
+  if (threadPool != nullptr) {
+    return 0;
+  }
+  if (walkerParallel) {
+    return 1;
+  }
+#ifdef _OPENMP
+  if (omp_in_parallel()) {
+    return 1;
+  }
+#endif
+  return nThreads;
+}
+
+//!
+//! @brief Calculate the extended log likelihood for one set of couplings
+//!
+//! Only reads the bases and integrals built by setup(), so it can be called from several threads at once.
+//!
+//! @param[in] betas Vector containing complex couplings for each resonance
+//! @param[in] threads Number of threads for the event sums (0 uses the OpenMP default)
+//!
+//! \return Extended log likelihood
+//!
+float Likelihood::logLikelihood(const arma::cx_fvec& betas, const int& threads) const {
+  float log_likelihood = dataChunks.isOpen() ? dataChunks.sumLogIntensity(betas, threads)
+                                              : dataBasis.sumLogIntensity(betas, threads);
+  if (precomputeIntegrals) {
+    // sum_i w_i |c_i . betas|^2 / nGenerated = betas^H M betas
+    log_likelihood -= real(arma::cdot(betas, normIntegrals * betas));
+  } else if (accChunks.isOpen()) {
+    log_likelihood -= accChunks.sumIntensity(betas, threads) / nGenerated;
+  } else {
+    log_likelihood -= accBasis.sumIntensity(betas, threads) / nGenerated;
   }
   return log_likelihood;
 }
 
+float Likelihood::getExtendedLogLikelihood(const arma::Col<float>& params) const {
+  return logLikelihood(betasFromParams(params), evaluationThreads());
+}
+
+arma::fvec Likelihood::getExtendedLogLikelihoodBatch(const arma::fmat& params) const {
+  const int threads = evaluationThreads();
+  arma::cx_fmat betas(13, params.n_cols);
+  for (arma::uword w = 0; w < params.n_cols; w++) {
+    betas.col(w) = betasFromParams(params.col(w));
+  }
+  arma::fvec log_likelihoods = dataChunks.isOpen() ? dataChunks.sumLogIntensityBatch(betas, threads)
+                                                   : dataBasis.sumLogIntensityBatch(betas, threads);
+  if (precomputeIntegrals) {
+    log_likelihoods -= arma::real(arma::sum(arma::conj(betas) % (normIntegrals * betas), 0)).t();
+  } else if (accChunks.isOpen()) {
+    log_likelihoods -= accChunks.sumIntensityBatch(betas, threads) / nGenerated;
+  } else {
+    log_likelihoods -= accBasis.sumIntensityBatch(betas, threads) / nGenerated;
+  }
+  return log_likelihoods;
+}
+
+//!
+//! @brief Calculate the extended log likelihood for each column of params, one walker per thread
+//!
+//! Unlike getExtendedLogLikelihoodBatch, every walker makes its own pass over the events (on a single thread, or
+//! as tasks on the thread pool if one is set), which scales better when there are at least as many walkers as
+//! cores and keeps each result bitwise equal to getExtendedLogLikelihood of that column.
+//!
+//! @param[in] params Matrix of parameters, one column per walker
+//!
+//! \return Vector of extended log likelihoods, one per column
+//!
+arma::fvec Likelihood::getExtendedLogLikelihoodWalkers(const arma::fmat& params) const {
+  // Checked here, an exception must not escape the OpenMP loop below
+  checkParameterCount(params.n_rows);
+  arma::fvec log_likelihoods(params.n_cols);
+  if (threadPool != nullptr) {
+    // Walkers and their event sums are tasks on the same pool, which splits the event sums more coarsely the
+    // more walkers are in flight
+    threadPool->parallelFor(params.n_cols, [&](size_t begin, size_t end) {
+      for (size_t w = begin; w < end; w++) {
+        log_likelihoods(w) = logLikelihood(betasFromParams(params.col(w)), 0);
+      }
+    });
+    return log_likelihoods;
+  }
+  const int nWalkers = params.n_cols;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threadCount(nThreads))
+#endif
+  for (int w = 0; w < nWalkers; w++) {
+    log_likelihoods(w) = logLikelihood(betasFromParams(params.col(w)), 1);
+  }
+  return log_likelihoods;
+}
+
 
 void Likelihood::printLoadingBar (
     const int& progress,
@@ -0,0 +1,331 @@
+#include "RunConfig.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+static string trim(const string& text) {
+  const size_t first = text.find_first_not_of(" \t\r");
+  if (first == string::npos) {
+    return "";
+  }
+  const size_t last = text.find_last_not_of(" \t\r");
+  return text.substr(first, last - first + 1);
+}
+
+//!
+//! @brief Parse a number, which may also be pi, tau or inf (with an optional sign)
+//!
+static float parseNumber(const string& word) {
+  const bool negative = !word.empty() && word[0] == '-';
+  const string magnitude = !word.empty() && (word[0] == '-' || word[0] == '+') ? word.substr(1) : word;
+  float value;
+  if (magnitude == "pi") {
+    value = static_cast<float>(M_PI);
+  } else if (magnitude == "tau") {
+    value = static_cast<float>(2.0 * M_PI);
+  } else if (magnitude == "inf") {
+    value = numeric_limits<float>::infinity();
+  } else {
+    char* end = nullptr;
+    value = strtof(word.c_str(), &end);
+    if (word.empty() || *end != '\0') {
+      throw runtime_error("Error: Invalid number '" + word + "'!");
+    }
+    return value;
+  }
+  return negative ? -value : value;
+}
+
+static vector<float> parseNumbers(const string& text, const size_t& minCount, const size_t& maxCount) {
+  istringstream words(text);
+  vector<float> numbers;
+  string word;
+  while (words >> word) {
+    numbers.push_back(parseNumber(word));
+  }
+  if (numbers.size() < minCount || numbers.size() > maxCount) {
+    stringstream error;
+    error << "Error: Expected " << minCount;
+    if (maxCount > minCount) {
+      error << " to " << maxCount;
+    }
+    error << " values, got " << numbers.size() << "!";
+    throw runtime_error(error.str());
+  }
+  return numbers;
+}
+
+static uint64_t parseCount(const string& text) {
+  if (text.empty() || text.find_first_not_of("0123456789") != string::npos) {
+    throw runtime_error("Error: Expected a non-negative integer, got '" + text + "'!");
+  }
+  try {
+    return stoull(text);
+  } catch (const out_of_range&) {
+    throw runtime_error("Error: " + text + " is too large!");
+  }
+}
+
+//!
+//! @brief Read the settings in a run configuration file, on top of the current ones
+//!
+//! @param[in] path Path of the configuration file
+//! \throws runtime_error if the file cannot be read or holds an invalid entry (the message names the line)
+//!
+void RunConfig::read(const string& path) {
+  ifstream file(path);
+  if (!file) {
+    stringstream error;
+    error << "Error: Failed to open run configuration " << path << "!";
+    throw runtime_error(error.str());
+  }
+  bool readParameters = false;
+  bool readStages = false;
+  string line;
+  size_t lineNumber = 0;
+  while (getline(file, line)) {
+    lineNumber++;
+    const string entry = trim(line.substr(0, line.find('#')));
+    if (entry.empty()) {
+      continue;
+    }
+    try {
+      const size_t equals = entry.find('=');
+      if (equals == string::npos) {
+        throw runtime_error("Error: Expected 'key = value'!");
+      }
+      const string left = trim(entry.substr(0, equals));
+      const string value = trim(entry.substr(equals + 1));
+      const size_t space = left.find_first_of(" \t");
+      const string key = left.substr(0, space);
+      const string name = space == string::npos ? "" : trim(left.substr(space));
+      const bool named = key == "parameter" || key == "selection" || key == "move";
+      if (named && name.empty()) {
+        throw runtime_error("Error: '" + key + "' needs a name before the '='!");
+      }
+      if (!named && !name.empty()) {
+        throw runtime_error("Error: Unexpected '" + name + "' after '" + key + "'!");
+      }
+      if (key == "walkers") {
+        walkers = parseCount(value);
+      } else if (key == "seed") {
+        seed = parseCount(value);
+        fixedSeed = true;
+      } else if (key == "output") {
+        if (value.empty()) {
+          throw runtime_error("Error: Empty output path!");
+        }
+        output = value;
+      } else if (key == "checkpoint_every") {
+        checkpointEvery = parseCount(value);
+      } else if (key == "autocorr_every") {
+        autocorrEvery = parseCount(value);
+      } else if (key == "autocorr_window") {
+        autocorrWindow = parseCount(value);
+      } else if (key == "stop_tau_factor") {
+        stopTauFactor = parseNumbers(value, 1, 1)[0];
+      } else if (key == "stop_tau_change") {
+        stopTauChange = parseNumbers(value, 1, 1)[0];
+      } else if (key == "stop_rhat") {
+        stopRHat = parseNumbers(value, 1, 1)[0];
+      } else if (key == "parameter") {
+        if (!readParameters) {
+          parameters.clear();
+          readParameters = true;
+        }
+        const vector<float> bounds = parseNumbers(value, 2, 2);
+        parameters.push_back({name, bounds[0], bounds[1]});
+      } else if (key == "selection" && name == "min_abs_weight") {
+        selection.minAbsWeight = parseNumbers(value, 1, 1)[0];
+      } else if (key == "selection") {
+        const vector<float> range = parseNumbers(value, 2, 2);
+        if (name == "mass") {
+          selection.massMin = range[0];
+          selection.massMax = range[1];
+        } else if (name == "theta") {
+          selection.thetaMin = range[0];
+          selection.thetaMax = range[1];
+        } else if (name == "phi") {
+          selection.phiMin = range[0];
+          selection.phiMax = range[1];
+        } else {
+          throw runtime_error("Error: Unknown selection '" + name + "' (expected mass, min_abs_weight, theta or phi)!");
+        }
+      } else if (key == "stage") {
+        if (!readStages) {
+          clearStages();
+          readStages = true;
+        }
+        addStage(parseCount(value));
+      } else if (key == "move") {
+        if (!readStages) {
+          throw runtime_error("Error: Move before the first stage of the file!");
+        }
+        const vector<float> numbers = parseNumbers(value, 1, 3);
+        addMove(name, numbers[0], vector<float>(numbers.begin() + 1, numbers.end()));
+      } else {
+        throw runtime_error("Error: Unknown key '" + key + "'!");
+      }
+    } catch (const runtime_error& exception) {
+      // Point at the offending line, e.g. "Error: run.cfg:12: Unknown key 'walker'!"
+      string message = exception.what();
+      if (message.rfind("Error: ", 0) == 0) {
+        message = message.substr(7);
+      }
+      stringstream error;
+      error << "Error: " << path << ":" << lineNumber << ": " << message;
+      throw runtime_error(error.str());
+    }
+  }
+}
+
+//!
+//! @brief Append a stage of the given number of steps, to which the following moves are added
+//!
+void RunConfig::addStage(const uint64_t& steps) {
+  Stage stage;
+  stage.steps = steps;
+  stages.push_back(stage);
+}
+
+//!
+//! @brief Create a move and add it to the last stage
+//!
+//! @param[in] type "stretch", "differential_evolution" or "snooker"
+//! @param[in] weight Relative weight of the move within the stage
+//! @param[in] arguments Optional constructor arguments: the scale a of the stretch move, sigma and gamma0 of the
+//! differential evolution move, or gamma of the snooker move
+//! \throws runtime_error if there is no stage yet, or the move or its arguments are invalid
+//!
+void RunConfig::addMove(const string& type, const float& weight, const vector<float>& arguments) {
+  if (stages.empty()) {
+    throw runtime_error("Error: A move needs a stage to belong to!");
+  }
+  if (!(weight > 0.0f)) {
+    stringstream error;
+    error << "Error: Move weights must be positive (got " << weight << ")!";
+    throw runtime_error(error.str());
+  }
+  const size_t maxArguments = type == "differential_evolution" ? 2 : 1;
+  if (arguments.size() > maxArguments) {
+    stringstream error;
+    error << "Error: The " << type << " move takes at most " << maxArguments << " arguments!";
+    throw runtime_error(error.str());
+  }
+  unique_ptr<Move> move;
+  if (type == "stretch") {
+    move = arguments.empty() ? make_unique<StretchMove>() : make_unique<StretchMove>(arguments[0]);
+  } else if (type == "differential_evolution") {
+    move = arguments.empty() ? make_unique<DifferentialEvolutionMove>()
+        : make_unique<DifferentialEvolutionMove>(arguments[0], arguments.size() > 1 ? arguments[1] : 0.0f);
+  } else if (type == "snooker") {
+    move = arguments.empty() ? make_unique<DifferentialEvolutionSnookerMove>()
+        : make_unique<DifferentialEvolutionSnookerMove>(arguments[0]);
+  } else {
+    throw runtime_error("Error: Unknown move '" + type + "' (expected stretch, differential_evolution or snooker)!");
+  }
+  stages.back().moves.emplace_back(move.get(), weight);
+  stages.back().moveNames.push_back(type);
+  moves.push_back(std::move(move));
+}
+
+void RunConfig::clearStages() {
+  stages.clear();
+  moves.clear();
+}
+
+//!
+//! @brief Check that the settings describe a run the sampler can carry out
+//!
+//! \throws runtime_error naming the first problem found
+//!
+void RunConfig::validate() const {
+  if (walkers < 6) {
+    stringstream error;
+    error << "Error: The ensemble needs at least 6 walkers (got " << walkers << ")!";
+    throw runtime_error(error.str());
+  }
+  if (parameters.empty()) {
+    throw runtime_error("Error: No parameters to sample!");
+  }
+  for (const SamplerParameter& parameter : parameters) {
+    if (!(parameter.lower < parameter.upper)) {
+      stringstream error;
+      error << "Error: Empty range [" << parameter.lower << ", " << parameter.upper << "] for " << parameter.name
+            << "!";
+      throw runtime_error(error.str());
+    }
+  }
+  if (checkpointEvery == 0) {
+    throw runtime_error("Error: The checkpoint interval must be at least one step!");
+  }
+  if (autocorrEvery == 0 || autocorrWindow < 4) {
+    throw runtime_error("Error: Convergence needs estimates at least every step, from a window of at least 4 steps!");
+  }
+  if (!(stopTauFactor >= 0.0f)) {
+    throw runtime_error("Error: The stopping factor must not be negative!");
+  }
+  if (stages.empty()) {
+    throw runtime_error("Error: The schedule has no stages!");
+  }
+  for (size_t s = 0; s < stages.size(); s++) {
+    if (stages[s].steps == 0 || stages[s].moves.empty()) {
+      stringstream error;
+      error << "Error: Stage " << s + 1 << " needs at least one step and one move!";
+      throw runtime_error(error.str());
+    }
+  }
+}
+
+//!
+//! @brief Check that the parameters are the ones the likelihood takes, in its order
+//!
+//! The likelihood matches parameters by position, so a missing, extra or reordered parameter would give bounds to
+//! the wrong couplings.
+//!
+//! @param[in] expected Parameter names in the order of the likelihood (e.g. Likelihood::parameterNames)
+//! \throws runtime_error naming the first parameter that differs
+//!
+void RunConfig::checkParameters(const vector<string>& expected) const {
+  for (size_t p = 0; p < std::max(parameters.size(), expected.size()); p++) {
+    const string name = p < parameters.size() ? parameters[p].name : "(none)";
+    const string wanted = p < expected.size() ? expected[p] : "(none)";
+    if (name != wanted) {
+      stringstream error;
+      error << "Error: Parameter " << p + 1 << " of " << parameters.size() << " is '" << name
+            << "', but the likelihood expects '" << wanted << "' there (" << expected.size() << " parameters)!";
+      throw runtime_error(error.str());
+    }
+  }
+}
+
+void RunConfig::print() const {
+  cout << "Run configuration: " << walkers << " walkers, " << parameters.size() << " parameters, "
+       << totalSteps() << " steps, chain written to " << output << " every " << checkpointEvery << " steps"
+       << endl;
+  if (stopTauFactor > 0.0f) {
+    cout << "  Stopping once the last " << autocorrWindow << " steps span " << stopTauFactor
+         << " autocorrelation times, tau changes by less than " << stopTauChange << " and split-R-hat is below "
+         << stopRHat << " (checked every " << autocorrEvery << " steps)" << endl;
+  }
+  for (size_t s = 0; s < stages.size(); s++) {
+    cout << "  Stage " << s + 1 << ": " << stages[s].steps << " steps with";
+    for (size_t m = 0; m < stages[s].moves.size(); m++) {
+      cout << (m == 0 ? " " : ", ") << stages[s].moveNames[m] << " (" << stages[s].moves[m].second << ")";
+    }
+    cout << endl;
+  }
+}
+
+uint64_t RunConfig::totalSteps() const {
+  uint64_t total = 0;
+  for (const Stage& stage : stages) {
+    total += stage.steps;
+  }
+  return total;
+}
@@ -0,0 +1,259 @@
+#include "SetupCache.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char magic[8] = {'K', 'M', 'C', 'A', 'C', 'H', 'E', '\0'};
+constexpr uint32_t hasBasis = 1;
+constexpr uint32_t hasIntegrals = 2;
+constexpr size_t nKinematics = 4;
+constexpr size_t integralSize = 13;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t key;
+  uint64_t nInput;
+  uint64_t nEvents;
+  uint64_t basisColumns;
+  uint64_t basisStride;
+  uint64_t maskOffset;
+  uint64_t kinematicsOffset;
+  uint64_t basisOffset;
+  uint64_t integralsOffset;
+  uint64_t fileBytes;
+};
+
+// 64-bit FNV-1a
+void hashBytes(uint64_t& hash, const void* data, const size_t& n) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < n; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+}
+
+uint64_t alignUp(const uint64_t& offset) {
+  return (offset + SetupCache::sectionAlignment - 1) / SetupCache::sectionAlignment * SetupCache::sectionAlignment;
+}
+
+bool readFully(const int& fd, void* data, const size_t& n, const uint64_t& offset) {
+  char* out = static_cast<char*>(data);
+  size_t done = 0;
+  while (done < n) {
+    const ssize_t count = pread(fd, out + done, n - done, offset + done);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    done += count;
+  }
+  return true;
+}
+
+void writePadding(ofstream& out, const uint64_t& offset) {
+  static const vector<char> zeros(SetupCache::sectionAlignment, 0);
+  const uint64_t position = out.tellp();
+  if (offset > position) {
+    out.write(zeros.data(), offset - position);
+  }
+}
+
+}  // namespace
+
+//!
+//! @brief Hash identifying the cached quantities of one sample
+//!
+//! @param[in] filePaths Input ROOT files
+//! @param[in] treeName Input tree
+//! @param[in] constants Amplitude constants (see Amplitude::constants)
+//! @param[in] settings Any other setting that changes the cached quantities
+//! \return 64-bit key (0 if an input file cannot be found)
+//!
+uint64_t SetupCache::key(const vector<string>& filePaths, const string& treeName, const vector<float>& constants,
+    const vector<double>& settings) {
+  uint64_t hash = 14695981039346656037ull;
+  hashBytes(hash, &version, sizeof(version));
+  for (const string& filePath : filePaths) {
+    struct stat info;
+    char* resolved = realpath(filePath.c_str(), nullptr);
+    if (!resolved || stat(resolved, &info) != 0) {
+      free(resolved);
+      return 0;
+    }
+    hashBytes(hash, resolved, strlen(resolved) + 1);
+    free(resolved);
+    const int64_t fileSize = info.st_size;
+    const int64_t modifiedSeconds = info.st_mtim.tv_sec;
+    const int64_t modifiedNanoseconds = info.st_mtim.tv_nsec;
+    hashBytes(hash, &fileSize, sizeof(fileSize));
+    hashBytes(hash, &modifiedSeconds, sizeof(modifiedSeconds));
+    hashBytes(hash, &modifiedNanoseconds, sizeof(modifiedNanoseconds));
+  }
+  hashBytes(hash, treeName.c_str(), treeName.size() + 1);
+  hashBytes(hash, constants.data(), constants.size() * sizeof(float));
+  hashBytes(hash, settings.data(), settings.size() * sizeof(double));
+  return hash;
+}
+
+//!
+//! @brief Path of the cache file for a sample
+//!
+//! @param[in] directory Cache directory
+//! @param[in] name Label for the sample
+//! @param[in] key Key from SetupCache::key
+//!
+string SetupCache::path(const string& directory, const string& name, const uint64_t& key) {
+  stringstream result;
+  result << directory << "/" << name << "-" << hex << setw(16) << setfill('0') << key << ".kmcache";
+  return result.str();
+}
+
+//!
+//! @brief Load a sample from a cache file
+//!
+//! The kinematics are copied into the reader, and the basis (if requested) is mapped from the file.
+//!
+//! @param[in] path Cache file
+//! @param[in] key Expected key
+//! @param[out] reader Reader whose columns receive the kinematics of the surviving events
+//! @param[out] valid Validity of every input event
+//! @param[out] basis Basis to map, or nullptr if not needed
+//! @param[out] integrals Unnormalized integral matrix, or nullptr if not needed
+//! \return false if there is no usable cache file (missing, stale or lacking a requested section)
+//!
+bool SetupCache::load(const string& path, const uint64_t& key, DataReader& reader, vector<unsigned char>& valid,
+    AmplitudeBasis* basis, arma::cx_mat* integrals) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  Header header;
+  bool usable = fstat(fd, &info) == 0
+    && readFully(fd, &header, sizeof(header), 0)
+    && memcmp(header.magic, magic, sizeof(magic)) == 0
+    && header.version == version
+    && header.key == key
+    && header.fileBytes == static_cast<uint64_t>(info.st_size)
+    && (!basis || ((header.flags & hasBasis) && header.basisColumns == basis->getStore().numColumns()))
+    && (!integrals || (header.flags & hasIntegrals));
+  if (usable) {
+    valid.resize(header.nInput);
+    reader.masses.resize(header.nEvents);
+    reader.weights.resize(header.nEvents);
+    reader.thetas.resize(header.nEvents);
+    reader.phis.resize(header.nEvents);
+    vector<float>* columns[nKinematics] = {&reader.masses, &reader.weights, &reader.thetas, &reader.phis};
+    usable = readFully(fd, valid.data(), valid.size(), header.maskOffset);
+    for (size_t k = 0; k < nKinematics && usable; k++) {
+      usable = readFully(fd, columns[k]->data(), header.nEvents * sizeof(float),
+          header.kinematicsOffset + k * header.nEvents * sizeof(float));
+    }
+    if (usable && integrals) {
+      integrals->set_size(integralSize, integralSize);
+      usable = readFully(fd, integrals->memptr(), integrals->n_elem * sizeof(complex<double>), header.integralsOffset);
+    }
+    if (usable && basis) {
+      try {
+        basis->mapFile(fd, header.basisOffset, header.nEvents, header.basisStride);
+      } catch (const runtime_error& exception) {
+        // A corrupt layout or a failed mapping makes the file unusable, and the descriptor must still be closed
+        cout << exception.what() << endl;
+        usable = false;
+      }
+    }
+  }
+  close(fd);
+  if (!usable) {
+    cout << "Ignoring unusable cache file " << path << endl;
+    return false;
+  }
+  reader.nEvents = header.nEvents;
+  return true;
+}
+
+//!
+//! @brief Write a sample to a cache file
+//!
+//! The file is written under a temporary name and renamed, so concurrent jobs never see a partial file.
+//! Failures are reported but not fatal, since the cache is only an optimization.
+//!
+//! @param[in] path Cache file
+//! @param[in] key Key from SetupCache::key
+//! @param[in] reader Reader holding the kinematics of the surviving events
+//! @param[in] valid Validity of every input event
+//! @param[in] basis Basis of the surviving events, or nullptr
+//! @param[in] integrals Unnormalized integral matrix, or nullptr
+//!
+void SetupCache::save(const string& path, const uint64_t& key, const DataReader& reader,
+    const vector<unsigned char>& valid, const AmplitudeBasis* basis, const arma::cx_mat* integrals) {
+  Header header{};
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.key = key;
+  header.nInput = valid.size();
+  header.nEvents = reader.masses.size();
+  header.maskOffset = alignUp(sizeof(Header));
+  header.kinematicsOffset = alignUp(header.maskOffset + header.nInput);
+  uint64_t end = header.kinematicsOffset + nKinematics * header.nEvents * sizeof(float);
+  if (basis) {
+    header.flags |= hasBasis;
+    header.basisColumns = basis->getStore().numColumns();
+    header.basisStride = basis->getStore().stride();
+    header.basisOffset = alignUp(end);
+    end = header.basisOffset + header.basisColumns * header.basisStride * sizeof(float);
+  }
+  if (integrals) {
+    header.flags |= hasIntegrals;
+    header.integralsOffset = alignUp(end);
+    end = header.integralsOffset + integralSize * integralSize * sizeof(complex<double>);
+  }
+  header.fileBytes = end;
+
+  const string temporary = path + ".tmp" + to_string(getpid());
+  {
+    ofstream out(temporary, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writePadding(out, header.maskOffset);
+    out.write(reinterpret_cast<const char*>(valid.data()), valid.size());
+    writePadding(out, header.kinematicsOffset);
+    for (const vector<float>* column : {&reader.masses, &reader.weights, &reader.thetas, &reader.phis}) {
+      out.write(reinterpret_cast<const char*>(column->data()), header.nEvents * sizeof(float));
+    }
+    if (basis) {
+      writePadding(out, header.basisOffset);
+      out.write(reinterpret_cast<const char*>(basis->getStore().column(0)),
+          header.basisColumns * header.basisStride * sizeof(float));
+    }
+    if (integrals) {
+      writePadding(out, header.integralsOffset);
+      out.write(reinterpret_cast<const char*>(integrals->memptr()), integrals->n_elem * sizeof(complex<double>));
+    }
+    if (!out) {
+      cout << "Warning: Failed to write cache file " << path << endl;
+      remove(temporary.c_str());
+      return;
+    }
+  }
+  if (rename(temporary.c_str(), path.c_str()) != 0) {
+    cout << "Warning: Failed to write cache file " << path << endl;
+    remove(temporary.c_str());
+    return;
+  }
+  cout << "Wrote cache file " << path << endl;
+}
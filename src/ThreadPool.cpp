@@ -0,0 +1,163 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+// Pool and deque of the pool thread running on this thread, if any
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local size_t currentDeque = 0;
+
+//!
+//! @brief Start the worker threads
+//!
+//! @param[in] nThreads Number of threads taking part in the loops, including the calling thread (0 uses one per
+//! hardware thread)
+//!
+ThreadPool::ThreadPool(const size_t& nThreads) {
+  const size_t total = nThreads > 0 ? nThreads : std::max<size_t>(1, thread::hardware_concurrency());
+  for (size_t i = 0; i < total; i++) {
+    deques.push_back(make_unique<TaskDeque>());
+  }
+  for (size_t i = 0; i + 1 < total; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(sleepGuard);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (thread& worker : workers) {
+    worker.join();
+  }
+}
+
+//!
+//! @brief Number of indices per task for a loop over n indices
+//!
+//! A loop running alone is split into tasksPerThread tasks per thread. With nActive loops in flight the threads
+//! are shared between them, so each loop is split into proportionally fewer tasks, which keeps the number of
+//! queued tasks (and the scheduling overhead per index) about constant.
+//!
+//! @param[in] n Number of indices in the loop
+//! @param[in] nThreads Number of threads in the pool
+//! @param[in] nActive Number of loops in flight, including this one
+//! \return Number of indices per task (at least 1)
+//!
+size_t ThreadPool::grainSize(const size_t& n, const size_t& nThreads, const size_t& nActive) {
+  const size_t nTasks = std::max<size_t>(1, tasksPerThread * nThreads / std::max<size_t>(1, nActive));
+  return std::max<size_t>(1, (n + nTasks - 1) / nTasks);
+}
+
+//!
+//! @brief Call body(begin, end) on disjoint ranges covering [0, n), spread over the pool
+//!
+//! Returns once every range is done. The calling thread runs tasks (its own or stolen) while it waits. If body
+//! throws, the remaining ranges still run and the first exception is rethrown here.
+//!
+//! @param[in] n Number of indices
+//! @param[in] body Function called on each range, must be safe to call concurrently
+//!
+void ThreadPool::parallelFor(const size_t& n, const function<void(size_t, size_t)>& body) {
+  if (n == 0) {
+    return;
+  }
+  const size_t grain = grainSize(n, size(), ++nActive);
+  if (grain >= n) {
+    try {
+      body(0, n);
+    } catch (...) {
+      nActive--;
+      throw;
+    }
+    nActive--;
+    return;
+  }
+  const size_t nTasks = (n + grain - 1) / grain;
+  Loop loop;
+  loop.body = &body;
+  loop.remaining = nTasks;
+  const size_t self = ownDeque();
+  {
+    lock_guard<mutex> lock(sleepGuard);
+    pending += nTasks;
+  }
+  {
+    lock_guard<mutex> lock(deques[self]->guard);
+    for (size_t begin = 0; begin < n; begin += grain) {
+      deques[self]->tasks.push_back({&loop, begin, std::min(n, begin + grain)});
+    }
+  }
+  wake.notify_all();
+  while (loop.remaining.load() > 0) {
+    if (!runOne(self)) {
+      this_thread::yield();
+    }
+  }
+  nActive--;
+  if (loop.error) {
+    rethrow_exception(loop.error);
+  }
+}
+
+size_t ThreadPool::ownDeque() const {
+  return currentPool == this ? currentDeque : workers.size();
+}
+
+//!
+//! @brief Run the newest task of deque self, or else steal the oldest task of another deque
+//!
+//! \return false if every deque was empty
+//!
+bool ThreadPool::runOne(const size_t& self) {
+  Task task{nullptr, 0, 0};
+  {
+    lock_guard<mutex> lock(deques[self]->guard);
+    if (!deques[self]->tasks.empty()) {
+      task = deques[self]->tasks.back();
+      deques[self]->tasks.pop_back();
+    }
+  }
+  for (size_t i = 1; task.loop == nullptr && i < deques.size(); i++) {
+    TaskDeque& victim = *deques[(self + i) % deques.size()];
+    lock_guard<mutex> lock(victim.guard);
+    if (!victim.tasks.empty()) {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+    }
+  }
+  if (task.loop == nullptr) {
+    return false;
+  }
+  pending--;
+  run(task);
+  return true;
+}
+
+void ThreadPool::run(const Task& task) {
+  try {
+    (*task.loop->body)(task.begin, task.end);
+  } catch (...) {
+    lock_guard<mutex> lock(task.loop->errorGuard);
+    if (!task.loop->error) {
+      task.loop->error = current_exception();
+    }
+  }
+  // The caller may destroy the loop as soon as this reaches zero
+  task.loop->remaining--;
+}
+
+void ThreadPool::workerLoop(const size_t& self) {
+  currentPool = this;
+  currentDeque = self;
+  while (true) {
+    if (runOne(self)) {
+      continue;
+    }
+    unique_lock<mutex> lock(sleepGuard);
+    wake.wait(lock, [this] { return stopping || pending.load() > 0; });
+    if (stopping) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef EVENTFILES_H
+#define EVENTFILES_H
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include "TFile.h"
+#include "TTree.h"
+
+using namespace std;
+
+//!
+//! @brief Write a ROOT file with a tree of random events in the layout DataReader reads, for tests that need input
+//! files
+//!
+//! Each event has a beam along z and a recoil proton and two kaons with random momenta (like test_kinematics.cpp),
+//! so the K K masses cover roughly 1 to 3 GeV.
+//!
+//! @param[in] path Output file
+//! @param[in] nEvents Number of events
+//! @param[in] seed Seed of the momenta and weights
+//! @param[in] treeName Name of the tree
+//! @param[in] clusterEntries Entries per cluster (0 keeps the ROOT default, which puts a small file in one cluster)
+//!
+inline void writeEventFile(const string& path, const int& nEvents, const uint64_t& seed,
+    const string& treeName = "kin", const Long64_t& clusterEntries = 0) {
+  unique_ptr<TFile> file(TFile::Open(path.c_str(), "RECREATE"));
+  // Owned by the file, which deletes it on Close
+  TTree* tree = new TTree(treeName.c_str(), treeName.c_str());
+  float weight, e_beam, px_beam, py_beam, pz_beam;
+  float e_fs[3], px_fs[3], py_fs[3], pz_fs[3];
+  tree->Branch("Weight", &weight, "Weight/F");
+  tree->Branch("E_Beam", &e_beam, "E_Beam/F");
+  tree->Branch("Px_Beam", &px_beam, "Px_Beam/F");
+  tree->Branch("Py_Beam", &py_beam, "Py_Beam/F");
+  tree->Branch("Pz_Beam", &pz_beam, "Pz_Beam/F");
+  tree->Branch("E_FinalState", e_fs, "E_FinalState[3]/F");
+  tree->Branch("Px_FinalState", px_fs, "Px_FinalState[3]/F");
+  tree->Branch("Py_FinalState", py_fs, "Py_FinalState[3]/F");
+  tree->Branch("Pz_FinalState", pz_fs, "Pz_FinalState[3]/F");
+  if (clusterEntries > 0) {
+    tree->SetAutoFlush(clusterEntries);
+  }
+
+  mt19937_64 rng(seed);
+  uniform_real_distribution<float> momentum(-1.5f, 1.5f);
+  uniform_real_distribution<float> beamEnergy(8.0f, 9.0f);
+  uniform_real_distribution<float> weights(0.5f, 1.5f);
+  const float finalStateMasses[3] = {0.93827f, 0.49761f, 0.49761f};
+  for (int i = 0; i < nEvents; i++) {
+    weight = weights(rng);
+    px_beam = 0.0f;
+    py_beam = 0.0f;
+    pz_beam = beamEnergy(rng);
+    e_beam = pz_beam;
+    for (int p = 0; p < 3; p++) {
+      px_fs[p] = momentum(rng);
+      py_fs[p] = momentum(rng);
+      pz_fs[p] = momentum(rng) + 2.0f;
+      e_fs[p] = std::sqrt(px_fs[p] * px_fs[p] + py_fs[p] * py_fs[p] + pz_fs[p] * pz_fs[p]
+                          + finalStateMasses[p] * finalStateMasses[p]);
+    }
+    tree->Fill();
+  }
+  file->Write();
+  file->Close();
+}
+
+#endif  // EVENTFILES_H
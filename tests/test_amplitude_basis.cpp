@@ -0,0 +1,114 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include "AmplitudeBasis.hpp"
+
+TEST_CASE("AmplitudeBasis block sums match per-event intensities", "[AmplitudeBasis]") {
+  arma::arma_rng::set_seed(1);
+  arma::uword nEvents = 1000;
+  AmplitudeBasis basis;
+  basis.resize(nEvents);
+  for (arma::uword i = 0; i < nEvents; i++) {
+    basis.set(i, arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients), static_cast<float>(arma::randu()) + 0.5f);
+  }
+  arma::cx_fvec betas = arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients);
+
+  double expected_log = 0.0;
+  double expected = 0.0;
+  for (arma::uword i = 0; i < nEvents; i++) {
+    expected_log += basis.weight(i) * log(basis.intensity(i, betas));
+    expected += basis.weight(i) * basis.intensity(i, betas);
+  }
+  CAPTURE(expected_log);
+  CAPTURE(expected);
+
+  REQUIRE(basis.sumLogIntensity(betas) == Catch::Approx(expected_log).epsilon(1e-4));
+  REQUIRE(basis.sumIntensity(betas) == Catch::Approx(expected).epsilon(1e-4));
+}
+
+TEST_CASE("AmplitudeBasis sums do not depend on the thread count", "[AmplitudeBasis]") {
+  arma::arma_rng::set_seed(2);
+  arma::uword nEvents = 12345;
+  AmplitudeBasis basis;
+  basis.resize(nEvents);
+  for (arma::uword i = 0; i < nEvents; i++) {
+    basis.set(i, arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients), static_cast<float>(arma::randu()));
+  }
+  arma::cx_fvec betas = arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients);
+
+  float reference_log = basis.sumLogIntensity(betas, 1);
+  float reference = basis.sumIntensity(betas, 1);
+  for (int nThreads : {2, 3, 7, 16}) {
+    CAPTURE(nThreads);
+    REQUIRE(basis.sumLogIntensity(betas, nThreads) == reference_log);
+    REQUIRE(basis.sumIntensity(betas, nThreads) == reference);
+  }
+}
+
+TEST_CASE("AmplitudeBasis sums on a thread pool match the OpenMP sums", "[AmplitudeBasis]") {
+  arma::arma_rng::set_seed(22);
+  arma::uword nEvents = 54321;
+  AmplitudeBasis basis;
+  basis.resize(nEvents);
+  for (arma::uword i = 0; i < nEvents; i++) {
+    basis.set(i, arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients), static_cast<float>(arma::randu()));
+  }
+  arma::cx_fmat betas = arma::randn<arma::cx_fmat>(AmplitudeBasis::nCoefficients, 3);
+
+  float reference_log = basis.sumLogIntensity(betas.col(0), 1);
+  float reference = basis.sumIntensity(betas.col(0), 1);
+  arma::fvec reference_log_batch = basis.sumLogIntensityBatch(betas, 1);
+  arma::fvec reference_batch = basis.sumIntensityBatch(betas, 1);
+  for (size_t nThreads : {1, 2, 5}) {
+    CAPTURE(nThreads);
+    ThreadPool pool(nThreads);
+    basis.setThreadPool(&pool);
+    REQUIRE(basis.sumLogIntensity(betas.col(0)) == reference_log);
+    REQUIRE(basis.sumIntensity(betas.col(0)) == reference);
+    REQUIRE(arma::all(basis.sumLogIntensityBatch(betas) == reference_log_batch));
+    REQUIRE(arma::all(basis.sumIntensityBatch(betas) == reference_batch));
+    basis.setThreadPool(nullptr);
+  }
+}
+
+TEST_CASE("AmplitudeBasis batch sums match single evaluations", "[AmplitudeBasis]") {
+  arma::arma_rng::set_seed(3);
+  arma::uword nEvents = 3000;
+  AmplitudeBasis basis;
+  basis.resize(nEvents);
+  for (arma::uword i = 0; i < nEvents; i++) {
+    basis.set(i, arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients), static_cast<float>(arma::randu()));
+  }
+  arma::cx_fmat betas = arma::randn<arma::cx_fmat>(AmplitudeBasis::nCoefficients, 5);
+
+  arma::fvec result_log = basis.sumLogIntensityBatch(betas);
+  arma::fvec result = basis.sumIntensityBatch(betas);
+  for (arma::uword w = 0; w < betas.n_cols; w++) {
+    CAPTURE(w);
+    REQUIRE(result_log(w) == Catch::Approx(basis.sumLogIntensity(betas.col(w))).epsilon(1e-4));
+    REQUIRE(result(w) == Catch::Approx(basis.sumIntensity(betas.col(w))).epsilon(1e-4));
+  }
+}
+
+TEST_CASE("AmplitudeBasis append matches a basis filled in one piece", "[AmplitudeBasis]") {
+  arma::arma_rng::set_seed(5);
+  const arma::uword nEvents = 2000;
+  AmplitudeBasis whole;
+  whole.resize(nEvents);
+  AmplitudeBasis appended;
+  for (arma::uword begin = 0; begin < nEvents; begin += 300) {
+    const arma::uword end = std::min(nEvents, begin + 300);
+    AmplitudeBasis piece;
+    piece.resize(end - begin);
+    for (arma::uword i = begin; i < end; i++) {
+      arma::cx_fvec coefficients = arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients);
+      const float weight = static_cast<float>(arma::randu());
+      whole.set(i, coefficients, weight);
+      piece.set(i - begin, coefficients, weight);
+    }
+    appended.append(piece);
+  }
+  REQUIRE(appended.size() == nEvents);
+  arma::cx_fvec betas = arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients);
+  REQUIRE(appended.sumLogIntensity(betas) == whole.sumLogIntensity(betas));
+  REQUIRE(appended.sumIntensity(betas) == whole.sumIntensity(betas));
+}
@@ -0,0 +1,69 @@
+#include <catch2/catch_all.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "BoundedQueue.hpp"
+
+TEST_CASE("BoundedQueue delivers every item once and never exceeds its capacity", "[BoundedQueue]") {
+  const size_t capacity = 4;
+  const int nProducers = 3;
+  const int nConsumers = 2;
+  const int nItems = 10000;
+  BoundedQueue<int> queue(capacity);
+  atomic<int> inFlight(0);
+  atomic<int> maxInFlight(0);
+  atomic<bool> pushFailed(false);
+  vector<atomic<int>> seen(nProducers * nItems);
+  for (atomic<int>& count : seen) {
+    count = 0;
+  }
+
+  vector<thread> producers;
+  for (int p = 0; p < nProducers; p++) {
+    producers.emplace_back([&, p] {
+      for (int i = 0; i < nItems; i++) {
+        const int current = ++inFlight;
+        int observed = maxInFlight.load();
+        while (current > observed && !maxInFlight.compare_exchange_weak(observed, current)) {}
+        if (!queue.push(p * nItems + i)) {
+          pushFailed = true;
+        }
+      }
+    });
+  }
+  vector<thread> consumers;
+  for (int c = 0; c < nConsumers; c++) {
+    consumers.emplace_back([&] {
+      int item;
+      while (queue.pop(item)) {
+        seen[item]++;
+        inFlight--;
+      }
+    });
+  }
+  for (thread& producer : producers) {
+    producer.join();
+  }
+  queue.close();
+  for (thread& consumer : consumers) {
+    consumer.join();
+  }
+  // Assertions are only made on this thread
+  REQUIRE_FALSE(pushFailed);
+  for (const atomic<int>& count : seen) {
+    REQUIRE(count == 1);
+  }
+  // Each producer may have counted one item it is still waiting to push
+  REQUIRE(maxInFlight <= static_cast<int>(capacity) + nProducers + nConsumers);
+}
+
+TEST_CASE("BoundedQueue rejects pushes after close but drains pops", "[BoundedQueue]") {
+  BoundedQueue<int> queue(2);
+  REQUIRE(queue.push(1));
+  queue.close();
+  REQUIRE_FALSE(queue.push(2));
+  int item = 0;
+  REQUIRE(queue.pop(item));
+  REQUIRE(item == 1);
+  REQUIRE_FALSE(queue.pop(item));
+}
@@ -0,0 +1,204 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include <H5Cpp.h>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "ChainCheckpoint.hpp"
+
+static SamplerState stepState(const uint64_t& step, const arma::uword& nWalkers) {
+  SamplerState state;
+  state.positions.set_size(2, nWalkers);
+  for (arma::uword i = 0; i < state.positions.n_elem; i++) {
+    state.positions(i) = 100.0f * step + i;
+  }
+  state.logProbs = -arma::linspace<arma::fvec>(0.0f, 1.0f, nWalkers) - static_cast<float>(step);
+  state.rng = "generator " + std::to_string(step);
+  state.steps = step + 1;
+  return state;
+}
+
+TEST_CASE("ChainCheckpoint writes blocks and resumes from the last step", "[ChainCheckpoint]") {
+  const string path = "/tmp/kmatrix-test-checkpoint.h5";
+  const vector<SamplerParameter> parameters = {{"magnitude", 0.0f, 10.0f}, {"phase", 0.0f, 6.3f}};
+  const arma::uword nWalkers = 6;
+  {
+    ChainCheckpoint checkpoint(path, parameters, nWalkers, 10);
+    for (uint64_t step = 0; step < 25; step++) {
+      checkpoint.record(stepState(step, nWalkers));
+    }
+    checkpoint.close();
+    REQUIRE(checkpoint.numSteps() == 25);
+  }
+  SamplerState state;
+  REQUIRE(ChainCheckpoint::load(path, state));
+  const SamplerState expected = stepState(24, nWalkers);
+  REQUIRE(state.steps == 25);
+  REQUIRE(state.rng == expected.rng);
+  REQUIRE(arma::approx_equal(state.positions, expected.positions, "absdiff", 0.0f));
+  REQUIRE(arma::approx_equal(state.logProbs, expected.logProbs, "absdiff", 0.0f));
+
+  {
+    ChainCheckpoint checkpoint(path, parameters, nWalkers, 10, true);
+    REQUIRE(checkpoint.numSteps() == 25);
+    for (uint64_t step = 25; step < 30; step++) {
+      checkpoint.record(stepState(step, nWalkers));
+    }
+  }
+  REQUIRE(ChainCheckpoint::load(path, state));
+  REQUIRE(state.steps == 30);
+
+  {
+    H5::H5File file(path, H5F_ACC_RDONLY);
+    H5::DataSet chain = file.openDataSet("chain");
+    hsize_t dims[3];
+    chain.getSpace().getSimpleExtentDims(dims);
+    REQUIRE(dims[0] == 30);
+    REQUIRE(dims[1] == nWalkers);
+    REQUIRE(dims[2] == 2);
+    arma::fcube values(2, nWalkers, 30);
+    chain.read(values.memptr(), H5::PredType::NATIVE_FLOAT);
+    for (uint64_t step : {0, 13, 29}) {
+      CAPTURE(step);
+      REQUIRE(arma::approx_equal(values.slice(step), stepState(step, nWalkers).positions, "absdiff", 0.0f));
+    }
+  }
+
+  REQUIRE_THROWS_AS(ChainCheckpoint(path, parameters, nWalkers + 2, 10, true), std::runtime_error);
+  std::remove(path.c_str());
+  REQUIRE_FALSE(ChainCheckpoint::load(path, state));
+  std::remove((path + ".state").c_str());
+}
+
+static void copyFile(const string& from, const string& to) {
+  ifstream in(from, ios::binary);
+  ofstream out(to, ios::binary | ios::trunc);
+  out << in.rdbuf();
+}
+
+TEST_CASE("ChainCheckpoint resumes from the state of the last complete block", "[ChainCheckpoint]") {
+  const string path = "/tmp/kmatrix-test-checkpoint-crash.h5";
+  const string statePath = path + ".state";
+  const string savedPath = path + ".saved";
+  const vector<SamplerParameter> parameters = {{"magnitude", 0.0f, 10.0f}, {"phase", 0.0f, 6.3f}};
+  const arma::uword nWalkers = 4;
+  {
+    ChainCheckpoint checkpoint(path, parameters, nWalkers, 10);
+    for (uint64_t step = 0; step < 20; step++) {
+      checkpoint.record(stepState(step, nWalkers));
+    }
+  }
+  copyFile(statePath, savedPath);
+  {
+    ChainCheckpoint checkpoint(path, parameters, nWalkers, 10, true);
+    for (uint64_t step = 20; step < 30; step++) {
+      checkpoint.record(stepState(step, nWalkers));
+    }
+  }
+  // A crash after the third block reached the chain, but before its state replaced the state of the second
+  copyFile(savedPath, statePath);
+  std::remove(savedPath.c_str());
+  SamplerState state;
+  REQUIRE(ChainCheckpoint::load(path, state));
+  REQUIRE(state.steps == 20);
+  REQUIRE(state.rng == stepState(19, nWalkers).rng);
+  REQUIRE(arma::approx_equal(state.positions, stepState(19, nWalkers).positions, "absdiff", 0.0f));
+
+  // The orphaned samples of the third block are replaced by the resumed run
+  {
+    ChainCheckpoint checkpoint(path, parameters, nWalkers, 10, true);
+    REQUIRE(checkpoint.numSteps() == 20);
+    for (uint64_t step = 20; step < 25; step++) {
+      SamplerState resumed = stepState(step, nWalkers);
+      resumed.positions += 0.5f;
+      checkpoint.record(resumed);
+    }
+  }
+  {
+    H5::H5File file(path, H5F_ACC_RDONLY);
+    H5::DataSet chain = file.openDataSet("chain");
+    hsize_t dims[3];
+    chain.getSpace().getSimpleExtentDims(dims);
+    REQUIRE(dims[0] == 25);
+    arma::fcube values(2, nWalkers, 25);
+    chain.read(values.memptr(), H5::PredType::NATIVE_FLOAT);
+    REQUIRE(arma::approx_equal(values.slice(19), stepState(19, nWalkers).positions, "absdiff", 0.0f));
+    REQUIRE(arma::approx_equal(values.slice(20), stepState(20, nWalkers).positions + 0.5f, "absdiff", 0.0f));
+  }
+  REQUIRE(ChainCheckpoint::load(path, state));
+  REQUIRE(state.steps == 25);
+
+  // A new run does not inherit the state of the old one
+  ChainCheckpoint(path, parameters, nWalkers, 10).close();
+  REQUIRE_FALSE(ChainCheckpoint::load(path, state));
+  std::remove(path.c_str());
+  std::remove(statePath.c_str());
+}
+
+TEST_CASE("ChainCheckpoint reports a failed write instead of blocking", "[ChainCheckpoint]") {
+  const string path = "/tmp/kmatrix-test-checkpoint-full.h5";
+  vector<SamplerParameter> parameters;
+  for (int p = 0; p < 8; p++) {
+    parameters.push_back({"p" + std::to_string(p), 0.0f, 1.0f});
+  }
+  const arma::uword nWalkers = 64;
+  mt19937_64 rng(7);
+  uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  // Random positions do not compress, so every block needs new space in the file
+  auto randomState = [&](const uint64_t& step) {
+    SamplerState state;
+    state.positions.set_size(parameters.size(), nWalkers);
+    for (arma::uword i = 0; i < state.positions.n_elem; i++) {
+      state.positions(i) = uniform(rng);
+    }
+    state.logProbs.set_size(nWalkers);
+    for (arma::uword i = 0; i < nWalkers; i++) {
+      state.logProbs(i) = uniform(rng);
+    }
+    state.steps = step + 1;
+    return state;
+  };
+  ChainCheckpoint checkpoint(path, parameters, nWalkers, 5);
+  // Emulate a full disk or quota: writes beyond a little more than the new file fail with EFBIG (SIGXFSZ is
+  // ignored meanwhile)
+  struct stat info;
+  REQUIRE(stat(path.c_str(), &info) == 0);
+  struct rlimit original;
+  REQUIRE(getrlimit(RLIMIT_FSIZE, &original) == 0);
+  struct rlimit limited = original;
+  limited.rlim_cur = info.st_size + 4096;
+  auto previousHandler = signal(SIGXFSZ, SIG_IGN);
+  REQUIRE(setrlimit(RLIMIT_FSIZE, &limited) == 0);
+  // Without the error reaching the sampler, record() would block forever once two blocks are queued
+  bool recordThrew = false;
+  try {
+    for (uint64_t step = 0; step < 1000; step++) {
+      checkpoint.record(randomState(step));
+    }
+  } catch (const std::runtime_error&) {
+    recordThrew = true;
+  }
+  bool recordThrewAgain = false;
+  try {
+    checkpoint.record(randomState(1000));
+  } catch (const std::runtime_error&) {
+    recordThrewAgain = true;
+  }
+  setrlimit(RLIMIT_FSIZE, &original);
+  signal(SIGXFSZ, previousHandler);
+  // Closing flushes the file, but still reports the failed block
+  bool closeThrew = false;
+  try {
+    checkpoint.close();
+  } catch (const std::runtime_error&) {
+    closeThrew = true;
+  }
+  std::remove(path.c_str());
+  std::remove((path + ".state").c_str());
+  REQUIRE(recordThrew);
+  REQUIRE(recordThrewAgain);
+  REQUIRE(closeThrew);
+}
@@ -0,0 +1,45 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include "AmplitudeBasis.hpp"
+#include "ChunkedBasis.hpp"
+
+TEST_CASE("ChunkedBasis sums match an in-memory basis", "[ChunkedBasis]") {
+  arma::arma_rng::set_seed(4);
+  const arma::uword nEvents = 10000;
+  const arma::uword chunkEvents = 3000;
+  AmplitudeBasis basis;
+  basis.resize(nEvents);
+  ChunkedBasis chunked;
+  chunked.open("/tmp");
+  AmplitudeBasis chunk;
+  for (arma::uword begin = 0; begin < nEvents; begin += chunkEvents) {
+    const arma::uword end = std::min(nEvents, begin + chunkEvents);
+    chunk.resize(end - begin);
+    for (arma::uword i = begin; i < end; i++) {
+      arma::cx_fvec coefficients = arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients);
+      const float weight = static_cast<float>(arma::randu()) + 0.5f;
+      basis.set(i, coefficients, weight);
+      chunk.set(i - begin, coefficients, weight);
+    }
+    chunked.append(chunk);
+  }
+  REQUIRE(chunked.size() == nEvents);
+  REQUIRE(chunked.numChunks() == 4);
+
+  arma::cx_fmat betas = arma::randn<arma::cx_fmat>(AmplitudeBasis::nCoefficients, 3);
+  REQUIRE(chunked.sumLogIntensity(betas.col(0)) == Catch::Approx(basis.sumLogIntensity(betas.col(0))).epsilon(1e-5));
+  REQUIRE(chunked.sumIntensity(betas.col(0)) == Catch::Approx(basis.sumIntensity(betas.col(0))).epsilon(1e-5));
+  arma::fvec result_log = chunked.sumLogIntensityBatch(betas);
+  arma::fvec result = chunked.sumIntensityBatch(betas);
+  for (arma::uword w = 0; w < betas.n_cols; w++) {
+    CAPTURE(w);
+    REQUIRE(result_log(w) == Catch::Approx(basis.sumLogIntensity(betas.col(w))).epsilon(1e-5));
+    REQUIRE(result(w) == Catch::Approx(basis.sumIntensity(betas.col(w))).epsilon(1e-5));
+  }
+
+  // Sums are deterministic across thread counts
+  const float reference = chunked.sumLogIntensity(betas.col(1), 1);
+  for (int nThreads : {2, 5}) {
+    REQUIRE(chunked.sumLogIntensity(betas.col(1), nThreads) == reference);
+  }
+}
@@ -0,0 +1,66 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include "Amplitude.hpp"
+#include "CoefficientTable.hpp"
+
+TEST_CASE("CoefficientTable interpolates the amplitude coefficients", "[CoefficientTable]") {
+  Amplitude amplitude;
+  const float tolerance = 1e-4f;
+  CoefficientTable table(amplitude, 1.0f, 4.0f, tolerance);
+  CAPTURE(table.size(), table.maxError());
+  REQUIRE(table.size() > 64);
+  REQUIRE(table.maxError() <= tolerance);
+
+  arma::arma_rng::set_seed(7);
+  float worst = 0.0f;
+  for (int i = 0; i < 1000; i++) {
+    const float s = 1.0f + 3.0f * static_cast<float>(arma::randu());
+    const float theta = static_cast<float>(arma::randu()) * arma::datum::pi;
+    const float phi = static_cast<float>(arma::randu()) * 2.0 * arma::datum::pi;
+    arma::cx_fvec exact, interpolated;
+    if (!amplitude.coefficients(exact, s, theta, phi)) {
+      continue;
+    }
+    REQUIRE(table.coefficients(interpolated, s, theta, phi));
+    worst = std::max(worst, arma::max(arma::abs(exact - interpolated)) / arma::max(arma::abs(exact)));
+  }
+  CAPTURE(worst);
+  REQUIRE(worst <= tolerance);
+}
+
+TEST_CASE("CoefficientTable evaluates events outside of its range exactly", "[CoefficientTable]") {
+  Amplitude amplitude;
+  CoefficientTable table(amplitude, 1.0f, 2.0f, 1e-3f);
+  for (float s : {0.5f, 3.0f}) {
+    arma::cx_fvec exact, result;
+    REQUIRE(amplitude.coefficients(exact, s, 0.3, 1.2));
+    REQUIRE(table.coefficients(result, s, 0.3, 1.2));
+    REQUIRE(arma::approx_equal(result, exact, "absdiff", 0.0));
+  }
+}
+
+TEST_CASE("CoefficientTable builds over narrow ranges around thresholds and poles", "[CoefficientTable]") {
+  // A mass slice: the intervals next to a singular point are halved down to one float apart
+  Amplitude amplitude;
+  for (const float& point : amplitude.singularPoints()) {
+    if (point < 0.5f || point > 4.0f) {
+      continue;
+    }
+    CAPTURE(point);
+    CoefficientTable table(amplitude, point - 0.01f, point + 0.01f, 1e-4f);
+    REQUIRE(table.size() < (1 << 16));
+    for (const float& s : {point - 0.005f, point, point + 0.005f}) {
+      arma::cx_fvec exact, result;
+      const bool valid = amplitude.coefficients(exact, s, 0.3, 1.2);
+      if (table.coefficients(result, s, 0.3, 1.2) && valid) {
+        REQUIRE(arma::max(arma::abs(result - exact)) <= 1e-3f * arma::max(arma::abs(exact)));
+      }
+    }
+  }
+}
+
+TEST_CASE("CoefficientTable rejects invalid ranges", "[CoefficientTable]") {
+  Amplitude amplitude;
+  REQUIRE_THROWS_AS(CoefficientTable(amplitude, 2.0f, 1.0f, 1e-3f), std::runtime_error);
+  REQUIRE_THROWS_AS(CoefficientTable(amplitude, 1.0f, 2.0f, 0.0f), std::runtime_error);
+}
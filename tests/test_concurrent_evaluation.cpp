@@ -0,0 +1,98 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "EventFiles.hpp"
+#include "Likelihood.hpp"
+#include "ThreadPool.hpp"
+
+static bool sameBits(const float& a, const float& b) {
+  return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+TEST_CASE("The likelihood gives bitwise-identical results from many threads", "[Concurrency]") {
+  const string dataPath = "/tmp/kmatrix-test-concurrent-data.root";
+  const string accPath = "/tmp/kmatrix-test-concurrent-acc.root";
+  writeEventFile(dataPath, 2000, 21);
+  writeEventFile(accPath, 4000, 22);
+  Likelihood lh(dataPath, accPath, 8000);
+  // Keep the accepted Monte Carlo as events, so both event sums run on every call
+  lh.setPrecomputeIntegrals(false);
+  lh.setNumThreads(2);
+  lh.setup();
+  std::remove(dataPath.c_str());
+  std::remove(accPath.c_str());
+
+  arma::arma_rng::set_seed(21);
+  const arma::uword nWalkers = 8;
+  arma::fmat params(Likelihood::parameterNames().size(), nWalkers);
+  for (arma::uword p = 0; p < params.n_rows; p++) {
+    // Magnitudes and phases alternate
+    params.row(p) = (p % 2 == 0 ? 100.0f : 6.0f) * arma::randu<arma::frowvec>(nWalkers);
+  }
+  vector<float> expected(nWalkers);
+  for (arma::uword w = 0; w < nWalkers; w++) {
+    expected[w] = lh.getExtendedLogLikelihood(params.col(w));
+    REQUIRE(std::isfinite(expected[w]));
+  }
+
+  const int nThreads = 16;
+  const int nRepeats = 4;
+  atomic<int> mismatches(0);
+  // Every thread evaluates every walker, alone and as part of the whole ensemble
+  auto evaluateFromThreads = [&]() {
+    vector<thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+      threads.emplace_back([&, t] {
+        for (int r = 0; r < nRepeats; r++) {
+          for (arma::uword w = 0; w < nWalkers; w++) {
+            const arma::uword walker = (w + t) % nWalkers;
+            if (!sameBits(lh.getExtendedLogLikelihood(params.col(walker)), expected[walker])) {
+              mismatches++;
+            }
+          }
+          const arma::fvec walkers = lh.getExtendedLogLikelihoodWalkers(params);
+          for (arma::uword w = 0; w < nWalkers; w++) {
+            if (!sameBits(walkers(w), expected[w])) {
+              mismatches++;
+            }
+          }
+        }
+      });
+    }
+    for (thread& worker : threads) {
+      worker.join();
+    }
+  };
+
+  // Calls that start their own OpenMP teams
+  evaluateFromThreads();
+  REQUIRE(mismatches == 0);
+  // Single-threaded calls
+  lh.setWalkerParallel(true);
+  evaluateFromThreads();
+  REQUIRE(mismatches == 0);
+  lh.setWalkerParallel(false);
+
+  // Walkers as tasks on a shared pool, each submitting its event sums to the same pool
+  ThreadPool pool(4);
+  lh.setThreadPool(&pool);
+  evaluateFromThreads();
+  REQUIRE(mismatches == 0);
+  for (int r = 0; r < nRepeats; r++) {
+    pool.parallelFor(nThreads * nWalkers, [&](size_t begin, size_t end) {
+      for (size_t task = begin; task < end; task++) {
+        const arma::uword walker = task % nWalkers;
+        if (!sameBits(lh.getExtendedLogLikelihood(params.col(walker)), expected[walker])) {
+          mismatches++;
+        }
+      }
+    });
+  }
+  REQUIRE(mismatches == 0);
+  lh.setThreadPool(nullptr);
+}
@@ -0,0 +1,99 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include <cmath>
+#include <random>
+#include "ConvergenceMonitor.hpp"
+
+// Chains of the AR(1) process x' = 0.9 x + noise, whose integrated autocorrelation time is (1 + 0.9) / (1 - 0.9) = 19
+static arma::mat autoregressive(const arma::uword& nSteps, const arma::uword& nChains, const uint64_t& seed) {
+  mt19937_64 rng(seed);
+  normal_distribution<double> normal(0.0, 1.0);
+  arma::mat series(nSteps, nChains);
+  for (arma::uword c = 0; c < nChains; c++) {
+    double x = normal(rng) / std::sqrt(1.0 - 0.81);
+    for (arma::uword t = 0; t < nSteps; t++) {
+      x = 0.9 * x + normal(rng);
+      series(t, c) = x;
+    }
+  }
+  return series;
+}
+
+TEST_CASE("ConvergenceMonitor estimates the autocorrelation time and split-R-hat", "[ConvergenceMonitor]") {
+  const arma::mat series = autoregressive(4000, 32, 1);
+  bool reliable = false;
+  const double tau = ConvergenceMonitor::integratedTime(series, &reliable);
+  REQUIRE(reliable);
+  REQUIRE(tau == Catch::Approx(19.0).epsilon(0.15));
+  REQUIRE(ConvergenceMonitor::splitRHat(series) < 1.02);
+
+  // Walkers stuck around different values
+  arma::mat offset = series;
+  for (arma::uword c = 0; c < offset.n_cols; c++) {
+    offset.col(c) += 0.5 * c;
+  }
+  REQUIRE(ConvergenceMonitor::splitRHat(offset) > 1.5);
+  // A walker drifting over the history disagrees with itself
+  arma::mat drifting = series;
+  drifting.each_col() += arma::linspace<arma::vec>(0.0, 20.0, series.n_rows);
+  REQUIRE(ConvergenceMonitor::splitRHat(drifting) > 1.5);
+
+  // Too short to find a summation window
+  ConvergenceMonitor::integratedTime(series.head_rows(40), &reliable);
+  REQUIRE_FALSE(reliable);
+  const arma::mat constant(100, 4, arma::fill::ones);
+  REQUIRE(std::isinf(ConvergenceMonitor::integratedTime(constant)));
+  REQUIRE(std::isinf(ConvergenceMonitor::splitRHat(constant)));
+}
+
+TEST_CASE("ConvergenceMonitor keeps the most recent steps", "[ConvergenceMonitor]") {
+  const arma::uword nWalkers = 8;
+  const arma::uword window = 300;
+  const arma::mat first = autoregressive(1000, nWalkers, 2);
+  const arma::mat second = 3.0 * autoregressive(1000, nWalkers, 3);
+  ConvergenceMonitor monitor(2, nWalkers, window);
+  arma::mat recorded(1000, nWalkers);
+  for (arma::uword t = 0; t < 1000; t++) {
+    const arma::fmat positions = arma::conv_to<arma::fmat>::from(arma::join_cols(first.row(t), second.row(t)));
+    monitor.record(positions);
+    recorded.row(t) = arma::conv_to<arma::rowvec>::from(positions.row(0));
+  }
+  REQUIRE(monitor.numSamples() == window);
+  REQUIRE(monitor.numRecorded() == 1000);
+  REQUIRE(monitor.effectiveSamples() == 0.0);
+  monitor.update();
+  const arma::mat recent = recorded.tail_rows(window);
+  REQUIRE(monitor.getTau()(0) == Catch::Approx(ConvergenceMonitor::integratedTime(recent)));
+  REQUIRE(monitor.getRHat()(0) == Catch::Approx(ConvergenceMonitor::splitRHat(recent)));
+  // Only the window counts, not the 700 steps before it
+  REQUIRE(monitor.effectiveSamples() == Catch::Approx(nWalkers * static_cast<double>(window) / monitor.getTau().max()));
+
+  REQUIRE_THROWS_AS(monitor.record(arma::fmat(3, nWalkers, arma::fill::zeros)), std::runtime_error);
+  REQUIRE_THROWS_AS(ConvergenceMonitor(2, nWalkers, 3), std::runtime_error);
+}
+
+TEST_CASE("ConvergenceMonitor stops once the history spans enough autocorrelation times", "[ConvergenceMonitor]") {
+  const arma::uword nWalkers = 32;
+  const arma::mat series = autoregressive(4100, nWalkers, 4);
+  ConvergenceMonitor monitor(1, nWalkers, 4000);
+  auto recordSteps = [&](const arma::uword& begin, const arma::uword& end) {
+    for (arma::uword t = begin; t < end; t++) {
+      monitor.record(arma::conv_to<arma::fmat>::from(series.row(t)));
+    }
+  };
+  recordSteps(0, 500);
+  monitor.update();
+  recordSteps(500, 600);
+  monitor.update();
+  // Too few steps for 50 autocorrelation times, and the halves of each walker still disagree
+  REQUIRE_FALSE(monitor.converged(50.0, 0.05, 1.02));
+
+  recordSteps(600, 4000);
+  monitor.update();
+  recordSteps(4000, 4100);
+  monitor.update();
+  CAPTURE(monitor.getTau(), monitor.getRHat());
+  REQUIRE(monitor.converged(50.0, 0.05, 1.02));
+  REQUIRE_FALSE(monitor.converged(500.0, 0.05, 1.02));
+  REQUIRE_FALSE(monitor.converged(50.0, 0.05, 1.0));
+}
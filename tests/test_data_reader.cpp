@@ -0,0 +1,236 @@
+#include <catch2/catch_all.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "DataReader.hpp"
+#include "EventFiles.hpp"
+#include "Kinematics.hpp"
+
+// The serial loop that DataReader::read replaces: GetEntry for every entry of every file in turn, then the
+// kinematics of all of them, keeping the events that pass the selection
+static EventColumns readSerially(const vector<string>& paths, const EventSelection& selection = EventSelection()) {
+  EventColumns result;
+  for (const string& path : paths) {
+    unique_ptr<TFile> file(TFile::Open(path.c_str(), "READ"));
+    TTree* tree = dynamic_cast<TTree*>(file->Get("kin"));
+    float weight, e_beam, px_beam, py_beam, pz_beam;
+    float e_fs[3], px_fs[3], py_fs[3], pz_fs[3];
+    tree->SetBranchAddress("Weight", &weight);
+    tree->SetBranchAddress("E_Beam", &e_beam);
+    tree->SetBranchAddress("Px_Beam", &px_beam);
+    tree->SetBranchAddress("Py_Beam", &py_beam);
+    tree->SetBranchAddress("Pz_Beam", &pz_beam);
+    tree->SetBranchAddress("E_FinalState", &e_fs);
+    tree->SetBranchAddress("Px_FinalState", &px_fs);
+    tree->SetBranchAddress("Py_FinalState", &py_fs);
+    tree->SetBranchAddress("Pz_FinalState", &pz_fs);
+    const size_t n = tree->GetEntries();
+    // Beam, recoil, p1 and p2, four components each
+    vector<vector<float>> momenta(16, vector<float>(n));
+    vector<float> weights(n), masses(n), thetas(n), phis(n);
+    for (size_t i = 0; i < n; i++) {
+      tree->GetEntry(i);
+      weights[i] = weight;
+      const float beam[4] = {e_beam, px_beam, py_beam, pz_beam};
+      for (size_t k = 0; k < 4; k++) {
+        momenta[k][i] = beam[k];
+      }
+      for (size_t p = 0; p < 3; p++) {
+        momenta[4 * (p + 1)][i] = e_fs[p];
+        momenta[4 * (p + 1) + 1][i] = px_fs[p];
+        momenta[4 * (p + 1) + 2][i] = py_fs[p];
+        momenta[4 * (p + 1) + 3][i] = pz_fs[p];
+      }
+    }
+    tree->ResetBranchAddresses();
+    auto particle = [&momenta](const size_t& p) {
+      return FourMomentumColumns{momenta[4 * p].data(), momenta[4 * p + 1].data(), momenta[4 * p + 2].data(),
+                                 momenta[4 * p + 3].data()};
+    };
+    Kinematics::resonanceFrame(particle(0), particle(1), particle(2), particle(3), n, masses.data(), thetas.data(),
+        phis.data());
+    for (size_t i = 0; i < n; i++) {
+      if (selection.accepts(masses[i], weights[i], thetas[i], phis[i])) {
+        result.masses.push_back(masses[i]);
+        result.weights.push_back(weights[i]);
+        result.thetas.push_back(thetas[i]);
+        result.phis.push_back(phis[i]);
+      }
+    }
+  }
+  return result;
+}
+
+static void requireSameEvents(const EventColumns& events, const EventColumns& expected) {
+  REQUIRE(events.size() == expected.size());
+  REQUIRE(events.masses == expected.masses);
+  REQUIRE(events.weights == expected.weights);
+  REQUIRE(events.thetas == expected.thetas);
+  REQUIRE(events.phis == expected.phis);
+}
+
+// Every cluster of the reader in order, as a pipeline would read them
+static EventColumns readClusters(const DataReader& reader) {
+  EventColumns result;
+  DataReader::FileHandle handle;
+  for (size_t c = 0; c < reader.numClusters(); c++) {
+    EventColumns cluster;
+    reader.readCluster(c, cluster, handle);
+    result.append(cluster);
+  }
+  return result;
+}
+
+// The entries in uneven chunks, the second of which spans both files
+static EventColumns readChunks(DataReader& reader) {
+  EventColumns result;
+  for (const auto& [begin, end] : vector<pair<Long64_t, Long64_t>>{{0, 300}, {300, 1100}, {1100, 100000}}) {
+    reader.readChunk(begin, end);
+    result.append(reader);
+  }
+  return result;
+}
+
+TEST_CASE("DataReader expands glob patterns and file lists", "[DataReader]") {
+  char directory[] = "/tmp/test_data_reader_XXXXXX";
+  REQUIRE(mkdtemp(directory) != nullptr);
+  const string base = directory;
+  for (const string& name : {"run2.root", "run1.root", "run10.root", "other.dat"}) {
+    ofstream(base + "/" + name) << "x";
+  }
+  REQUIRE(DataReader::expandPaths(base + "/run*.root")
+          == vector<string>{base + "/run1.root", base + "/run10.root", base + "/run2.root"});
+  REQUIRE(DataReader::expandPaths(base + "/run1.root") == vector<string>{base + "/run1.root"});
+  // Kept as given, e.g. for a remote URL, so that opening it reports the error
+  REQUIRE(DataReader::expandPaths("root://server//data.root") == vector<string>{"root://server//data.root"});
+
+  const string list = base + "/files.list";
+  ofstream(list) << "# one file or pattern per line\n"
+                 << "\n"
+                 << "  " << base << "/other.dat  \n"
+                 << base << "/run1*.root\r\n";
+  REQUIRE(DataReader::expandPaths(list)
+          == vector<string>{base + "/other.dat", base + "/run1.root", base + "/run10.root"});
+  REQUIRE_THROWS_AS(DataReader::expandPaths(base + "/missing.txt"), std::runtime_error);
+
+  for (const string& name : {"run2.root", "run1.root", "run10.root", "other.dat", "files.list"}) {
+    std::remove((base + "/" + name).c_str());
+  }
+  std::remove(directory);
+}
+
+TEST_CASE("DataReader rejects files it cannot read", "[DataReader]") {
+  const string path = "/tmp/kmatrix-test-reader.root";
+  writeEventFile(path, 10, 1, "other");
+  REQUIRE_THROWS_WITH(DataReader(path, "kin"), Catch::Matchers::ContainsSubstring(path));
+  REQUIRE_THROWS_AS(DataReader(vector<string>{path + ".missing"}, "kin"), std::runtime_error);
+  DataReader reader(path, "other");
+  REQUIRE(reader.numEntries() == 10);
+  std::remove(path.c_str());
+}
+
+TEST_CASE("DataReader counts entries and caches the counts", "[DataReader]") {
+  const string first = "/tmp/kmatrix-test-count-1.root";
+  const string second = "/tmp/kmatrix-test-count-2.root";
+  const string cache = "/tmp/kmatrix-test-entry-counts.txt";
+  writeEventFile(first, 10, 1);
+  writeEventFile(second, 25, 2);
+  std::remove(cache.c_str());
+  REQUIRE(DataReader::countEntries({first, second}, "kin") == vector<Long64_t>{10, 25});
+  REQUIRE(DataReader::countEntries({first, second}, "kin", cache, 2) == vector<Long64_t>{10, 25});
+
+  // Counts of unchanged files come from the cache, without opening the files
+  vector<string> lines;
+  {
+    ifstream in(cache);
+    for (string line; getline(in, line);) {
+      lines.push_back(line);
+    }
+  }
+  REQUIRE(lines.size() == 2);
+  {
+    ofstream out(cache);
+    for (const string& line : lines) {
+      const string key = line.substr(line.find(' '));
+      out << (key.find(first) != string::npos ? "99" : line.substr(0, line.find(' '))) << key << "\n";
+    }
+    // Damaged lines are skipped
+    out << "garbage\n" << "7\n" << "-3 12 0 0 kin /tmp/x.root\n" << "\n" << "42";
+  }
+  REQUIRE(DataReader::countEntries({first, second}, "kin", cache) == vector<Long64_t>{99, 25});
+  // A changed file is counted again
+  writeEventFile(first, 12, 3);
+  REQUIRE(DataReader::countEntries({first, second}, "kin", cache) == vector<Long64_t>{12, 25});
+
+  REQUIRE_THROWS_AS(DataReader::countEntries({first, first + ".missing"}, "kin", cache), std::runtime_error);
+  REQUIRE_THROWS_WITH(DataReader::countEntries({first}, "other"), Catch::Matchers::ContainsSubstring(first));
+  for (const string& path : {first, second, cache}) {
+    std::remove(path.c_str());
+  }
+}
+
+TEST_CASE("DataReader reads clusters in parallel like a serial loop", "[DataReader]") {
+  // Several clusters per file, of different sizes in each file
+  const vector<string> paths = {"/tmp/kmatrix-test-clusters-1.root", "/tmp/kmatrix-test-clusters-2.root"};
+  writeEventFile(paths[0], 1000, 31, "kin", 64);
+  writeEventFile(paths[1], 650, 32, "kin", 100);
+  const EventColumns expected = readSerially(paths);
+  REQUIRE(expected.size() == 1650);
+
+  DataReader reader(paths, "kin");
+  REQUIRE(reader.numEntries() == 1650);
+  REQUIRE(reader.numClusters() > 10);
+  for (const int& nThreads : {1, 4}) {
+    CAPTURE(nThreads);
+    reader.read(nThreads);
+    REQUIRE(reader.nEvents == 1650);
+    requireSameEvents(reader, expected);
+  }
+  requireSameEvents(readClusters(reader), expected);
+  requireSameEvents(readChunks(reader), expected);
+  for (const string& path : paths) {
+    std::remove(path.c_str());
+  }
+}
+
+TEST_CASE("DataReader keeps the selected events in order", "[DataReader]") {
+  const vector<string> paths = {"/tmp/kmatrix-test-selection-1.root", "/tmp/kmatrix-test-selection-2.root"};
+  writeEventFile(paths[0], 1000, 33, "kin", 64);
+  writeEventFile(paths[1], 650, 34, "kin", 100);
+  EventSelection selection;
+  selection.massMin = 1.5f;
+  selection.massMax = 2.5f;
+  selection.minAbsWeight = 0.7f;
+  selection.thetaMax = 2.5f;
+  const EventColumns expected = readSerially(paths, selection);
+  CAPTURE(expected.size());
+  REQUIRE(expected.size() > 100);
+  REQUIRE(expected.size() < 1000);
+
+  DataReader reader(paths, "kin");
+  reader.setSelection(selection);
+  for (const int& nThreads : {1, 4}) {
+    CAPTURE(nThreads);
+    reader.read(nThreads);
+    REQUIRE(reader.nEvents == static_cast<int>(expected.size()));
+    requireSameEvents(reader, expected);
+  }
+  requireSameEvents(readClusters(reader), expected);
+  requireSameEvents(readChunks(reader), expected);
+
+  // Reading everything and filtering afterwards keeps the same events
+  reader.setSelection(EventSelection());
+  reader.read(4);
+  vector<unsigned char> accepted(reader.size());
+  for (size_t i = 0; i < reader.size(); i++) {
+    accepted[i] = selection.accepts(reader.masses[i], reader.weights[i], reader.thetas[i], reader.phis[i]);
+  }
+  reader.compact(accepted);
+  requireSameEvents(reader, expected);
+  for (const string& path : paths) {
+    std::remove(path.c_str());
+  }
+}
@@ -0,0 +1,116 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include <atomic>
+#include "EnsembleSampler.hpp"
+
+// Independent normal distributions with means (0.5, -1) and standard deviations (1, 0.5)
+static arma::fvec gaussian(const arma::fmat& positions) {
+  arma::fvec result(positions.n_cols);
+  for (arma::uword i = 0; i < positions.n_cols; i++) {
+    const float x = positions(0, i) - 0.5f;
+    const float y = (positions(1, i) + 1.0f) / 0.5f;
+    result(i) = -0.5f * (x * x + y * y);
+  }
+  return result;
+}
+
+static const vector<SamplerParameter> gaussianParameters = {{"x", -10.0f, 10.0f}, {"y", -10.0f, 10.0f}};
+
+TEST_CASE("EnsembleSampler samples a Gaussian with every move", "[EnsembleSampler]") {
+  StretchMove stretch;
+  DifferentialEvolutionMove differentialEvolution;
+  DifferentialEvolutionSnookerMove snooker;
+  const vector<pair<const Move*, float>> moves = {{&stretch, 0.5f}, {&differentialEvolution, 0.3f},
+                                                  {&snooker, 0.2f}};
+  EnsembleSampler sampler(32, gaussianParameters, gaussian, 5);
+  sampler.init();
+  for (int s = 0; s < 200; s++) {
+    sampler.step(moves);
+  }
+  arma::fmat samples(2, 0);
+  for (int s = 0; s < 1000; s++) {
+    sampler.step(moves);
+    samples = arma::join_rows(samples, sampler.getPositions());
+  }
+  REQUIRE(sampler.numSteps() == 1200);
+  const arma::fvec mean = arma::mean(samples, 1);
+  const arma::fvec deviation = arma::stddev(samples, 0, 1);
+  CAPTURE(mean, deviation);
+  REQUIRE(mean(0) == Catch::Approx(0.5).margin(0.1));
+  REQUIRE(mean(1) == Catch::Approx(-1.0).margin(0.05));
+  REQUIRE(deviation(0) == Catch::Approx(1.0).epsilon(0.1));
+  REQUIRE(deviation(1) == Catch::Approx(0.5).epsilon(0.1));
+  REQUIRE(arma::mean(sampler.acceptanceFraction()) > 0.2f);
+}
+
+TEST_CASE("DifferentialEvolutionMove jitters every parameter independently", "[EnsembleSampler]") {
+  // Identical complement walkers, so the proposals only differ from the walkers by the jitter
+  const DifferentialEvolutionMove move(0.1f);
+  const arma::fmat active(4, 2000, arma::fill::zeros);
+  const arma::fmat complement(4, 2, arma::fill::ones);
+  arma::fmat proposed;
+  arma::fvec logFactors;
+  mt19937_64 rng(7);
+  move.propose(active, complement, proposed, logFactors, rng);
+  REQUIRE(arma::all(logFactors == 0.0f));
+  const arma::fvec deviation = arma::stddev(proposed, 0, 1);
+  CAPTURE(deviation);
+  for (arma::uword k = 0; k < proposed.n_rows; k++) {
+    REQUIRE(deviation(k) == Catch::Approx(0.1).epsilon(0.1));
+  }
+  // The parameters of one proposal are uncorrelated rather than shifted together
+  const arma::fmat correlation = arma::cor(proposed.t());
+  CAPTURE(correlation);
+  REQUIRE(arma::abs(correlation - arma::eye<arma::fmat>(4, 4)).max() < 0.1f);
+}
+
+TEST_CASE("EnsembleSampler continues exactly from a saved state", "[EnsembleSampler]") {
+  StretchMove stretch;
+  DifferentialEvolutionMove differentialEvolution;
+  const vector<pair<const Move*, float>> moves = {{&stretch, 0.7f}, {&differentialEvolution, 0.3f}};
+  EnsembleSampler uninterrupted(10, gaussianParameters, gaussian, 9);
+  uninterrupted.init();
+  for (int s = 0; s < 15; s++) {
+    uninterrupted.step(moves);
+  }
+  const SamplerState state = uninterrupted.getState();
+  REQUIRE(state.steps == 15);
+  for (int s = 0; s < 15; s++) {
+    uninterrupted.step(moves);
+  }
+
+  EnsembleSampler resumed(10, gaussianParameters, gaussian, 1234);
+  resumed.setState(state);
+  for (int s = 0; s < 15; s++) {
+    resumed.step(moves);
+  }
+  REQUIRE(resumed.numSteps() == 30);
+  REQUIRE(arma::approx_equal(resumed.getPositions(), uninterrupted.getPositions(), "absdiff", 0.0f));
+  REQUIRE(arma::approx_equal(resumed.getLogProbs(), uninterrupted.getLogProbs(), "absdiff", 0.0f));
+
+  EnsembleSampler mismatched(12, gaussianParameters, gaussian);
+  REQUIRE_THROWS_AS(mismatched.setState(state), std::runtime_error);
+}
+
+TEST_CASE("EnsembleSampler only evaluates positions within the bounds", "[EnsembleSampler]") {
+  const vector<SamplerParameter> parameters = {{"a", 0.0f, 1.0f}, {"b", 2.0f, 3.0f}};
+  std::atomic<bool> outside(false);
+  auto flat = [&](const arma::fmat& positions) {
+    for (arma::uword i = 0; i < positions.n_cols; i++) {
+      if (positions(0, i) < 0.0f || positions(0, i) > 1.0f || positions(1, i) < 2.0f || positions(1, i) > 3.0f) {
+        outside = true;
+      }
+    }
+    return arma::fvec(positions.n_cols, arma::fill::zeros);
+  };
+  StretchMove stretch;
+  EnsembleSampler sampler(8, parameters, flat, 3);
+  sampler.init();
+  for (int s = 0; s < 100; s++) {
+    sampler.step({{&stretch, 1.0f}});
+  }
+  REQUIRE_FALSE(outside);
+  REQUIRE(arma::all(sampler.getPositions().row(0) >= 0.0f));
+  REQUIRE(arma::all(sampler.getPositions().row(1) <= 3.0f));
+  REQUIRE_THROWS_AS(EnsembleSampler(4, parameters, flat), std::runtime_error);
+}
@@ -0,0 +1,34 @@
+#include <catch2/catch_all.hpp>
+#include <cmath>
+#include <limits>
+#include "EventSelection.hpp"
+
+TEST_CASE("EventSelection defaults keep every event", "[EventSelection]") {
+  EventSelection selection;
+  REQUIRE(selection.keepsAll());
+  REQUIRE(selection.accepts(1.5f, 0.0f, 0.0f, -static_cast<float>(M_PI)));
+  REQUIRE(selection.accepts(3.0f, -2.0f, static_cast<float>(M_PI), static_cast<float>(M_PI)));
+}
+
+TEST_CASE("EventSelection applies each cut", "[EventSelection]") {
+  EventSelection selection;
+  selection.massMin = 1.0f;
+  selection.massMax = 1.2f;
+  REQUIRE_FALSE(selection.keepsAll());
+  REQUIRE(selection.accepts(1.0f, 1.0f, 1.0f, 0.0f));
+  REQUIRE(selection.accepts(1.1f, 1.0f, 1.0f, 0.0f));
+  // Adjacent mass slices share no events
+  REQUIRE_FALSE(selection.accepts(1.2f, 1.0f, 1.0f, 0.0f));
+  REQUIRE_FALSE(selection.accepts(0.9f, 1.0f, 1.0f, 0.0f));
+  REQUIRE_FALSE(selection.accepts(numeric_limits<float>::quiet_NaN(), 1.0f, 1.0f, 0.0f));
+
+  selection.minAbsWeight = 1.0e-6f;
+  REQUIRE_FALSE(selection.accepts(1.1f, 0.0f, 1.0f, 0.0f));
+  REQUIRE(selection.accepts(1.1f, -0.5f, 1.0f, 0.0f));
+
+  selection.thetaMax = 0.5f;
+  selection.phiMin = 0.0f;
+  REQUIRE_FALSE(selection.accepts(1.1f, 1.0f, 1.0f, 0.1f));
+  REQUIRE_FALSE(selection.accepts(1.1f, 1.0f, 0.2f, -0.1f));
+  REQUIRE(selection.accepts(1.1f, 1.0f, 0.2f, 0.1f));
+}
@@ -0,0 +1,87 @@
+#include <catch2/catch_all.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include "EventStore.hpp"
+
+TEST_CASE("EventStore columns are aligned and a fixed stride apart", "[EventStore]") {
+  EventStore store(3);
+  store.resize(100);
+  REQUIRE(store.size() == 100);
+  REQUIRE(store.capacity() >= 100);
+  REQUIRE(store.stride() % (EventStore::alignment / sizeof(float)) == 0);
+  for (size_t k = 0; k < store.numColumns(); k++) {
+    REQUIRE(reinterpret_cast<uintptr_t>(store.column(k)) % EventStore::alignment == 0);
+    REQUIRE(store.column(k) - store.column(0) == static_cast<ptrdiff_t>(k * store.stride()));
+  }
+  REQUIRE(store.bytes() >= 3 * 100 * sizeof(float));
+}
+
+TEST_CASE("EventStore resize keeps existing values", "[EventStore]") {
+  EventStore store(2);
+  store.resize(10);
+  for (size_t i = 0; i < 10; i++) {
+    store.column(0)[i] = static_cast<float>(i);
+    store.column(1)[i] = -static_cast<float>(i);
+  }
+  store.resize(5);
+  REQUIRE(store.size() == 5);
+  store.resize(1000);
+  REQUIRE(store.size() == 1000);
+  for (size_t i = 0; i < 5; i++) {
+    REQUIRE(store.column(0)[i] == static_cast<float>(i));
+    REQUIRE(store.column(1)[i] == -static_cast<float>(i));
+  }
+  REQUIRE(store.column(0)[999] == 0.0f);
+}
+
+TEST_CASE("EventStore move transfers ownership", "[EventStore]") {
+  EventStore store(1);
+  store.resize(16);
+  store.column(0)[3] = 42.0f;
+  EventStore moved(std::move(store));
+  REQUIRE(store.size() == 0);
+  REQUIRE(store.bytes() == 0);
+  REQUIRE(moved.size() == 16);
+  REQUIRE(moved.column(0)[3] == 42.0f);
+}
+
+#ifdef __linux__
+TEST_CASE("EventStore maps a written store copy-on-write", "[EventStore]") {
+  EventStore store(2);
+  store.resize(100);
+  for (size_t i = 0; i < 100; i++) {
+    store.column(0)[i] = static_cast<float>(i);
+    store.column(1)[i] = -static_cast<float>(i);
+  }
+  char path[] = "/tmp/test_event_store_XXXXXX";
+  const int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  const size_t nBytes = store.numColumns() * store.stride() * sizeof(float);
+  REQUIRE(write(fd, store.column(0), nBytes) == static_cast<ssize_t>(nBytes));
+
+  EventStore mapped(2);
+  mapped.mapFile(fd, 0, 100, store.stride());
+  close(fd);
+  REQUIRE(mapped.isFileBacked());
+  REQUIRE_FALSE(mapped.hugePages());
+  REQUIRE(mapped.size() == 100);
+  REQUIRE(mapped.column(1)[42] == -42.0f);
+
+  // Writes stay private to the mapping
+  mapped.column(1)[42] = 1.0f;
+  const int reopened = open(path, O_RDONLY);
+  float value = 0.0f;
+  REQUIRE(pread(reopened, &value, sizeof(float), (store.stride() + 42) * sizeof(float)) == sizeof(float));
+  REQUIRE(value == -42.0f);
+  close(reopened);
+  remove(path);
+
+  // Growing copies into an ordinary allocation
+  mapped.resize(1000);
+  REQUIRE_FALSE(mapped.isFileBacked());
+  REQUIRE(mapped.column(0)[99] == 99.0f);
+  REQUIRE(mapped.column(1)[42] == 1.0f);
+}
+#endif
@@ -0,0 +1,124 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include "KMatrix.hpp"
+#include "FixedKMatrix.hpp"
+
+template <size_t N>
+static arma::cx_fvec toVec(const std::array<std::complex<float>, N>& values) {
+  arma::cx_fvec result(N);
+  for (size_t i = 0; i < N; i++) {
+    result(i) = values[i];
+  }
+  return result;
+}
+
+template <size_t N>
+static arma::cx_fmat toMat(const std::array<std::array<std::complex<float>, N>, N>& values) {
+  arma::cx_fmat result(N, N);
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      result(i, j) = values[i][j];
+    }
+  }
+  return result;
+}
+
+static void initializeA2(KMatrix& kmat_a2) {
+  arma::fmat a2_mchannels = {
+    {0.13498, 0.54786},
+    {0.49368, 0.49761},
+    {0.13498, 0.95778}
+  };
+  arma::fmat a2_malphas = {1.30080, 1.75351};
+  arma::fmat a2_galphas = {
+    {+0.30073, +0.21426, -0.09162},
+    {+0.68567, +0.12543, +0.00184}
+  };
+  arma::fmat a2_cbkg = {
+    {-0.40184, +0.00033, -0.08707},
+    {+0.00033, -0.21416, -0.06193},
+    {-0.08707, -0.06193, -0.17435}
+  };
+  kmat_a2.initialize(a2_malphas, a2_mchannels, a2_galphas.t(), a2_cbkg);
+}
+
+static void initializeF0(KMatrix& kmat_f0) {
+  arma::fmat f0_mchannels = {
+    {0.13498, 0.13498},
+    {0.26995, 0.26995},
+    {0.49368, 0.49761},
+    {0.54786, 0.54786},
+    {0.54786, 0.95778}
+  };
+  arma::fmat f0_malphas = {0.51461, 0.90630, 1.23089, 1.46104, 1.69611};
+  arma::fmat f0_galphas = {
+    {+0.74987, -0.01257, +0.02736, -0.15102, +0.36103},
+    {+0.06401, +0.00204, +0.77413, +0.50999, +0.13112},
+    {-0.23417, -0.01032, +0.72283, +0.11934, +0.36792},
+    {+0.01570, +0.26700, +0.09214, +0.02742, -0.04025},
+    {-0.14242, +0.22780, +0.15981, +0.16272, -0.17397}
+  };
+  arma::fmat f0_cbkg = {
+    {+0.03728, +0.00000, -0.01398, -0.02203, +0.01397},
+    {+0.00000, +0.00000, +0.00000, +0.00000, +0.00000},
+    {-0.01398, +0.00000, +0.02349, +0.03101, -0.04003},
+    {-0.02203, +0.00000, +0.03101, -0.13769, -0.06722},
+    {+0.01397, +0.00000, -0.04003, -0.06722, -0.28401}
+  };
+  kmat_f0.initialize(f0_malphas, f0_mchannels, f0_galphas.t(), f0_cbkg);
+}
+
+TEST_CASE("FixedKMatrix rejects mismatched dimensions", "[FixedKMatrix]") {
+  KMatrix kmat_a2(3, 2, 2);
+  initializeA2(kmat_a2);
+  REQUIRE_THROWS_AS((FixedKMatrix<3, 2, 0>(kmat_a2)), std::runtime_error);
+  REQUIRE_THROWS_AS((FixedKMatrix<2, 2, 2>(kmat_a2)), std::runtime_error);
+}
+
+TEST_CASE("FixedKMatrix matches KMatrix (J=2)", "[FixedKMatrix]") {
+  KMatrix kmat_a2(3, 2, 2);
+  initializeA2(kmat_a2);
+  FixedKMatrix<3, 2, 2> fixed_a2(kmat_a2);
+
+  for (float s : {0.5f, 1.3f, 2.7f}) {
+    CAPTURE(s);
+    REQUIRE(arma::approx_equal(toVec(fixed_a2.rho(s)), kmat_a2.rho(s), "reldiff", 0.0001));
+    REQUIRE(arma::approx_equal(toVec(fixed_a2.q(s)), kmat_a2.q(s), "reldiff", 0.0001));
+    REQUIRE(arma::approx_equal(toMat(fixed_a2.K(s)), kmat_a2.K(s), "absdiff", 0.0001));
+    REQUIRE(arma::approx_equal(arma::cx_fmat(arma::diagmat(toVec(fixed_a2.C(s)))), kmat_a2.C(s), "absdiff", 0.0001));
+
+    FixedKMatrix<3, 2, 2>::ChannelMatrix inv;
+    REQUIRE(fixed_a2.IKC_inv(inv, s));
+    REQUIRE(arma::approx_equal(toMat(inv), kmat_a2.IKC_inv(s), "absdiff", 0.0001));
+
+    FixedKMatrix<3, 2, 2>::ChannelVector column;
+    REQUIRE(fixed_a2.IKC_inv_col(column, s, 1) > 0.0f);
+    REQUIRE(arma::approx_equal(toVec(column), arma::cx_fvec(kmat_a2.IKC_inv(s).col(1)), "absdiff", 0.0001));
+
+    FixedKMatrix<3, 2, 2>::AlphaVector coeffs;
+    REQUIRE(fixed_a2.coefficients(coeffs, s, 1));
+    arma::cx_fvec expected = kmat_a2.coefficients(s, kmat_a2.B(s), kmat_a2.IKC_inv(s).col(1));
+    CAPTURE(expected);
+    CAPTURE(toVec(coeffs));
+    REQUIRE(arma::approx_equal(toVec(coeffs), expected, "absdiff", 0.0001));
+  }
+}
+
+TEST_CASE("FixedKMatrix matches KMatrix with Adler zero (J=0)", "[FixedKMatrix]") {
+  KMatrix kmat_f0(5, 5, 0);
+  initializeF0(kmat_f0);
+  FixedKMatrix<5, 5, 0> fixed_f0(kmat_f0);
+
+  for (float s : {0.5f, 1.3f, 2.7f}) {
+    CAPTURE(s);
+    REQUIRE(arma::approx_equal(toMat(fixed_f0.K(s, 0.0091125, 1.0)), kmat_f0.K(s, 0.0091125, 1.0), "absdiff", 0.0001));
+
+    FixedKMatrix<5, 5, 0>::AlphaVector coeffs;
+    REQUIRE(fixed_f0.coefficients(coeffs, s, 0.0091125, 1.0, 2));
+    arma::cx_fvec expected = kmat_f0.coefficients(
+        s, arma::fmat(5, 5, arma::fill::ones), kmat_f0.IKC_inv(s, 0.0091125, 1.0).col(2));
+    CAPTURE(expected);
+    CAPTURE(toVec(coeffs));
+    REQUIRE(arma::approx_equal(toVec(coeffs), expected, "absdiff", 0.0001));
+  }
+}
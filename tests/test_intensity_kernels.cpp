@@ -0,0 +1,91 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include <cmath>
+#include <vector>
+#include "Amplitude.hpp"
+#include "AmplitudeBasis.hpp"
+#include "IntensityKernels.hpp"
+
+static const IntensityKernel allKernels[] = {IntensityKernel::Scalar, IntensityKernel::AVX2, IntensityKernel::AVX512};
+
+TEST_CASE("Vectorized logarithm is within the stated tolerance", "[IntensityKernels]") {
+  // Powers of two spanning most of the normal float range, plus points around the polynomial's branch
+  std::vector<float> x;
+  for (int e = -120; e <= 120; e++) {
+    for (float m : {1.0f, 1.1f, 1.41421f, 1.41422f, 1.5f, 1.999f}) {
+      x.push_back(std::ldexp(m, e));
+    }
+  }
+  for (float v : {0.999999f, 1.000001f, 0.70710677f, 0.70710683f}) {
+    x.push_back(v);
+  }
+  for (IntensityKernel kernel : allKernels) {
+    if (!IntensityKernels::supported(kernel)) {
+      continue;
+    }
+    CAPTURE(IntensityKernels::name(kernel));
+    std::vector<float> result(x.size());
+    IntensityKernels::logArray(kernel, x.data(), result.data(), x.size());
+    for (size_t i = 0; i < x.size(); i++) {
+      double expected = std::log(static_cast<double>(x[i]));
+      CAPTURE(x[i]);
+      REQUIRE(std::fabs(result[i] - expected) <= IntensityKernels::logTolerance * std::max(1.0, std::fabs(expected)));
+    }
+  }
+}
+
+TEST_CASE("Vectorized logarithm handles zero and non-finite arguments", "[IntensityKernels]") {
+  std::vector<float> x = {0.0f, INFINITY, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+  for (IntensityKernel kernel : allKernels) {
+    if (!IntensityKernels::supported(kernel)) {
+      continue;
+    }
+    CAPTURE(IntensityKernels::name(kernel));
+    std::vector<float> result(x.size());
+    IntensityKernels::logArray(kernel, x.data(), result.data(), x.size());
+    REQUIRE(std::isinf(result[0]));
+    REQUIRE(result[0] < 0.0f);
+    REQUIRE(std::isinf(result[1]));
+    REQUIRE(result[1] > 0.0f);
+    REQUIRE(result[2] == 0.0f);
+  }
+}
+
+TEST_CASE("Every kernel reproduces the scalar Amplitude::intensity sum", "[IntensityKernels]") {
+  arma::arma_rng::set_seed(4);
+  Amplitude amplitude;
+  // Not a multiple of any vector width, so the remainder loops are exercised too
+  arma::uword nEvents = 1003;
+  arma::cx_fvec betas = arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients) * 10.0f;
+  arma::fmat bw_f0(5, 5, arma::fill::ones);
+  arma::fmat bw_a0(2, 2, arma::fill::ones);
+  AmplitudeBasis basis;
+  basis.resize(nEvents);
+  double expected = 0.0;
+  for (arma::uword i = 0; i < nEvents; i++) {
+    float mass = 1.0f + static_cast<float>(arma::randu());
+    float s = mass * mass;
+    float theta = arma::datum::pi * static_cast<float>(arma::randu());
+    float phi = arma::datum::pi * (2.0f * static_cast<float>(arma::randu()) - 1.0f);
+    float weight = static_cast<float>(arma::randu());
+    arma::fmat bw_f2 = amplitude.bw_f2(s);
+    arma::fmat bw_a2 = amplitude.bw_a2(s);
+    arma::cx_fvec ikc_inv_f0 = amplitude.ikc_inv_vec_f0(s);
+    arma::cx_fvec ikc_inv_f2 = amplitude.ikc_inv_vec_f2(s);
+    arma::cx_fvec ikc_inv_a0 = amplitude.ikc_inv_vec_a0(s);
+    arma::cx_fvec ikc_inv_a2 = amplitude.ikc_inv_vec_a2(s);
+    expected += weight * std::log(amplitude.intensity(betas, s, theta, phi,
+          bw_f0, bw_f2, bw_a0, bw_a2,
+          ikc_inv_f0, ikc_inv_f2, ikc_inv_a0, ikc_inv_a2));
+    basis.set(i, amplitude.coefficients(s, theta, phi, bw_f2, bw_a2,
+          ikc_inv_f0, ikc_inv_f2, ikc_inv_a0, ikc_inv_a2), weight);
+  }
+  for (IntensityKernel kernel : allKernels) {
+    if (!IntensityKernels::supported(kernel)) {
+      continue;
+    }
+    CAPTURE(IntensityKernels::name(kernel));
+    basis.setKernel(kernel);
+    REQUIRE(basis.sumLogIntensity(betas) == Catch::Approx(expected).epsilon(1e-4));
+  }
+}
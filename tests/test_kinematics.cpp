@@ -0,0 +1,66 @@
+#include <catch2/catch_all.hpp>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "TLorentzVector.h"
+#include "TLorentzRotation.h"
+#include "Kinematics.hpp"
+
+// The per-event ROOT calculation that Kinematics::resonanceFrame replaces
+static void rootResonanceFrame(const TLorentzVector& beam, const TLorentzVector& recoil,
+    const TLorentzVector& p1, const TLorentzVector& p2, float& mass, float& theta, float& phi) {
+  TLorentzVector resonance = p1 + p2;
+  TLorentzRotation resRestBoost(-resonance.BoostVector());
+  TLorentzVector recoil_res = resRestBoost * recoil;
+  TLorentzVector p1_res = resRestBoost * p1;
+  TVector3 z = -1.0 * recoil_res.Vect().Unit();
+  TVector3 y = (beam.Vect().Cross(-recoil.Vect())).Unit();
+  TVector3 x = y.Cross(z);
+  TVector3 angles(p1_res.Vect().Dot(x), p1_res.Vect().Dot(y), p1_res.Vect().Dot(z));
+  mass = resonance.M();
+  theta = angles.Theta();
+  phi = angles.Phi();
+}
+
+TEST_CASE("Kinematics matches the ROOT helicity frame calculation", "[Kinematics]") {
+  const size_t n = 1000;
+  std::mt19937 rng(2023);
+  std::uniform_real_distribution<float> momentum(-1.5f, 1.5f);
+  std::uniform_real_distribution<float> beamEnergy(8.0f, 9.0f);
+  // Columns for the beam, recoil (proton), p1 and p2 (kaons)
+  std::vector<std::vector<float>> columns(16, std::vector<float>(n));
+  std::vector<TLorentzVector> vectors(4 * n);
+  const float particleMasses[4] = {0.0f, 0.93827f, 0.49368f, 0.49368f};
+  for (size_t i = 0; i < n; i++) {
+    for (size_t p = 0; p < 4; p++) {
+      float px = momentum(rng);
+      float py = momentum(rng);
+      float pz = p == 0 ? beamEnergy(rng) : momentum(rng) + 2.0f;
+      if (p == 0) {
+        px *= 0.01f;
+        py *= 0.01f;
+      }
+      float e = std::sqrt(px * px + py * py + pz * pz + particleMasses[p] * particleMasses[p]);
+      columns[4 * p + 0][i] = e;
+      columns[4 * p + 1][i] = px;
+      columns[4 * p + 2][i] = py;
+      columns[4 * p + 3][i] = pz;
+      vectors[4 * i + p] = TLorentzVector(px, py, pz, e);
+    }
+  }
+  auto particle = [&columns](size_t p) {
+    return FourMomentumColumns{columns[4 * p].data(), columns[4 * p + 1].data(), columns[4 * p + 2].data(), columns[4 * p + 3].data()};
+  };
+  std::vector<float> masses(n), thetas(n), phis(n);
+  Kinematics::resonanceFrame(particle(0), particle(1), particle(2), particle(3), n, masses.data(), thetas.data(), phis.data());
+
+  for (size_t i = 0; i < n; i++) {
+    float mass, theta, phi;
+    rootResonanceFrame(vectors[4 * i], vectors[4 * i + 1], vectors[4 * i + 2], vectors[4 * i + 3], mass, theta, phi);
+    CAPTURE(i, mass, theta, phi, masses[i], thetas[i], phis[i]);
+    REQUIRE(masses[i] == Catch::Approx(mass).epsilon(1e-6));
+    REQUIRE(thetas[i] == Catch::Approx(theta).margin(1e-5));
+    // phi wraps at +-pi
+    REQUIRE(std::remainder(phis[i] - phi, 2.0 * M_PI) == Catch::Approx(0.0).margin(1e-5));
+  }
+}
@@ -8,14 +8,14 @@ TEST_CASE("KMatrix constructor initializes members correctly", "[KMatrix]") {
     REQUIRE(kmatrix.numChannels == 2);
     REQUIRE(kmatrix.numAlphas == 3);
     REQUIRE(kmatrix.J == 0);
-    REQUIRE(kmatrix.mAlphas.n_rows == 1);
-    REQUIRE(kmatrix.mAlphas.n_cols == 3);
-    REQUIRE(kmatrix.mChannels.n_rows == 2);
-    REQUIRE(kmatrix.mChannels.n_cols == 2);
-    REQUIRE(kmatrix.gAlphas.n_rows == 2);
-    REQUIRE(kmatrix.gAlphas.n_cols == 3);
-    REQUIRE(kmatrix.cBkg.n_rows == 2);
-    REQUIRE(kmatrix.cBkg.n_cols == 2);
+    REQUIRE(kmatrix.getMAlphas().n_rows == 1);
+    REQUIRE(kmatrix.getMAlphas().n_cols == 3);
+    REQUIRE(kmatrix.getMChannels().n_rows == 2);
+    REQUIRE(kmatrix.getMChannels().n_cols == 2);
+    REQUIRE(kmatrix.getGAlphas().n_rows == 2);
+    REQUIRE(kmatrix.getGAlphas().n_cols == 3);
+    REQUIRE(kmatrix.getCBkg().n_rows == 2);
+    REQUIRE(kmatrix.getCBkg().n_cols == 2);
   }
 
   SECTION("J = 2") {
@@ -23,14 +23,14 @@ TEST_CASE("KMatrix constructor initializes members correctly", "[KMatrix]") {
     REQUIRE(kmatrix.numChannels == 3);
     REQUIRE(kmatrix.numAlphas == 4);
     REQUIRE(kmatrix.J == 2);
-    REQUIRE(kmatrix.mAlphas.n_rows == 1);
-    REQUIRE(kmatrix.mAlphas.n_cols == 4);
-    REQUIRE(kmatrix.mChannels.n_rows == 3);
-    REQUIRE(kmatrix.mChannels.n_cols == 2);
-    REQUIRE(kmatrix.gAlphas.n_rows == 3);
-    REQUIRE(kmatrix.gAlphas.n_cols == 4);
-    REQUIRE(kmatrix.cBkg.n_rows == 3);
-    REQUIRE(kmatrix.cBkg.n_cols == 3);
+    REQUIRE(kmatrix.getMAlphas().n_rows == 1);
+    REQUIRE(kmatrix.getMAlphas().n_cols == 4);
+    REQUIRE(kmatrix.getMChannels().n_rows == 3);
+    REQUIRE(kmatrix.getMChannels().n_cols == 2);
+    REQUIRE(kmatrix.getGAlphas().n_rows == 3);
+    REQUIRE(kmatrix.getGAlphas().n_cols == 4);
+    REQUIRE(kmatrix.getCBkg().n_rows == 3);
+    REQUIRE(kmatrix.getCBkg().n_cols == 3);
   }
 
   SECTION("Unsupported J") {
@@ -711,3 +711,122 @@ TEST_CASE("KMatrix B2 function below threshold (J=2)", "[KMatrix]") {
   REQUIRE(arma::approx_equal(result, expected_result, "reldiff", 0.00001));
 }
 
+
+TEST_CASE("KMatrix coefficients reproduce F (J=2)", "[KMatrix]") {
+  arma::fmat a2_mchannels = {
+    {0.13498, 0.54786},
+    {0.49368, 0.49761},
+    {0.13498, 0.95778}
+  };
+  arma::fmat a2_malphas = {1.30080, 1.75351};
+  arma::fmat a2_galphas = {
+    {+0.30073, +0.21426, -0.09162},
+    {+0.68567, +0.12543, +0.00184}
+  };
+  arma::fmat a2_cbkg = {
+    {-0.40184, +0.00033, -0.08707},
+    {+0.00033, -0.21416, -0.06193},
+    {-0.08707, -0.06193, -0.17435}
+  };
+
+  KMatrix kmat_a2(3, 2, 2);
+  kmat_a2.initialize(a2_malphas, a2_mchannels, a2_galphas.t(), a2_cbkg);
+
+  float s = 1.3;
+  arma::cx_fvec betas = {std::complex<float>(1.5, -0.5), std::complex<float>(-0.3, 2.0)};
+  arma::cx_fvec ikc_inv_vec = kmat_a2.IKC_inv(s).col(1);
+  arma::fmat B = kmat_a2.B(s);
+
+  arma::cx_fvec expected_result = {kmat_a2.F(s, betas, B, ikc_inv_vec)};
+  arma::cx_fvec result = {arma::dot(kmat_a2.coefficients(s, B, ikc_inv_vec), betas)};
+  CAPTURE(expected_result);  // Print the expectation
+  CAPTURE(result);  // Print the result
+
+  REQUIRE(arma::approx_equal(result, expected_result, "reldiff", 0.00001));
+}
+
+TEST_CASE("KMatrix IKC_inv_col matches IKC_inv", "[KMatrix]") {
+  arma::fmat a2_mchannels = {
+    {0.13498, 0.54786},
+    {0.49368, 0.49761},
+    {0.13498, 0.95778}
+  };
+  arma::fmat a2_malphas = {1.30080, 1.75351};
+  arma::fmat a2_galphas = {
+    {+0.30073, +0.21426, -0.09162},
+    {+0.68567, +0.12543, +0.00184}
+  };
+  arma::fmat a2_cbkg = {
+    {-0.40184, +0.00033, -0.08707},
+    {+0.00033, -0.21416, -0.06193},
+    {-0.08707, -0.06193, -0.17435}
+  };
+
+  KMatrix kmat_a2(3, 2, 2);
+  kmat_a2.initialize(a2_malphas, a2_mchannels, a2_galphas.t(), a2_cbkg);
+
+  for (float s : {0.5f, 1.3f, 2.7f}) {
+    arma::cx_fmat expected_result = kmat_a2.IKC_inv(s);
+    for (arma::uword channel = 0; channel < 3; channel++) {
+      arma::cx_fvec result;
+      float rcond = kmat_a2.IKC_inv_col(result, s, channel);
+      CAPTURE(s, channel, rcond);
+      CAPTURE(expected_result.col(channel));
+      CAPTURE(result);
+      REQUIRE(rcond > 0.0f);
+      REQUIRE(arma::approx_equal(result, arma::cx_fvec(expected_result.col(channel)), "absdiff", 0.0001));
+    }
+  }
+}
+
+TEST_CASE("KMatrix batch evaluation matches single evaluation (J=2)", "[KMatrix]") {
+  arma::fmat a2_mchannels = {
+    {0.13498, 0.54786},
+    {0.49368, 0.49761},
+    {0.13498, 0.95778}
+  };
+  arma::fmat a2_malphas = {1.30080, 1.75351};
+  arma::fmat a2_galphas = {
+    {+0.30073, +0.21426, -0.09162},
+    {+0.68567, +0.12543, +0.00184}
+  };
+  arma::fmat a2_cbkg = {
+    {-0.40184, +0.00033, -0.08707},
+    {+0.00033, -0.21416, -0.06193},
+    {-0.08707, -0.06193, -0.17435}
+  };
+
+  KMatrix kmat_a2(3, 2, 2);
+  kmat_a2.initialize(a2_malphas, a2_mchannels, a2_galphas.t(), a2_cbkg);
+
+  arma::fvec s = {0.2, 0.5, 1.3, 2.7};
+  arma::cx_fmat rho, cdiag;
+  arma::fmat bw;
+  arma::cx_fcube kmats;
+  kmat_a2.evaluate(s, rho, bw, cdiag, kmats);
+  arma::cx_fmat columns;
+  arma::fvec rcond = kmat_a2.IKC_inv_col(columns, s, 1);
+
+  arma::cx_fcube kmats_adler;
+  kmat_a2.evaluate(s, 0.1, 2.0, rho, bw, cdiag, kmats_adler);
+
+  for (arma::uword e = 0; e < s.n_elem; e++) {
+    CAPTURE(s(e));
+    REQUIRE(arma::approx_equal(arma::cx_fvec(rho.row(e).st()), kmat_a2.rho(s(e)), "absdiff", 0.0001));
+    REQUIRE(arma::approx_equal(arma::fvec(bw.row(e).t()), kmat_a2.blatt_weisskopf(s(e)), "absdiff", 0.0001));
+    REQUIRE(arma::approx_equal(arma::cx_fvec(cdiag.row(e).st()), arma::cx_fvec(kmat_a2.C(s(e)).diag()), "absdiff", 0.0001));
+
+    arma::cx_fmat kmat(3, 3), kmat_adler(3, 3);
+    for (arma::uword i = 0; i < 3; i++) {
+      for (arma::uword j = 0; j < 3; j++) {
+        kmat(i, j) = kmats(e, i, j);
+        kmat_adler(i, j) = kmats_adler(e, i, j);
+      }
+    }
+    REQUIRE(arma::approx_equal(kmat, kmat_a2.K(s(e)), "absdiff", 0.0001));
+    REQUIRE(arma::approx_equal(kmat_adler, kmat_a2.K(s(e), 0.1, 2.0), "absdiff", 0.0001));
+
+    REQUIRE(rcond(e) > 0.0f);
+    REQUIRE(arma::approx_equal(arma::cx_fvec(columns.row(e).st()), arma::cx_fvec(kmat_a2.IKC_inv(s(e)).col(1)), "absdiff", 0.0001));
+  }
+}
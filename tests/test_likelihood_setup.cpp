@@ -0,0 +1,168 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <dirent.h>
+#include <limits>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "EventFiles.hpp"
+#include "Likelihood.hpp"
+#include "SetupCache.hpp"
+
+// What setup() derived from both samples, as written to its cache
+struct SetupResult {
+  SetupResult(const string& dataPath, const string& accPath) : data(dataPath, "kin"), acc(accPath, "kin") {}
+  DataReader data;
+  vector<unsigned char> dataValid;
+  AmplitudeBasis dataBasis;
+  DataReader acc;
+  vector<unsigned char> accValid;
+  AmplitudeBasis accBasis;
+  arma::cx_mat integrals;
+};
+
+// Load (and remove) the only cache file of a sample in directory, whose key is taken from its name
+static void loadCached(const string& directory, const string& name, DataReader& reader, vector<unsigned char>& valid,
+    AmplitudeBasis* basis, arma::cx_mat* integrals) {
+  string file;
+  DIR* listing = opendir(directory.c_str());
+  REQUIRE(listing);
+  while (const dirent* entry = readdir(listing)) {
+    if (string(entry->d_name).rfind(name + "-", 0) == 0) {
+      file = entry->d_name;
+    }
+  }
+  closedir(listing);
+  REQUIRE_FALSE(file.empty());
+  const uint64_t key = std::stoull(file.substr(name.size() + 1, 16), nullptr, 16);
+  const string path = directory + "/" + file;
+  REQUIRE(SetupCache::load(path, key, reader, valid, basis, integrals));
+  std::remove(path.c_str());
+}
+
+// Run setup() and collect its results through the setup cache
+static void runSetup(SetupResult& result, const string& dataPath, const string& accPath, const float& tolerance,
+    const bool& precomputeIntegrals, const EventSelection& selection) {
+  char directory[] = "/tmp/kmatrix-test-setup-XXXXXX";
+  REQUIRE(mkdtemp(directory));
+  Likelihood lh(dataPath, accPath, 8000);
+  lh.setInterpolationTolerance(tolerance);
+  lh.setPrecomputeIntegrals(precomputeIntegrals);
+  lh.setSelection(selection);
+  lh.setNumThreads(4);
+  lh.setCacheDirectory(directory);
+  lh.setup();
+  loadCached(directory, "data", result.data, result.dataValid, &result.dataBasis, nullptr);
+  loadCached(directory, "acc", result.acc, result.accValid, precomputeIntegrals ? nullptr : &result.accBasis,
+      precomputeIntegrals ? &result.integrals : nullptr);
+  rmdir(directory);
+}
+
+static void requireSameEvents(const DataReader& events, const DataReader& expected) {
+  REQUIRE(events.nEvents == expected.nEvents);
+  REQUIRE(events.masses == expected.masses);
+  REQUIRE(events.weights == expected.weights);
+  REQUIRE(events.thetas == expected.thetas);
+  REQUIRE(events.phis == expected.phis);
+}
+
+static void requireSameBasis(const AmplitudeBasis& basis, const AmplitudeBasis& expected) {
+  REQUIRE(basis.size() == expected.size());
+  for (arma::uword i = 0; i < basis.size(); i++) {
+    REQUIRE(basis.weight(i) == expected.weight(i));
+    for (arma::uword k = 0; k < AmplitudeBasis::nCoefficients; k++) {
+      const float scale = 1e-5f * (1.0f + std::abs(expected.realData(k)[i]) + std::abs(expected.imagData(k)[i]));
+      REQUIRE(std::abs(basis.realData(k)[i] - expected.realData(k)[i]) <= scale);
+      REQUIRE(std::abs(basis.imagData(k)[i] - expected.imagData(k)[i]) <= scale);
+    }
+  }
+}
+
+TEST_CASE("The setup pipeline matches reading and precalculating in turn", "[Likelihood]") {
+  const string dataPath = "/tmp/kmatrix-test-setup-data.root";
+  const string accPath = "/tmp/kmatrix-test-setup-acc.root";
+  // Several clusters per sample, so the pipeline has chunks to reorder
+  writeEventFile(dataPath, 1500, 41, "kin", 128);
+  writeEventFile(accPath, 3000, 42, "kin", 200);
+  EventSelection cuts;
+  cuts.massMin = 1.2f;
+  cuts.massMax = 2.6f;
+  cuts.minAbsWeight = 0.6f;
+  cuts.phiMin = -2.5f;
+
+  for (const bool& precomputeIntegrals : {true, false}) {
+    for (const EventSelection& selection : {EventSelection(), cuts}) {
+      CAPTURE(precomputeIntegrals, selection.keepsAll());
+      // A tolerance that only an exactly linear interval of the table could meet, so the events are evaluated
+      // exactly as in the pipeline, but after reading the whole sample
+      SetupResult sequential(dataPath, accPath);
+      runSetup(sequential, dataPath, accPath, numeric_limits<float>::denorm_min(), precomputeIntegrals, selection);
+      SetupResult pipelined(dataPath, accPath);
+      runSetup(pipelined, dataPath, accPath, 0.0f, precomputeIntegrals, selection);
+
+      REQUIRE(pipelined.dataValid == sequential.dataValid);
+      REQUIRE(pipelined.accValid == sequential.accValid);
+      requireSameEvents(pipelined.data, sequential.data);
+      requireSameEvents(pipelined.acc, sequential.acc);
+      REQUIRE(pipelined.data.nEvents > 0);
+      requireSameBasis(pipelined.dataBasis, sequential.dataBasis);
+      if (precomputeIntegrals) {
+        // Summed in a different order
+        REQUIRE(arma::norm(pipelined.integrals - sequential.integrals, "inf")
+                <= 1e-6 * arma::norm(sequential.integrals, "inf"));
+      } else {
+        requireSameBasis(pipelined.accBasis, sequential.accBasis);
+      }
+    }
+  }
+  std::remove(dataPath.c_str());
+  std::remove(accPath.c_str());
+}
+
+TEST_CASE("A likelihood streamed under a memory budget matches the in-memory likelihood", "[Likelihood]") {
+  const string dataPath = "/tmp/kmatrix-test-streaming-data.root";
+  const string accPath = "/tmp/kmatrix-test-streaming-acc.root";
+  // More events than the smallest chunk (one integral block), so both samples span several chunks
+  writeEventFile(dataPath, 9000, 43, "kin", 1000);
+  writeEventFile(accPath, 14000, 44, "kin", 1000);
+  EventSelection cuts;
+  cuts.massMin = 1.1f;
+  cuts.massMax = 2.8f;
+  cuts.thetaMin = 0.3f;
+
+  arma::arma_rng::set_seed(43);
+  const arma::uword nWalkers = 6;
+  arma::fmat params(Likelihood::parameterNames().size(), nWalkers);
+  for (arma::uword p = 0; p < params.n_rows; p++) {
+    // Magnitudes and phases alternate
+    params.row(p) = (p % 2 == 0 ? 100.0f : 6.0f) * arma::randu<arma::frowvec>(nWalkers);
+  }
+  for (const bool& precomputeIntegrals : {true, false}) {
+    for (const EventSelection& selection : {EventSelection(), cuts}) {
+      CAPTURE(precomputeIntegrals, selection.keepsAll());
+      Likelihood inMemory(dataPath, accPath, 30000);
+      Likelihood streamed(dataPath, accPath, 30000);
+      for (Likelihood* lh : {&inMemory, &streamed}) {
+        lh->setPrecomputeIntegrals(precomputeIntegrals);
+        lh->setSelection(selection);
+        lh->setNumThreads(2);
+      }
+      streamed.setMemoryBudget(1 << 20, "/tmp");
+      inMemory.setup();
+      streamed.setup();
+      const arma::fvec expected = inMemory.getExtendedLogLikelihoodBatch(params);
+      const arma::fvec result = streamed.getExtendedLogLikelihoodBatch(params);
+      for (arma::uword w = 0; w < nWalkers; w++) {
+        CAPTURE(w);
+        REQUIRE(std::isfinite(expected(w)));
+        REQUIRE(result(w) == Catch::Approx(expected(w)).epsilon(1e-5));
+        REQUIRE(streamed.getExtendedLogLikelihood(params.col(w)) == Catch::Approx(expected(w)).epsilon(1e-5));
+      }
+    }
+  }
+  std::remove(dataPath.c_str());
+  std::remove(accPath.c_str());
+}
@@ -0,0 +1,127 @@
+#include <catch2/catch_all.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include "RunConfig.hpp"
+
+static string writeConfig(const string& text) {
+  const string path = "/tmp/kmatrix-test-run.cfg";
+  ofstream file(path);
+  file << text;
+  return path;
+}
+
+static RunConfig defaultConfig() {
+  RunConfig config;
+  config.parameters = {{"magnitude", 0.0f, 10.0f}, {"phase", 0.0f, 6.0f}};
+  config.addStage(50);
+  config.addMove("stretch", 1.0f);
+  return config;
+}
+
+TEST_CASE("RunConfig reads settings, bounds and the schedule", "[RunConfig]") {
+  RunConfig config = defaultConfig();
+  const string path = writeConfig(
+      "# Two stages\n"
+      "walkers = 32\n"
+      "seed = 17   # fixed\n"
+      "output = /tmp/chain.h5\n"
+      "checkpoint_every = 5\n"
+      "autocorr_every = 50\n"
+      "stop_tau_factor = 0\n"
+      "stop_rhat = 1.05\n"
+      "parameter f0(1370) Magnitude = 0 1000\n"
+      "parameter f0(1370) Phase = -pi tau\n"
+      "selection mass = 1.0 1.5\n"
+      "selection min_abs_weight = 1e-6\n"
+      "\n"
+      "stage = 100\n"
+      "move stretch = 0.5\n"
+      "move differential_evolution = 0.3 1e-5 1.0\n"
+      "move snooker = 0.2\n"
+      "stage = 20\n"
+      "move differential_evolution = 1\n");
+  config.read(path);
+  std::remove(path.c_str());
+  REQUIRE_NOTHROW(config.validate());
+  REQUIRE(config.walkers == 32);
+  REQUIRE(config.fixedSeed);
+  REQUIRE(config.seed == 17);
+  REQUIRE(config.output == "/tmp/chain.h5");
+  REQUIRE(config.checkpointEvery == 5);
+  REQUIRE(config.autocorrEvery == 50);
+  REQUIRE(config.autocorrWindow == 5000);
+  REQUIRE(config.stopTauFactor == 0.0f);
+  REQUIRE(config.stopRHat == 1.05f);
+  REQUIRE(config.parameters.size() == 2);
+  REQUIRE(config.parameters[1].name == "f0(1370) Phase");
+  REQUIRE(config.parameters[1].lower == Catch::Approx(-M_PI));
+  REQUIRE(config.parameters[1].upper == Catch::Approx(2.0 * M_PI));
+  REQUIRE(config.selection.massMin == 1.0f);
+  REQUIRE(config.selection.massMax == 1.5f);
+  REQUIRE(config.selection.minAbsWeight == 1.0e-6f);
+  REQUIRE_FALSE(config.selection.keepsAll());
+
+  const vector<RunConfig::Stage>& stages = config.getStages();
+  REQUIRE(stages.size() == 2);
+  REQUIRE(config.totalSteps() == 120);
+  REQUIRE(stages[0].moves.size() == 3);
+  REQUIRE(stages[0].moves[1].second == 0.3f);
+  REQUIRE(dynamic_cast<const DifferentialEvolutionMove*>(stages[0].moves[1].first) != nullptr);
+  REQUIRE(dynamic_cast<const DifferentialEvolutionSnookerMove*>(stages[0].moves[2].first) != nullptr);
+  REQUIRE(stages[1].steps == 20);
+  REQUIRE(stages[1].moveNames == vector<string>{"differential_evolution"});
+}
+
+TEST_CASE("RunConfig keeps settings that are not in the file", "[RunConfig]") {
+  RunConfig config = defaultConfig();
+  const Move* move = config.getStages()[0].moves[0].first;
+  const string path = writeConfig("walkers = 12\n");
+  config.read(path);
+  std::remove(path.c_str());
+  REQUIRE(config.walkers == 12);
+  REQUIRE_FALSE(config.fixedSeed);
+  REQUIRE(config.parameters.size() == 2);
+  REQUIRE(config.totalSteps() == 50);
+  REQUIRE(config.getStages()[0].moves[0].first == move);
+  REQUIRE(config.selection.keepsAll());
+}
+
+TEST_CASE("RunConfig rejects invalid entries with their line", "[RunConfig]") {
+  const vector<string> invalid = {"walker = 12\n", "walkers = -3\n", "walkers\n", "parameter = 0 1\n",
+      "parameter x = 0\n", "parameter x = 0 one\n", "selection energy = 0 1\n", "move stretch = 1\n",
+      "stage = 10\nmove jump = 1\n", "stage = 10\nmove stretch = 0\n", "stage = 10\nmove snooker = 1 2 3\n",
+      "stage = 10\nmove stretch = 1 0.5\n", "stop_rhat = 1 2\n"};
+  for (const string& text : invalid) {
+    CAPTURE(text);
+    RunConfig config = defaultConfig();
+    const string path = writeConfig("# comment\n" + text);
+    REQUIRE_THROWS_WITH(config.read(path), Catch::Matchers::StartsWith("Error: " + path + ":"));
+    std::remove(path.c_str());
+  }
+  RunConfig config;
+  REQUIRE_THROWS_AS(config.read("/tmp/kmatrix-test-missing.cfg"), std::runtime_error);
+
+  config = defaultConfig();
+  config.walkers = 4;
+  REQUIRE_THROWS_AS(config.validate(), std::runtime_error);
+  config = defaultConfig();
+  config.addStage(10);
+  REQUIRE_THROWS_AS(config.validate(), std::runtime_error);
+  config = defaultConfig();
+  config.autocorrWindow = 2;
+  REQUIRE_THROWS_AS(config.validate(), std::runtime_error);
+  config = defaultConfig();
+  config.parameters[0].upper = config.parameters[0].lower;
+  REQUIRE_THROWS_AS(config.validate(), std::runtime_error);
+}
+
+TEST_CASE("RunConfig checks its parameters against the expected names and order", "[RunConfig]") {
+  const RunConfig config = defaultConfig();
+  REQUIRE_NOTHROW(config.checkParameters({"magnitude", "phase"}));
+  REQUIRE_THROWS_WITH(config.checkParameters({"phase", "magnitude"}),
+      Catch::Matchers::ContainsSubstring("'magnitude'"));
+  REQUIRE_THROWS_AS(config.checkParameters({"magnitude"}), std::runtime_error);
+  REQUIRE_THROWS_WITH(config.checkParameters({"magnitude", "phase", "extra"}),
+      Catch::Matchers::ContainsSubstring("'extra'"));
+}
@@ -0,0 +1,116 @@
+#include <catch2/catch_all.hpp>
+#include <armadillo>
+#include <cstdint>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "EventFiles.hpp"
+#include "SetupCache.hpp"
+
+static size_t openDescriptors() {
+  size_t count = 0;
+  DIR* directory = opendir("/proc/self/fd");
+  while (directory && readdir(directory)) {
+    count++;
+  }
+  if (directory) {
+    closedir(directory);
+  }
+  return count;
+}
+
+// A sample with every third event rejected, its basis and integrals
+struct CachedSample {
+  explicit CachedSample(const string& input) : reader(input, "kin") {
+    reader.read(1);
+    valid.resize(reader.size());
+    for (size_t i = 0; i < valid.size(); i++) {
+      valid[i] = i % 3 != 0;
+    }
+    reader.compact(valid);
+    arma::arma_rng::set_seed(15);
+    basis.resize(reader.size());
+    for (arma::uword i = 0; i < basis.size(); i++) {
+      basis.set(i, arma::randn<arma::cx_fvec>(AmplitudeBasis::nCoefficients), static_cast<float>(arma::randu()));
+    }
+    integrals = arma::randn<arma::cx_mat>(13, 13);
+  }
+  DataReader reader;
+  vector<unsigned char> valid;
+  AmplitudeBasis basis;
+  arma::cx_mat integrals;
+};
+
+TEST_CASE("SetupCache loads the sample it saved", "[SetupCache]") {
+  const string input = "/tmp/kmatrix-test-cache-input.root";
+  writeEventFile(input, 300, 5);
+  const CachedSample sample(input);
+  const uint64_t key = SetupCache::key({input}, "kin", {1.0f, 2.0f}, {0.0});
+  REQUIRE(key != 0);
+  const string path = SetupCache::path("/tmp", "kmatrix-test", key);
+  SetupCache::save(path, key, sample.reader, sample.valid, &sample.basis, &sample.integrals);
+
+  DataReader reader(input, "kin");
+  vector<unsigned char> valid;
+  AmplitudeBasis basis;
+  arma::cx_mat integrals;
+  REQUIRE(SetupCache::load(path, key, reader, valid, &basis, &integrals));
+  REQUIRE(valid == sample.valid);
+  REQUIRE(reader.nEvents == 200);
+  REQUIRE(reader.masses == sample.reader.masses);
+  REQUIRE(reader.weights == sample.reader.weights);
+  REQUIRE(reader.thetas == sample.reader.thetas);
+  REQUIRE(reader.phis == sample.reader.phis);
+  REQUIRE(basis.size() == sample.basis.size());
+  for (arma::uword i = 0; i < basis.size(); i++) {
+    REQUIRE(basis.weight(i) == sample.basis.weight(i));
+    for (arma::uword k = 0; k < AmplitudeBasis::nCoefficients; k++) {
+      REQUIRE(basis.realData(k)[i] == sample.basis.realData(k)[i]);
+      REQUIRE(basis.imagData(k)[i] == sample.basis.imagData(k)[i]);
+    }
+  }
+  REQUIRE(arma::approx_equal(integrals, sample.integrals, "absdiff", 0.0));
+  std::remove(path.c_str());
+  std::remove(input.c_str());
+}
+
+TEST_CASE("SetupCache ignores stale and damaged files", "[SetupCache]") {
+  const string input = "/tmp/kmatrix-test-cache-stale.root";
+  writeEventFile(input, 300, 6);
+  const CachedSample sample(input);
+  const uint64_t key = SetupCache::key({input}, "kin", {1.0f, 2.0f}, {0.0});
+  const string path = SetupCache::path("/tmp", "kmatrix-test", key);
+  SetupCache::save(path, key, sample.reader, sample.valid, &sample.basis, &sample.integrals);
+
+  // Every input to the key changes it
+  REQUIRE(SetupCache::key({input}, "kin", {1.0f, 2.5f}, {0.0}) != key);
+  REQUIRE(SetupCache::key({input}, "kin", {1.0f, 2.0f}, {1e-4}) != key);
+  REQUIRE(SetupCache::key({input}, "other", {1.0f, 2.0f}, {0.0}) != key);
+  REQUIRE(SetupCache::key({input + ".missing"}, "kin", {1.0f, 2.0f}, {0.0}) == 0);
+
+  DataReader reader(input, "kin");
+  vector<unsigned char> valid;
+  AmplitudeBasis basis;
+  arma::cx_mat integrals;
+  // A file under the old key of a changed input
+  writeEventFile(input, 301, 6);
+  const uint64_t changedKey = SetupCache::key({input}, "kin", {1.0f, 2.0f}, {0.0});
+  REQUIRE(changedKey != key);
+  REQUIRE_FALSE(SetupCache::load(path, changedKey, reader, valid, &basis, &integrals));
+  REQUIRE_FALSE(SetupCache::load(path + ".missing", key, reader, valid, &basis, &integrals));
+
+  // A stride the basis cannot be mapped with
+  const size_t before = openDescriptors();
+  const int fd = open(path.c_str(), O_WRONLY);
+  REQUIRE(fd >= 0);
+  const uint64_t badStride = 1;
+  REQUIRE(pwrite(fd, &badStride, sizeof(badStride), 48) == sizeof(badStride));
+  close(fd);
+  REQUIRE_FALSE(SetupCache::load(path, key, reader, valid, &basis, &integrals));
+  REQUIRE(openDescriptors() == before);
+  // Without the basis, the rest of the file is still usable
+  REQUIRE(SetupCache::load(path, key, reader, valid, nullptr, &integrals));
+  std::remove(path.c_str());
+  std::remove(input.c_str());
+}
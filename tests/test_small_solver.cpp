@@ -0,0 +1,84 @@
+#include <catch2/catch_all.hpp>
+#include <complex>
+#include <random>
+#include "SmallSolver.hpp"
+
+template <size_t N>
+static void checkRandomSolve(std::mt19937& rng) {
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  SmallSolver::Matrix<N> A;
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      A[i][j] = std::complex<float>(dist(rng), dist(rng)) + (i == j ? 2.0f : 0.0f);
+    }
+  }
+  for (size_t column = 0; column < N; column++) {
+    SmallSolver::Vector<N> x;
+    float rcond = SmallSolver::solveColumn<N>(A, column, x);
+    CAPTURE(N, column, rcond);
+    REQUIRE(rcond > 0.0f);
+    REQUIRE(rcond <= 1.0f);
+    // A x must reproduce the unit vector
+    for (size_t i = 0; i < N; i++) {
+      std::complex<float> sum = 0.0f;
+      for (size_t j = 0; j < N; j++) {
+        sum += A[i][j] * x[j];
+      }
+      REQUIRE(std::abs(sum - (i == column ? 1.0f : 0.0f)) < 1e-5f);
+    }
+  }
+}
+
+TEST_CASE("SmallSolver solves for one column of the inverse", "[SmallSolver]") {
+  std::mt19937 rng(12345);
+  for (int trial = 0; trial < 20; trial++) {
+    checkRandomSolve<2>(rng);
+    checkRandomSolve<3>(rng);
+    checkRandomSolve<4>(rng);
+    checkRandomSolve<5>(rng);
+  }
+}
+
+TEST_CASE("SmallSolver pivots on zero diagonal elements", "[SmallSolver]") {
+  SmallSolver::Matrix<3> A = {{
+    {0.0f, 1.0f, 0.0f},
+    {0.0f, 0.0f, 1.0f},
+    {1.0f, 0.0f, 0.0f}
+  }};
+  SmallSolver::Vector<3> x;
+  REQUIRE(SmallSolver::solveColumn<3>(A, 0, x) == Catch::Approx(1.0f));
+  REQUIRE(x[0] == std::complex<float>(0.0f));
+  REQUIRE(x[1] == std::complex<float>(1.0f));
+  REQUIRE(x[2] == std::complex<float>(0.0f));
+}
+
+TEST_CASE("SmallSolver reports singular and ill-conditioned matrices", "[SmallSolver]") {
+  SECTION("Singular 2x2") {
+    SmallSolver::Matrix<2> A = {{{1.0f, 2.0f}, {2.0f, 4.0f}}};
+    SmallSolver::Vector<2> x;
+    REQUIRE(SmallSolver::solveColumn<2>(A, 1, x) == 0.0f);
+  }
+
+  SECTION("Singular 4x4") {
+    SmallSolver::Matrix<4> A{};
+    for (size_t i = 0; i < 4; i++) {
+      for (size_t j = 0; j < 4; j++) {
+        A[i][j] = std::complex<float>(static_cast<float>(i + 1), 0.0f) * static_cast<float>(j + 1);
+      }
+    }
+    SmallSolver::Vector<4> x;
+    REQUIRE(SmallSolver::solveColumn<4>(A, 0, x) == 0.0f);
+  }
+
+  SECTION("Nearly singular 3x3") {
+    SmallSolver::Matrix<3> A = {{
+      {1.0f, 0.0f, 0.0f},
+      {0.0f, 1.0f, 0.0f},
+      {0.0f, 0.0f, 1.0e-6f}
+    }};
+    SmallSolver::Vector<3> x;
+    float rcond = SmallSolver::solveColumn<3>(A, 0, x);
+    REQUIRE(rcond > 0.0f);
+    REQUIRE(rcond < 1.0e-5f);
+  }
+}
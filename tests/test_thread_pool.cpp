@@ -0,0 +1,147 @@
+#include <catch2/catch_all.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "ThreadPool.hpp"
+
+TEST_CASE("ThreadPool runs every index of a loop exactly once", "[ThreadPool]") {
+  ThreadPool pool(4);
+  REQUIRE(pool.size() == 4);
+  for (size_t n : {0, 1, 7, 1000, 100000}) {
+    vector<atomic<int>> seen(n);
+    for (atomic<int>& count : seen) {
+      count = 0;
+    }
+    pool.parallelFor(n, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        seen[i]++;
+      }
+    });
+    CAPTURE(n);
+    for (size_t i = 0; i < n; i++) {
+      REQUIRE(seen[i] == 1);
+    }
+  }
+  REQUIRE(pool.activeLoops() == 0);
+}
+
+TEST_CASE("ThreadPool runs nested loops from many callers without deadlocks", "[ThreadPool]") {
+  ThreadPool pool(3);
+  const size_t nWalkers = 70;
+  const size_t nEvents = 5000;
+  const int nCallers = 4;
+  atomic<long> total(0);
+  vector<thread> callers;
+  for (int c = 0; c < nCallers; c++) {
+    callers.emplace_back([&] {
+      // Loop over walkers, each with its own loop over events
+      pool.parallelFor(nWalkers, [&](size_t begin, size_t end) {
+        for (size_t w = begin; w < end; w++) {
+          atomic<long> events(0);
+          pool.parallelFor(nEvents, [&](size_t first, size_t last) {
+            events += last - first;
+          });
+          total += events;
+        }
+      });
+    });
+  }
+  for (thread& caller : callers) {
+    caller.join();
+  }
+  REQUIRE(total == static_cast<long>(nCallers * nWalkers * nEvents));
+  REQUIRE(pool.activeLoops() == 0);
+}
+
+TEST_CASE("ThreadPool rethrows exceptions from the loop body", "[ThreadPool]") {
+  ThreadPool pool(2);
+  atomic<size_t> done(0);
+  REQUIRE_THROWS_AS(pool.parallelFor(100, [&](size_t begin, size_t end) {
+    if (begin == 0) {
+      throw runtime_error("failed");
+    }
+    done += end - begin;
+  }), runtime_error);
+  // The pool is still usable afterwards
+  pool.parallelFor(100, [&](size_t begin, size_t end) { done += end - begin; });
+  REQUIRE(done >= 100);
+}
+
+TEST_CASE("ThreadPool grain size grows with the number of concurrent loops", "[ThreadPool]") {
+  const size_t n = 1000000;
+  REQUIRE(ThreadPool::grainSize(n, 128, 1) == (n + 4 * 128 - 1) / (4 * 128));
+  REQUIRE(ThreadPool::grainSize(n, 128, 70) > ThreadPool::grainSize(n, 128, 1));
+  REQUIRE(ThreadPool::grainSize(n, 1, 1) == n / 4);
+  REQUIRE(ThreadPool::grainSize(10, 128, 1) == 1);
+  // More concurrent loops than threads never splits below one task per loop
+  REQUIRE(ThreadPool::grainSize(n, 4, 1000) == n);
+}
+
+// Not run by default (hidden tag): prints how the walker-shaped loops scale with the pool size on this machine, e.g.
+// on the 128-core target with ./tests "[benchmark]"
+TEST_CASE("ThreadPool scaling with the number of threads", "[.][benchmark]") {
+  const size_t nWalkers = 70;
+  const size_t nEvents = 1 << 20;
+  const int nRepeats = 5;
+  vector<float> events(nEvents);
+  for (size_t i = 0; i < nEvents; i++) {
+    events[i] = static_cast<float>(i % 1000) / 1000.0f;
+  }
+  // A sum of logarithms over the events for every walker, like the data term of the likelihood
+  auto evaluate = [&](ThreadPool& pool, const size_t& nLoops) {
+    vector<double> sums(nLoops);
+    pool.parallelFor(nLoops, [&](size_t begin, size_t end) {
+      for (size_t w = begin; w < end; w++) {
+        const float scale = 1.0f + static_cast<float>(w);
+        atomic<double> sum(0.0);
+        pool.parallelFor(nEvents, [&](size_t first, size_t last) {
+          float partial = 0.0f;
+          for (size_t i = first; i < last; i++) {
+            partial += std::log(1.0f + scale * events[i]);
+          }
+          double current = sum.load();
+          while (!sum.compare_exchange_weak(current, current + partial)) {
+          }
+        });
+        sums[w] = sum.load();
+      }
+    });
+    return sums;
+  };
+
+  vector<size_t> threadCounts;
+  const size_t maxThreads = std::max(1u, thread::hardware_concurrency());
+  for (size_t nThreads = 1; nThreads < maxThreads; nThreads *= 2) {
+    threadCounts.push_back(nThreads);
+  }
+  threadCounts.push_back(maxThreads);
+  for (const size_t& nLoops : {size_t(1), nWalkers}) {
+    cout << "ThreadPool scaling, " << nLoops << " concurrent loop(s) of " << nEvents << " events" << endl;
+    cout << setw(8) << "threads" << setw(12) << "seconds" << setw(10) << "speedup" << setw(12) << "efficiency" << endl;
+    double serialSeconds = 0.0;
+    for (const size_t& nThreads : threadCounts) {
+      ThreadPool pool(nThreads);
+      evaluate(pool, nLoops);
+      double best = numeric_limits<double>::infinity();
+      for (int r = 0; r < nRepeats; r++) {
+        const auto start = chrono::steady_clock::now();
+        const vector<double> sums = evaluate(pool, nLoops);
+        best = std::min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        REQUIRE(std::isfinite(sums.back()));
+      }
+      if (nThreads == 1) {
+        serialSeconds = best;
+      }
+      const double speedup = serialSeconds / best;
+      cout << setw(8) << nThreads << setw(12) << best << setw(10) << speedup << setw(12) << speedup / nThreads
+           << endl;
+    }
+  }
+}